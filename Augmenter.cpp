@@ -0,0 +1,104 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "Augmenter.h"
+#include "MatPool.h"
+#include <sstream>
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace ccnr{
+
+namespace{
+
+//! FNV-1a, stable across platforms and runs unlike std::hash
+unsigned long long HashString(const std::string& str)
+{
+	unsigned long long h = 14695981039346656037ULL;
+	for(size_t i=0; i<str.size(); i++){
+		h ^= (unsigned char)str[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+}
+
+
+std::string Augmenter::VariantName(const std::string& source, int variant)
+{
+	std::ostringstream oss;
+	oss << source << "#" << variant;
+	return oss.str();
+}
+
+
+void Augmenter::Generate(const cv::Mat& src, const cv::Size& out_size, const std::string& source, int variant, cv::Mat& dst) const
+{
+	cv::RNG rng(HashString(source) ^ (_params.seed + 0x9e3779b97f4a7c15ULL * (unsigned long long)variant));
+	double scale = rng.uniform(1.0 - _params.max_scale, 1.0 + _params.max_scale);
+	double dx = rng.uniform(-_params.max_shift, _params.max_shift) * out_size.width;
+	double dy = rng.uniform(-_params.max_shift, _params.max_shift) * out_size.height;
+	double sigma = rng.uniform(0.0, _params.max_blur);
+	double contrast = rng.uniform(1.0 - _params.max_contrast, 1.0 + _params.max_contrast);
+	double brightness = rng.uniform(-_params.max_brightness, _params.max_brightness);
+
+	// same conversion as EdgeDirFeatures, done once on the source
+	cv::Mat gray;
+	if(src.channels() > 1){
+		MatPool::Use(gray);
+		cv::cvtColor(src, gray, cv::COLOR_RGB2GRAY);
+	}
+	else{
+		gray = src;
+	}
+
+	// resize to out_size, scale about the center and shift in one warp
+	double sx = scale * out_size.width / src.cols;
+	double sy = scale * out_size.height / src.rows;
+	cv::Mat affine = cv::Mat::zeros(2, 3, CV_64FC1);
+	affine.at<double>(0, 0) = sx;
+	affine.at<double>(0, 2) = (out_size.width - sx * src.cols) * 0.5 + dx;
+	affine.at<double>(1, 1) = sy;
+	affine.at<double>(1, 2) = (out_size.height - sy * src.rows) * 0.5 + dy;
+	cv::Mat warped;
+	MatPool::Use(warped);
+	cv::warpAffine(gray, warped, affine, out_size, cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+
+	if(sigma > 0.3)
+		cv::GaussianBlur(warped, warped, cv::Size(), sigma);
+
+	// contrast about mid gray and brightness in one saturating pass
+	warped.convertTo(dst, CV_8U, contrast, 128.0 * (1.0 - contrast) + brightness);
+}
+
+}
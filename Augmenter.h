@@ -0,0 +1,91 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __AUGMENTER__
+#define __AUGMENTER__
+
+#include <string>
+#include <opencv2/core/core.hpp>
+
+namespace ccnr{
+
+//! Ranges of the random changes made to a training image
+struct AugmentParams
+{
+	int variants;	// augmented samples per image in addition to the original
+	double max_shift;	// translation, fraction of the output size
+	double max_scale;	// scale in [1 - max_scale, 1 + max_scale]
+	double max_blur;	// gaussian sigma in [0, max_blur] pixels of the output
+	double max_contrast;	// contrast in [1 - max_contrast, 1 + max_contrast] around mid gray
+	double max_brightness;	// offset in [-max_brightness, max_brightness] gray levels
+	unsigned long long seed;
+
+	AugmentParams() : variants(0), max_shift(0.08), max_scale(0.1), max_blur(1.0),
+		max_contrast(0.3), max_brightness(20), seed(0x5eed){};
+};
+
+
+//! Random variants of a character image, made in memory
+/*!
+Shift, scale and the resize to the training size are one warpAffine; blur and
+contrast follow on the small output image, so a variant costs about as much
+as the plain resize. The random numbers depend only on the seed, the source
+name and the variant number, so a sample is the same whichever thread makes
+it and whether or not the run was resumed.
+*/
+class Augmenter
+{
+public:
+	explicit Augmenter(const AugmentParams& params = AugmentParams()) : _params(params){};
+
+	//! Variant number variant (1 ... params.variants) of src at out_size
+	/*!
+	\param[in] src gray or BGR image
+	\param[out] dst gray image of out_size
+	*/
+	void Generate(const cv::Mat& src, const cv::Size& out_size, const std::string& source, int variant, cv::Mat& dst) const;
+
+	const AugmentParams& Params() const{
+		return _params;
+	}
+
+	//! Index name of a variant, "source#variant"
+	static std::string VariantName(const std::string& source, int variant);
+
+private:
+	AugmentParams _params;
+};
+
+}
+
+#endif
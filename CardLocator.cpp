@@ -0,0 +1,276 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "CardLocator.h"
+#include "SearchBudget.h"
+#include "common.h"
+#include <cmath>
+#include <algorithm>
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace ccnr{
+
+namespace{
+
+// Clockwise from the corner nearest to the top-left, the longer side first
+void OrderCorners(std::vector<cv::Point2f>& quad)
+{
+	cv::Point2f center = (quad[0] + quad[1] + quad[2] + quad[3]) * 0.25f;
+	std::vector<std::pair<float, cv::Point2f> > angles;
+	for(int i=0; i<4; i++){
+		angles.push_back(std::make_pair(std::atan2(quad[i].y - center.y, quad[i].x - center.x), quad[i]));
+	}
+	// y points down, so an increasing angle turns clockwise on the image
+	std::sort(angles.begin(), angles.end(),
+		[](const std::pair<float, cv::Point2f>& a, const std::pair<float, cv::Point2f>& b){ return a.first < b.first; });
+	int first = 0;
+	for(int i=1; i<4; i++){
+		if(angles[i].second.x + angles[i].second.y < angles[first].second.x + angles[first].second.y)
+			first = i;
+	}
+	std::vector<cv::Point2f> ordered(4);
+	for(int i=0; i<4; i++){
+		ordered[i] = angles[(first + i) % 4].second;
+	}
+	// a card standing upright is laid down so that the rectified card is landscape
+	double horizontal = cv::norm(ordered[1] - ordered[0]) + cv::norm(ordered[3] - ordered[2]);
+	double vertical = cv::norm(ordered[2] - ordered[1]) + cv::norm(ordered[0] - ordered[3]);
+	if(horizontal < vertical)
+		std::rotate(ordered.begin(), ordered.begin() + 3, ordered.end());
+	quad = ordered;
+}
+
+
+// The card outline traced by a contour, if it is one
+bool CardQuad(const std::vector<cv::Point>& contour, double min_area, double aspect, double aspect_tolerance,
+	std::vector<cv::Point2f>& quad, double& area)
+{
+	std::vector<cv::Point> hull;
+	cv::convexHull(contour, hull);
+	double hull_area = cv::contourArea(hull);
+	if(hull_area < min_area)
+		return false;
+	// an outline runs along its hull; a patch of texture winds far inside it
+	double hull_length = cv::arcLength(hull, true);
+	if(cv::arcLength(contour, true) > 3.0 * hull_length)
+		return false;
+
+	std::vector<cv::Point> poly;
+	cv::approxPolyDP(hull, poly, 0.02 * hull_length, true);
+	quad.clear();
+	if(poly.size() == 4){
+		for(int i=0; i<4; i++){
+			quad.push_back(cv::Point2f((float)poly[i].x, (float)poly[i].y));
+		}
+	}
+	else{
+		// rounded or cut corners: the smallest enclosing rectangle if the outline fills it
+		cv::RotatedRect box = cv::minAreaRect(hull);
+		if(hull_area < 0.9 * box.size.area())
+			return false;
+		cv::Point2f points[4];
+		box.points(points);
+		quad.assign(points, points + 4);
+	}
+	OrderCorners(quad);
+
+	double width = (cv::norm(quad[1] - quad[0]) + cv::norm(quad[2] - quad[3])) / 2;
+	double height = (cv::norm(quad[2] - quad[1]) + cv::norm(quad[3] - quad[0])) / 2;
+	if(height <= 0 || std::abs(width / height / aspect - 1.0) > aspect_tolerance)
+		return false;
+	area = cv::contourArea(quad);
+	return true;
+}
+
+}
+
+
+int CardLocator::FindQuads(const cv::Mat& img, std::vector<std::pair<double, std::vector<cv::Point2f> > >& quads) const
+{
+	SearchBudget budget(_params.time_limit_ms);
+	quads.clear();
+	if(img.empty())
+		return -1;
+
+	cv::Mat gray;
+	if(img.channels() > 1)
+		cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+	else
+		gray = img;
+
+	cv::Mat small;
+	double scale = std::min(1.0, (double)_params.work_width / gray.cols);
+	if(scale < 1.0)
+		cv::resize(gray, small, cv::Size(round(gray.cols * scale), round(gray.rows * scale)), 0, 0, cv::INTER_AREA);
+	else
+		small = gray;
+
+	// strong edges of the downsampled frame
+	cv::Mat dx, dy, grad, edges;
+	cv::Sobel(small, dx, CV_16S, 1, 0);
+	cv::Sobel(small, dy, CV_16S, 0, 1);
+	cv::convertScaleAbs(dx, dx);
+	cv::convertScaleAbs(dy, dy);
+	cv::add(dx, dy, grad);
+	cv::threshold(grad, edges, 0, 255, cv::THRESH_BINARY | cv::THRESH_OTSU);
+	// close the small gaps of the outline
+	cv::morphologyEx(edges, edges, cv::MORPH_CLOSE, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3)));
+	if(!budget.Check())
+		return -1;
+
+	std::vector<std::vector<cv::Point> > contours;
+	cv::findContours(edges, contours, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE);
+	if(!budget.Check())
+		return -1;
+
+	double min_area = _params.min_area * small.total();
+	std::vector<cv::Point2f> quad;
+	for(size_t i=0; i<contours.size(); i++){
+		if(!budget.Spend(contours[i].size()))
+			return -1;
+		if(cv::boundingRect(contours[i]).area() < min_area)
+			continue;
+		double area;
+		if(CardQuad(contours[i], min_area, _params.aspect, _params.aspect_tolerance, quad, area)){
+			// back to the pixel centers of img
+			for(int k=0; k<4; k++){
+				quad[k] = cv::Point2f((float)((quad[k].x + 0.5) / scale - 0.5), (float)((quad[k].y + 0.5) / scale - 0.5));
+			}
+			quads.push_back(std::make_pair(area, quad));
+		}
+	}
+	return 0;
+}
+
+
+int CardLocator::Locate(const cv::Mat& img, std::vector<cv::Point2f>& corners) const
+{
+	corners.clear();
+	std::vector<std::pair<double, std::vector<cv::Point2f> > > quads;
+	if(FindQuads(img, quads) < 0 || quads.empty())
+		return -1;
+
+	size_t best = 0;
+	for(size_t i=1; i<quads.size(); i++){
+		if(quads[i].first > quads[best].first)
+			best = i;
+	}
+	corners = quads[best].second;
+	return 0;
+}
+
+
+int CardLocator::LocateAll(const cv::Mat& img, std::vector<std::vector<cv::Point2f> >& cards, int max_cards) const
+{
+	cards.clear();
+	std::vector<std::pair<double, std::vector<cv::Point2f> > > quads;
+	if(FindQuads(img, quads) < 0)
+		return -1;
+
+	// the largest first, so that the inner outline of a card or a box printed on it is nested in the card
+	std::stable_sort(quads.begin(), quads.end(),
+		[](const std::pair<double, std::vector<cv::Point2f> >& a, const std::pair<double, std::vector<cv::Point2f> >& b){
+			return a.first > b.first;
+		});
+	std::vector<cv::Point2f> centers;
+	for(size_t i=0; i<quads.size(); i++){
+		if(max_cards > 0 && (int)cards.size() >= max_cards)
+			break;
+		const std::vector<cv::Point2f>& quad = quads[i].second;
+		cv::Point2f center = (quad[0] + quad[1] + quad[2] + quad[3]) * 0.25f;
+		bool nested = false;
+		for(size_t c=0; c<cards.size() && !nested; c++){
+			nested = cv::pointPolygonTest(cards[c], center, false) >= 0 || cv::pointPolygonTest(quad, centers[c], false) >= 0;
+		}
+		if(!nested){
+			cards.push_back(quad);
+			centers.push_back(center);
+		}
+	}
+
+	// row by row: a card starts a new row when its center is below the first card of the row by half a card height
+	std::vector<size_t> order(cards.size());
+	for(size_t i=0; i<order.size(); i++){
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b){ return centers[a].y < centers[b].y; });
+	std::vector<std::vector<cv::Point2f> > sorted;
+	for(size_t row_begin=0; row_begin<order.size(); ){
+		const std::vector<cv::Point2f>& first = cards[order[row_begin]];
+		float half_height = (float)(cv::norm(first[3] - first[0]) + cv::norm(first[2] - first[1])) / 4;
+		size_t row_end = row_begin + 1;
+		while(row_end < order.size() && centers[order[row_end]].y - centers[order[row_begin]].y < half_height)
+			row_end++;
+		std::sort(order.begin() + row_begin, order.begin() + row_end, [&](size_t a, size_t b){ return centers[a].x < centers[b].x; });
+		for(size_t i=row_begin; i<row_end; i++){
+			sorted.push_back(cards[order[i]]);
+		}
+		row_begin = row_end;
+	}
+	cards.swap(sorted);
+	return (int)cards.size();
+}
+
+
+cv::Size CardLocator::CardSize() const
+{
+	return cv::Size(_params.card_width, round(_params.card_width / _params.aspect));
+}
+
+
+void CardLocator::Rectify(const cv::Mat& img, const std::vector<cv::Point2f>& corners, cv::Mat& card, cv::Mat& homography) const
+{
+	CV_Assert(corners.size() == 4);
+	cv::Size size = CardSize();
+	cv::Point2f dst[4] = {
+		cv::Point2f(0, 0), cv::Point2f((float)(size.width - 1), 0),
+		cv::Point2f((float)(size.width - 1), (float)(size.height - 1)), cv::Point2f(0, (float)(size.height - 1))
+	};
+	cv::Mat to_card = cv::getPerspectiveTransform(&corners[0], dst);
+	cv::warpPerspective(img, card, to_card, size, cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+	homography = to_card.inv();
+}
+
+
+cv::Rect CardLocator::MapRect(const cv::Rect& rect, const cv::Mat& homography, const cv::Size& img_size)
+{
+	std::vector<cv::Point2f> src, dst;
+	src.push_back(cv::Point2f((float)rect.x, (float)rect.y));
+	src.push_back(cv::Point2f((float)rect.br().x, (float)rect.y));
+	src.push_back(cv::Point2f((float)rect.br().x, (float)rect.br().y));
+	src.push_back(cv::Point2f((float)rect.x, (float)rect.br().y));
+	cv::perspectiveTransform(src, dst, homography);
+	return TruncateRect(cv::boundingRect(dst), img_size);
+}
+
+}
@@ -0,0 +1,111 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __CARD_LOCATOR__
+#define __CARD_LOCATOR__
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+namespace ccnr{
+
+//! Search range and output of CardLocator
+struct LocatorParams
+{
+	int work_width;	// the frame is searched at this width [pixel]
+	double time_limit_ms;	// the search gives up after this, <= 0 for no limit
+	double min_area;	// smallest card, fraction of the frame area
+	double aspect;	// width / height of the card (ISO/IEC 7810 ID-1)
+	double aspect_tolerance;	// accepted relative deviation from aspect
+	int card_width;	// width of the rectified card [pixel]
+
+	LocatorParams() : work_width(400), time_limit_ms(20), min_area(0.05), aspect(85.60 / 53.98),
+		aspect_tolerance(0.25), card_width(640){};
+};
+
+
+//! Finds a card in a wide photo and rectifies it
+/*!
+Locate() looks for the card outline on a downsampled gradient image: the
+strong edges (Otsu threshold of |dx| + |dy|) are traced as contours, and the
+largest convex quadrilateral with the card's aspect ratio wins. Only the
+found quadrilateral is warped to the canonical size by Rectify(), so the
+recognition sees the digits with as many pixels as the photo has.
+*/
+class CardLocator
+{
+public:
+	explicit CardLocator(const LocatorParams& params = LocatorParams()) : _params(params){};
+
+	//! Corners of the card in img, clockwise from the top-left of the longer side
+	/*!
+	\param[in] img gray image
+	\return 0 if a card was found, -1 if not or the time ran out
+	*/
+	int Locate(const cv::Mat& img, std::vector<cv::Point2f>& corners) const;
+
+	//! Corners of every card of a page, e.g. a flatbed scan with several cards
+	/*!
+	The page is searched once as by Locate(); the quadrilaterals are taken from the
+	largest down, skipping those nested in a card already taken, and are returned
+	row by row from the top-left.
+	\param[in] max_cards at most this many cards, <= 0 for no limit
+	\return number of cards, -1 if the time ran out
+	*/
+	int LocateAll(const cv::Mat& img, std::vector<std::vector<cv::Point2f> >& cards, int max_cards = 0) const;
+
+	//! Warp the card to card_width x card_width / aspect
+	/*!
+	\param[out] homography maps the points of card to img (CV_64FC1)
+	*/
+	void Rectify(const cv::Mat& img, const std::vector<cv::Point2f>& corners, cv::Mat& card, cv::Mat& homography) const;
+
+	//! Bounding box in the photo of a box on the rectified card
+	static cv::Rect MapRect(const cv::Rect& rect, const cv::Mat& homography, const cv::Size& img_size);
+
+	const LocatorParams& Params() const{
+		return _params;
+	}
+
+	cv::Size CardSize() const;
+
+private:
+	LocatorParams _params;
+
+	//! Card quadrilaterals of img with their areas, in the pixels of img
+	int FindQuads(const cv::Mat& img, std::vector<std::pair<double, std::vector<cv::Point2f> > >& quads) const;
+};
+
+}
+
+#endif
@@ -0,0 +1,167 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "CreditLayout.h"
+#include "NumberDetect.h"
+#include <sstream>
+#include <cstdlib>
+
+namespace ccnr{
+
+namespace{
+
+const int BUILTIN_GROUPS[CreditLayout::BUILTIN_NUM][6] = {
+	{4, 4, 4, 4, 0},
+	{4, 6, 5, 0},
+	{4, 6, 4, 0},
+	{4, 4, 4, 4, 3, 0},
+	{4, 4, 5, 0}
+};
+
+std::vector<int> BuiltinGroups(int type)
+{
+	std::vector<int> groups;
+	for(int i=0; BUILTIN_GROUPS[type][i] > 0; i++){
+		groups.push_back(BUILTIN_GROUPS[type][i]);
+	}
+	return groups;
+}
+
+}
+
+
+const int CreditLayout::BUILTIN_NUM;
+
+
+CreditLayout::CreditLayout(const std::vector<int>& groups) : _type(-1), _groups(groups)
+{
+	int group_num = groups.size();
+	std::ostringstream name;
+	_break_pattern.push_back(NumberDetect::CHAR_STRING_LEFT);
+	for(int j=0; j<group_num; j++){
+		if(j > 0)
+			name << "-";
+		name << groups[j];
+
+		_box_begin.push_back(_break_pattern.size() - 1);
+		for(int i=0; i<groups[j]-1; i++){
+			_break_pattern.push_back(NumberDetect::CHAR_BLANK);
+		}
+		if(j < group_num - 1){
+			_break_pattern.push_back(NumberDetect::CHAR_RIGHT);
+			_box_end.push_back(_break_pattern.size() - 1);
+			_break_pattern.push_back(NumberDetect::CHAR_LEFT);
+		}
+	}
+	_break_pattern.push_back(NumberDetect::CHAR_STRING_RIGHT);
+	_box_end.push_back(_break_pattern.size() - 1);
+	_name = name.str();
+
+	for(int t=0; t<BUILTIN_NUM; t++){
+		if(BuiltinGroups(t) == groups){
+			_type = t;
+			break;
+		}
+	}
+}
+
+
+CreditLayout CreditLayout::Builtin(int type)
+{
+	if(type < 0 || type >= BUILTIN_NUM)
+		return CreditLayout();
+	return CreditLayout(BuiltinGroups(type));
+}
+
+
+int CreditLayout::Parse(const std::string& spec, CreditLayout& layout)
+{
+	std::vector<int> groups;
+	std::istringstream is(spec);
+	std::string token;
+	while(std::getline(is, token, '-')){
+		char* end;
+		long n = std::strtol(token.c_str(), &end, 10);
+		if(token.empty() || *end != '\0' || n <= 0 || n > 32)
+			return -1;
+		groups.push_back((int)n);
+	}
+	if(groups.empty())
+		return -1;
+	layout = CreditLayout(groups);
+	return 0;
+}
+
+
+int CreditLayout::ParseList(const std::string& specs, std::vector<CreditLayout>& layouts)
+{
+	std::vector<CreditLayout> result;
+	std::istringstream is(specs);
+	std::string spec;
+	while(std::getline(is, spec, ',')){
+		CreditLayout layout;
+		if(Parse(spec, layout) < 0)
+			return -1;
+		result.push_back(layout);
+	}
+	if(result.empty())
+		return -1;
+	layouts.swap(result);
+	return 0;
+}
+
+
+int CreditLayout::DigitNum() const
+{
+	int num = 0;
+	for(size_t i=0; i<_groups.size(); i++){
+		num += _groups[i];
+	}
+	return num;
+}
+
+
+void CreditLayout::ConvertToRects(const std::vector<int>& breaks, std::vector<cv::Rect>& number_rects, const cv::Rect& region) const
+{
+	if(breaks.size() != _break_pattern.size())
+		return;
+
+	for(size_t j=0; j<_box_begin.size(); j++){
+		for(int i=_box_begin[j]; i<_box_end[j]; i++){
+			cv::Rect rect(breaks[i], region.y, breaks[i+1] - breaks[i], region.height);
+			number_rects.push_back(rect);
+		}
+	}
+}
+
+}
@@ -0,0 +1,115 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __CREDIT_LAYOUT__
+#define __CREDIT_LAYOUT__
+
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+namespace ccnr{
+
+//! Digit grouping of a card number, e.g. 4-6-5
+/*!
+The break pattern searched by NumberDetect::ExtractCharRange and the index
+tables that turn the found breaks into digit boxes are compiled once when the
+layout is created.
+*/
+class CreditLayout
+{
+public:
+	//! Built-in layouts, see Builtin()
+	static const int BUILTIN_NUM = 5;
+
+	CreditLayout() : _type(-1){};
+
+	//! Compile a layout from its digit groups (each 1 or more digits)
+	explicit CreditLayout(const std::vector<int>& groups);
+
+	//! Built-in layout 0:4-4-4-4, 1:4-6-5, 2:4-6-4, 3:4-4-4-4-3, 4:4-4-5
+	static CreditLayout Builtin(int type);
+
+	//! Parse "4-4-4-4"-style text
+	/*!
+	\return 0 on success, -1 if spec is not a list of positive group sizes
+	*/
+	static int Parse(const std::string& spec, CreditLayout& layout);
+
+	//! Parse a comma separated list such as "4-4-4-4,4-6-5"
+	static int ParseList(const std::string& specs, std::vector<CreditLayout>& layouts);
+
+	bool empty() const{
+		return _groups.empty();
+	}
+
+	//! Index of the built-in layout with the same groups, -1 if none
+	int Type() const{
+		return _type;
+	}
+
+	const std::string& Name() const{
+		return _name;
+	}
+
+	const std::vector<int>& Groups() const{
+		return _groups;
+	}
+
+	int DigitNum() const;
+
+	//! Sequence of NumberDetect::CHAR_EDGE_TYPE from the left to the right end of the string
+	const std::vector<int>& BreakPattern() const{
+		return _break_pattern;
+	}
+
+	//! Length of the string in character pitches
+	int Span() const{
+		return (int)_break_pattern.size() - 1;
+	}
+
+	//! Convert break positions found for BreakPattern() into one box per digit
+	void ConvertToRects(const std::vector<int>& breaks, std::vector<cv::Rect>& number_rects, const cv::Rect& region) const;
+
+private:
+	int _type;
+	std::string _name;
+	std::vector<int> _groups;
+	std::vector<int> _break_pattern;
+	std::vector<int> _box_begin;	// index of the first break of each group
+	std::vector<int> _box_end;	// index of the last break of each group
+};
+
+}
+
+#endif
@@ -35,14 +35,232 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include "common.h"
+#include "Profiler.h"
+#include "FeatureFile.h"
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <map>
+#include <set>
+#include <functional>
+#include <sstream>
+#include <memory>
+#include <cmath>
+#include <cstdio>
 
 namespace ccnr{
 
+namespace{
+
+//! One row of a FeatureFile
+struct FeatureRow
+{
+	int label;
+	std::string source;
+	cv::Mat feature;
+
+	FeatureRow(int label_, const std::string& source_) : label(label_), source(source_){};
+};
+
+
+//! Produce the rows of jobs 0 ... jobs-1 on several threads and append them to writer in job order
+/*!
+Finished rows wait until all earlier jobs are written, so the file does not
+depend on the number of threads. A thread does not start a job more than a few
+times the number of threads ahead of the oldest unwritten one, which bounds the
+rows waiting behind a slow job. No job is started after writing has failed.
+\param[in] threads number of threads (0: all cores)
+*/
+int WriteRowsInOrder(FeatureFile& writer, size_t jobs, int threads,
+	const std::function<void(size_t, std::vector<FeatureRow>&)>& produce)
+{
+	if(threads <= 0)
+		threads = std::max(1, (int)std::thread::hardware_concurrency());
+	const long long flush_interval = 1024;
+	const size_t max_ahead = 4 * (size_t)threads;
+
+	std::mutex write_mutex;
+	std::condition_variable written;
+	std::map<size_t, std::vector<FeatureRow> > pending;
+	size_t next_write = 0;
+	bool failed = false;
+	std::atomic<size_t> next_job(0);
+
+	std::vector<std::thread> workers;
+	for(int t=0; t<threads; t++){
+		workers.push_back(std::thread([&](){
+			size_t job;
+			while((job = next_job++) < jobs){
+				{
+					// the thread of job next_write never waits, so this always moves on
+					std::unique_lock<std::mutex> lock(write_mutex);
+					written.wait(lock, [&](){ return failed || job < next_write + max_ahead; });
+					if(failed)
+						break;
+				}
+				std::vector<FeatureRow> rows;
+				produce(job, rows);
+
+				std::lock_guard<std::mutex> lock(write_mutex);
+				pending[job].swap(rows);
+				std::map<size_t, std::vector<FeatureRow> >::iterator it;
+				bool advanced = false;
+				while(!failed && (it = pending.find(next_write)) != pending.end()){
+					for(size_t r=0; r<it->second.size() && !failed; r++){
+						const FeatureRow& row = it->second[r];
+						if(writer.Append(row.label, row.feature, row.source) < 0
+							|| (writer.Rows() % flush_interval == 0 && writer.Flush() < 0))
+							failed = true;
+					}
+					pending.erase(it);
+					next_write++;
+					advanced = true;
+				}
+				if(advanced || failed)
+					written.notify_all();
+			}
+		}));
+	}
+	for(size_t t=0; t<workers.size(); t++){
+		workers[t].join();
+	}
+	return failed ? -1 : 0;
+}
+
+
+//! Intersection over union
+double Overlap(const cv::Rect& a, const cv::Rect& b)
+{
+	double inter = (a & b).area();
+	double uni = a.area() + b.area() - inter;
+	return (uni > 0) ? inter / uni : 0;
+}
+
+
+double MaxOverlap(const cv::Rect& rect, const std::vector<cv::Rect>& rects)
+{
+	double max_overlap = 0;
+	for(size_t i=0; i<rects.size(); i++){
+		max_overlap = std::max(max_overlap, Overlap(rect, rects[i]));
+	}
+	return max_overlap;
+}
+
+
+//! Window scored by the detector in a band
+struct MinedWindow
+{
+	double score;
+	cv::Rect window;
+	int band;
+	int feature_x;	// first feature column of the window
+
+	MinedWindow(double score_, const cv::Rect& window_, int band_, int feature_x_)
+		: score(score_), window(window_), band(band_), feature_x(feature_x_){};
+
+	bool operator<(const MinedWindow& other) const{
+		return score > other.score;
+	}
+};
+
+
+//! Index name of a mined window: "image@x,y,w,h"
+//! Index name of a mined row, "image@x,y,w,h:detector"
+std::string WindowName(const std::string& source, const cv::Rect& window, const std::string& detector)
+{
+	std::ostringstream oss;
+	oss << source << "@" << window.x << "," << window.y << "," << window.width << "," << window.height << detector;
+	return oss.str();
+}
+
+
+//! Image of a row named by WindowName, empty if another detector mined it
+std::string MinedImage(const std::string& name, const std::string& detector)
+{
+	size_t at = name.rfind('@');
+	if(at == std::string::npos || name.size() < at + detector.size()
+		|| name.compare(name.size() - detector.size(), detector.size(), detector) != 0)
+		return std::string();
+	return name.substr(0, at);
+}
+
+
+//! |d/dx| + |d/dy| of the working image
+void SumOfGradients(const cv::Mat& img, cv::Mat& row_grad, cv::Mat& col_grad, cv::Mat& sum_grad)
+{
+	CCNR_PROFILE_SCOPE(STAGE_SOBEL);
+	cv::Sobel(img, row_grad, CV_32F, 1, 0);
+	cv::Sobel(img, col_grad, CV_32F, 0, 1);
+	// abs in place instead of cv::abs() temporaries
+	cv::absdiff(row_grad, cv::Scalar::all(0), row_grad);
+	cv::absdiff(col_grad, cv::Scalar::all(0), col_grad);
+	cv::add(row_grad, col_grad, sum_grad);
+}
+
+
+//! Digit band of img, rotated as the working image was
+/*!
+\param[in] rotation 2x3 rotation of the working image (CV_64FC1)
+\param[in] ratio size of img over the working image
+\param[in] boxes digit boxes in the rotated working image; empty ones are skipped
+\param[out] band the band covering the boxes at the resolution of img
+\param[out] band_boxes the boxes in band
+\param[out] img_boxes their bounding boxes in img
+*/
+void CutRotatedBand(const cv::Mat& img, const cv::Mat& rotation, float ratio, const std::vector<cv::Rect>& boxes,
+	cv::Mat& band, std::vector<cv::Rect>& band_boxes, std::vector<cv::Rect>& img_boxes)
+{
+	std::vector<cv::Rect> scaled;
+	cv::Rect region;
+	for(size_t i=0; i<boxes.size(); i++){
+		if(boxes[i].width > 0 && boxes[i].height > 0){
+			cv::Rect rect((int)(ratio * boxes[i].x), (int)(ratio * boxes[i].y),
+				round(ratio * boxes[i].width), round(ratio * boxes[i].height));
+			region = scaled.empty() ? rect : (region | rect);
+			scaled.push_back(rect);
+		}
+	}
+	if(scaled.empty())
+		return;
+
+	// a point p of the rotated image at the resolution of img is L * p + ratio * t in img,
+	// where [L | t] is the inverse rotation of the working image
+	cv::Mat inverse;
+	cv::invertAffineTransform(rotation, inverse);
+	const double* r0 = inverse.ptr<double>(0);
+	const double* r1 = inverse.ptr<double>(1);
+	double band_to_img[] = {
+		r0[0], r0[1], r0[0] * region.x + r0[1] * region.y + ratio * r0[2],
+		r1[0], r1[1], r1[0] * region.x + r1[1] * region.y + ratio * r1[2]
+	};
+	cv::warpAffine(img, band, cv::Mat(2, 3, CV_64FC1, band_to_img), region.size(),
+		cv::INTER_LINEAR | cv::WARP_INVERSE_MAP, cv::BORDER_REPLICATE);
+
+	for(size_t i=0; i<scaled.size(); i++){
+		const cv::Rect& rect = scaled[i];
+		band_boxes.push_back(TruncateRect(cv::Rect(rect.x - region.x, rect.y - region.y, rect.width, rect.height), band.size()));
+		std::vector<cv::Point2f> corners;
+		int xs[] = {rect.x, rect.x + rect.width, rect.x + rect.width, rect.x};
+		int ys[] = {rect.y, rect.y, rect.y + rect.height, rect.y + rect.height};
+		for(int c=0; c<4; c++){
+			corners.push_back(cv::Point2f((float)(r0[0] * xs[c] + r0[1] * ys[c] + ratio * r0[2]),
+				(float)(r1[0] * xs[c] + r1[1] * ys[c] + ratio * r1[2])));
+		}
+		img_boxes.push_back(TruncateRect(cv::boundingRect(corners), img.size()));
+	}
+}
+
+}
+
 CreditNumberRecog::CreditNumberRecog(void)
 {
 	this->_input_width = 320;
 	this->_train_size = cv::Size(16,24);
 	this->_FeatureExtractor.init(4, 4, 0.5);
+	this->_MatPool = MatPool::Create();
+	this->_Model.SetExpectedCols(GetFeatureDims() + 1);
 }
 
 
@@ -53,8 +271,10 @@ CreditNumberRecog::~CreditNumberRecog(void)
 	
 void CreditNumberRecog::CreateFeature(const cv::Mat& img, cv::Mat& feature, bool resize_f) const
 {
+	ScopedMatPool pool_scope(_MatPool.get());
 	cv::Mat resize_img;
 	if(resize_f){
+		MatPool::Use(resize_img);
 		cv::resize(img, resize_img, _train_size);
 	}
 	else{
@@ -89,57 +309,598 @@ void CreditNumberRecog::CreateFeatures(const std::vector<std::string>& imglist,
 }
 
 
+long long CreditNumberRecog::CreateFeatureFile(const std::vector<std::string>& imglist, const std::vector<int>& labels,
+	const std::string& file, int threads, bool resume, const AugmentParams& augment) const
+{
+	if(imglist.size() != labels.size())
+		return -1;
+	FeatureFile writer;
+	std::vector<std::string> done_list;
+	if(writer.Open(file, GetFeatureDims(), resume, &done_list) < 0)
+		return -1;
+	std::set<std::string> done(done_list.begin(), done_list.end());
+	Augmenter augmenter(augment);
+	int variants = std::max(0, augment.variants);
 
-void CreditNumberRecog::RecognizeCreditCardNumber(const cv::Mat& card_img, std::vector<int>& numbers, std::vector<cv::Rect>& num_pos) const
+	// names of the rows of an image: the image itself, then its variants
+	std::vector<size_t> todo;
+	for(size_t i=0; i<imglist.size(); i++){
+		bool complete = done.count(imglist[i]) > 0;
+		for(int v=1; v<=variants && complete; v++){
+			complete = done.count(Augmenter::VariantName(imglist[i], v)) > 0;
+		}
+		if(!complete)
+			todo.push_back(i);
+	}
+
+	int ret = WriteRowsInOrder(writer, todo.size(), threads, [&](size_t job, std::vector<FeatureRow>& rows){
+		const std::string& source = imglist[todo[job]];
+		int label = labels[todo[job]];
+		// nothing is written for an image that cannot be read
+		cv::Mat img = cv::imread(source);
+		if(img.empty())
+			return;
+		if(!done.count(source)){
+			FeatureRow row(label, source);
+			CreateFeature(img, row.feature);
+			rows.push_back(row);
+		}
+		for(int v=1; v<=variants; v++){
+			FeatureRow row(label, Augmenter::VariantName(source, v));
+			if(done.count(row.source))
+				continue;
+			// the variant already has the training size
+			cv::Mat variant;
+			augmenter.Generate(img, _train_size, source, v, variant);
+			CreateFeature(variant, row.feature, false);
+			rows.push_back(row);
+		}
+	});
+	long long rows = writer.Rows();
+	if(writer.Close() < 0 || ret < 0)
+		return -1;
+	return rows;
+}
+
+
+
+int CreditNumberRecog::MineHardNegatives(const cv::Mat& card_img, const std::vector<cv::Rect>& digit_boxes, const MiningParams& params,
+	std::vector<cv::Mat>& features, std::vector<cv::Rect>* windows) const
 {
-	// O[XP[ϊ
+	features.clear();
+	if(windows)
+		windows->clear();
+	std::shared_ptr<const NumberRecog> recognizer = _Model.Get();
+	int class_num = recognizer->GetNumClassOVR();
+	if(class_num < 2)
+		return -1;
+	if(digit_boxes.empty() || params.max_per_image <= 0)
+		return 0;
+	ScopedMatPool pool_scope(_MatPool.get());
+
 	cv::Mat img;
 	if(card_img.channels() > 1){
+		MatPool::Use(img);
 		cv::cvtColor(card_img, img, cv::COLOR_RGB2GRAY);
 	}
 	else{
 		img = card_img;
 	}
 
+	// the digit band: median top and height of the boxes
+	std::vector<int> tops, heights;
+	for(size_t i=0; i<digit_boxes.size(); i++){
+		tops.push_back(digit_boxes[i].y);
+		heights.push_back(digit_boxes[i].height);
+	}
+	std::nth_element(tops.begin(), tops.begin() + tops.size() / 2, tops.end());
+	std::nth_element(heights.begin(), heights.begin() + heights.size() / 2, heights.end());
+	int band_top = tops[tops.size() / 2];
+	int band_height = heights[heights.size() / 2];
+	if(band_height <= 0)
+		return 0;
+
+	std::vector<int> band_tops(1, band_top);
+	if(params.shifted_bands){
+		band_tops.push_back(band_top - band_height / 2);
+		band_tops.push_back(band_top + band_height / 2);
+	}
+
+	// the filters are as large as a training sample and anchored at their center
+	cv::Size filter_size = _FeatureExtractor.calcSizeImg2Feature(_train_size);
+	int anchor_x = filter_size.width / 2;
+	int anchor_y = filter_size.height / 2;
+
+	std::vector<std::vector<cv::Mat> > band_features(band_tops.size());
+	std::vector<MinedWindow> candidates;
+	for(size_t b=0; b<band_tops.size(); b++){
+		cv::Rect band(0, band_tops[b], img.cols, band_height);
+		if(band.y < 0 || band.br().y > img.rows)
+			continue;
+
+		// band height to the training height, as in CreateCharExistingCost
+		double scale = (double)_train_size.height / band_height;
+		cv::Mat band_img;
+		MatPool::Use(band_img);
+		cv::resize(img(band), band_img, cv::Size(round(img.cols * scale), _train_size.height));
+		if(band_img.cols < _train_size.width)
+			continue;
+
+		_FeatureExtractor(band_img, band_features[b]);
+		std::vector<cv::Mat> responses;
+		recognizer->ScoreMapOVR(band_features[b], responses);
+
+		// only windows inside the band, so that no response depends on the border
+		int positions = band_features[b][0].cols - filter_size.width + 1;
+		int win_width = round(_train_size.width / scale);
+		for(int x=0; x<positions; x++){
+			// digit probability = 1 - background probability of the softmax (Score2CostOVR)
+			std::vector<float> resp(class_num);
+			for(int c=0; c<class_num; c++){
+				resp[c] = responses[c].at<float>(anchor_y, x + anchor_x);
+			}
+			float max_resp = *std::max_element(resp.begin(), resp.end());
+			double sum = 0;
+			for(int c=0; c<class_num; c++){
+				sum += std::exp(resp[c] - max_resp);
+			}
+			double score = 1.0 - std::exp(resp[class_num - 1] - max_resp) / sum;
+			if(score <= params.min_score)
+				continue;
+
+			int img_x = _FeatureExtractor.calcSizeFeature2Img(x) - _FeatureExtractor.calcSizeFeature2Img(0);
+			cv::Rect window(round(img_x / scale), band.y, win_width, band_height);
+			window &= cv::Rect(0, 0, img.cols, img.rows);
+			if(MaxOverlap(window, digit_boxes) > params.max_overlap)
+				continue;
+			candidates.push_back(MinedWindow(score, window, (int)b, x));
+		}
+	}
+
+	// highest scores first, without near duplicates
+	std::stable_sort(candidates.begin(), candidates.end());
+	std::vector<cv::Rect> selected;
+	for(size_t i=0; i<candidates.size() && (int)selected.size() < params.max_per_image; i++){
+		const MinedWindow& cand = candidates[i];
+		if(MaxOverlap(cand.window, selected) > params.nms_overlap)
+			continue;
+		selected.push_back(cand.window);
+
+		// the features the detector scored at this window
+		const std::vector<cv::Mat>& band_feature = band_features[cand.band];
+		std::vector<cv::Mat> window_features;
+		for(size_t d=0; d<band_feature.size(); d++){
+			window_features.push_back(band_feature[d](cv::Rect(cand.feature_x, 0, filter_size.width, filter_size.height)).clone());
+		}
+		cv::Mat feature;
+		EdgeDirFeatures::ConcatMatFeature1D(window_features, feature);
+		features.push_back(feature);
+	}
+	if(windows)
+		*windows = selected;
+	return (int)features.size();
+}
+
+
+long long CreditNumberRecog::MineHardNegativeFile(const std::vector<std::string>& imglist, const std::vector<std::vector<cv::Rect> >& digit_boxes,
+	const std::string& file, const MiningParams& params, int threads, bool resume) const
+{
+	std::shared_ptr<const NumberRecog> model = _Model.Get();
+	if(imglist.size() != digit_boxes.size() || model->GetNumClassOVR() < 2)
+		return -1;
+	// the negatives are added to the rows already in the file
+	FeatureFile writer;
+	std::vector<std::string> done_list;
+	if(writer.Open(file, GetFeatureDims(), true, &done_list) < 0)
+		return -1;
+
+	// rows are keyed by the detector, so a retrained one mines the cards again
+	char detector[16];
+	std::snprintf(detector, sizeof(detector), ":%08x", model->GetChecksumOVR());
+
+	std::set<std::string> done;
+	if(resume){
+		// The rows are written in job order, so only the last card of an interrupted run
+		// can be incomplete. Its windows are mined again if it is still in the list.
+		std::set<std::string> listed(imglist.begin(), imglist.end());
+		size_t tail = done_list.size();
+		std::string tail_image = tail > 0 ? MinedImage(done_list[tail - 1], detector) : std::string();
+		if(!tail_image.empty() && listed.count(tail_image)){
+			while(tail > 0 && MinedImage(done_list[tail - 1], detector) == tail_image)
+				tail--;
+			if(writer.DropRows((long long)(done_list.size() - tail)) < 0)
+				return -1;
+			done_list.resize(tail);
+		}
+		for(size_t i=0; i<done_list.size(); i++){
+			std::string image = MinedImage(done_list[i], detector);
+			if(!image.empty())
+				done.insert(image);
+		}
+	}
+	long long first_row = writer.Rows();
+
+	std::vector<size_t> todo;
+	for(size_t i=0; i<imglist.size(); i++){
+		if(!done.count(imglist[i]))
+			todo.push_back(i);
+	}
+
+	int ret = WriteRowsInOrder(writer, todo.size(), threads, [&](size_t job, std::vector<FeatureRow>& rows){
+		const std::string& source = imglist[todo[job]];
+		cv::Mat img = cv::imread(source);
+		if(img.empty())
+			return;
+		std::vector<cv::Mat> features;
+		std::vector<cv::Rect> windows;
+		MineHardNegatives(img, digit_boxes[todo[job]], params, features, &windows);
+		for(size_t i=0; i<features.size(); i++){
+			FeatureRow row(FeatureFile::LABEL_BACKGROUND, WindowName(source, windows[i], detector));
+			row.feature = features[i];
+			rows.push_back(row);
+		}
+	});
+	long long rows = writer.Rows() - first_row;
+	if(writer.Close() < 0 || ret < 0)
+		return -1;
+	return rows;
+}
+
+
+
+class CreditNumberRecog::DetectorBandCosts : public BandCostSource
+{
+public:
+	DetectorBandCosts(const CreditNumberRecog& owner, const NumberRecog& recognizer, const cv::Mat& proc_img,
+		float projection_weight, float learned_weight)
+		: BandCostSource(projection_weight, learned_weight), _owner(owner), _recognizer(recognizer), _proc_img(proc_img){};
+
+	void CharCosts(const cv::Rect& band, cv::Mat& exist_cost, cv::Mat& non_exist_cost){
+		const Band& entry = Find(band);
+		exist_cost = entry.exist_cost;
+		non_exist_cost = entry.non_exist_cost;
+	}
+
+	//! Digit with the largest response at the center of a box found in a scored band, -1 if none
+	int Classify(const cv::Rect& box) const{
+		cv::Point center(box.x + box.width / 2, box.y + box.height / 2);
+		for(size_t i=0; i<_bands.size(); i++){
+			const Band& band = _bands[i];
+			if(!band.rect.contains(center))
+				continue;
+			int x = center.x - band.rect.x;
+			// the last response is the background
+			int digit = 0;
+			for(int c=1; c<band.responses.rows - 1; c++){
+				if(band.responses.at<float>(c, x) > band.responses.at<float>(digit, x))
+					digit = c;
+			}
+			return digit;
+		}
+		return -1;
+	}
+
+private:
+	struct Band
+	{
+		cv::Rect rect;
+		cv::Mat exist_cost;
+		cv::Mat non_exist_cost;
+		cv::Mat responses;
+	};
+
+	const CreditNumberRecog& _owner;
+	const NumberRecog& _recognizer;
+	cv::Mat _proc_img;
+	std::vector<Band> _bands;
+
+	const Band& Find(const cv::Rect& rect){
+		for(size_t i=0; i<_bands.size(); i++){
+			if(_bands[i].rect == rect)
+				return _bands[i];
+		}
+		Band band;
+		band.rect = rect;
+		_owner.CreateCharExistingCost(_recognizer, _proc_img(rect), rect.width, band.exist_cost, band.non_exist_cost, &band.responses);
+		_bands.push_back(band);
+		return _bands.back();
+	}
+};
+
+
+const char* CreditNumberRecog::EngineName(int engine)
+{
+	static const char* names[] = {"projection", "detector", "mixed"};
+	if(engine < 0 || engine >= ENGINE_NUM)
+		return "";
+	return names[engine];
+}
+
+
+int CreditNumberRecog::ParseEngine(const std::string& name)
+{
+	for(int i=0; i<ENGINE_NUM; i++){
+		if(name == EngineName(i))
+			return i;
+	}
+	return -1;
+}
+
+
+const char* CreditNumberRecog::OrientationName(int orientation)
+{
+	static const char* names[] = {"upright", "mirrored", "flipped", "upside_down"};
+	if(orientation < 0 || orientation >= NumberDetect::ORIENTATION_NUM)
+		return "";
+	return names[orientation];
+}
+
+
+int CreditNumberRecog::ParseOrientations(const std::string& names)
+{
+	if(names == "all")
+		return (1 << NumberDetect::ORIENTATION_NUM) - 1;
+	int bits = 0;
+	std::istringstream iss(names);
+	std::string name;
+	while(std::getline(iss, name, ',')){
+		int o = 0;
+		while(o < NumberDetect::ORIENTATION_NUM && name != OrientationName(o))
+			o++;
+		if(o == NumberDetect::ORIENTATION_NUM)
+			return -1;
+		bits |= (1 << o);
+	}
+	return (bits == 0) ? -1 : bits;
+}
+
+
+void CreditNumberRecog::RecognizeCreditCardNumber(const cv::Mat& card_img, std::vector<int>& numbers, std::vector<cv::Rect>& num_pos) const
+{
+	RecognizeCreditCardNumber(card_img, numbers, num_pos, RecogOptions());
+}
+
+
+void CreditNumberRecog::RecognizeCreditCardNumber(const cv::Mat& card_img, std::vector<int>& numbers, std::vector<cv::Rect>& num_pos,
+	const RecogOptions& options, RecogStatus* status) const
+{
+	CCNR_PROFILE_SCOPE(STAGE_TOTAL);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	// the whole card is recognized with one model even if it is replaced meanwhile
+	std::shared_ptr<const NumberRecog> recognizer = _Model.Get();
+	SearchBudget budget(options.time_limit_ms, options.max_search_work);
+	ScopedMatPool pool_scope(_MatPool.get());
+
+	// O[XP[ϊ
+	cv::Mat img;
+	{
+		CCNR_PROFILE_SCOPE(STAGE_GRAYSCALE);
+		if(card_img.channels() > 1){
+			MatPool::Use(img);
+			cv::cvtColor(card_img, img, cv::COLOR_RGB2GRAY);
+		}
+		else{
+			img = card_img;
+		}
+	}
+
+	// a card in a wide photo is rectified, and the rest of the pipeline only sees the card
+	cv::Mat to_photo;	// rectified card -> card_img
+	std::vector<cv::Point2f> card_corners;
+	if(options.locate_card){
+		CCNR_PROFILE_SCOPE(STAGE_LOCATE);
+		CardLocator locator(options.locator);
+		if(locator.Locate(img, card_corners) == 0){
+			cv::Mat card;
+			MatPool::Use(card);
+			locator.Rectify(img, card_corners, card, to_photo);
+			img = card;
+		}
+		else{
+			card_corners.clear();
+		}
+	}
+
 	// 摜TCYϊ
 	cv::Mat proc_img;
-	cv::resize(img, proc_img, cv::Size(_input_width, round((float)img.rows * _input_width / img.cols)));
+	MatPool::Use(proc_img);
+	{
+		CCNR_PROFILE_SCOPE(STAGE_RESIZE);
+		cv::resize(img, proc_img, cv::Size(_input_width, round((float)img.rows * _input_width / img.cols)));
+	}
 	
 	// GbW摜쐬
 	cv::Mat RowGrad, ColGrad, SumGrad;
-	cv::Sobel(proc_img, RowGrad, CV_32F, 1, 0);
-	cv::Sobel(proc_img, ColGrad, CV_32F, 0, 1);
-	cv::add(cv::abs(RowGrad), cv::abs(ColGrad), SumGrad);
+	MatPool::Use(RowGrad);
+	MatPool::Use(ColGrad);
+	MatPool::Use(SumGrad);
+	SumOfGradients(proc_img, RowGrad, ColGrad, SumGrad);
+
+	// a small skew is measured on the edges; the working image is rotated once and its edges made again
+	cv::Mat rotation;	// proc_img -> the rotated proc_img
+	double skew_angle = 0;
+	if(options.deskew){
+		CCNR_PROFILE_SCOPE(STAGE_DESKEW);
+		double angle = SkewEstimator(options.skew).Estimate(SumGrad);
+		if(std::abs(angle) >= options.skew.min_angle){
+			skew_angle = angle;
+			rotation = cv::getRotationMatrix2D(cv::Point2f((proc_img.cols - 1) * 0.5f, (proc_img.rows - 1) * 0.5f), angle, 1.0);
+			cv::Mat rotated;
+			MatPool::Use(rotated);
+			cv::warpAffine(proc_img, rotated, rotation, proc_img.size(), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+			proc_img = rotated;
+			SumOfGradients(proc_img, RowGrad, ColGrad, SumGrad);
+		}
+	}
 
 	// ̈؂o
 	std::vector<cv::Rect> char_regions;
 	NumberDetect::CREDIT_PATTERN pattern;
-	_NumberDetector.ExtractNumbers(SumGrad, char_regions, pattern);
+	int engine = options.engine;
+	if(engine != ENGINE_PROJECTION && recognizer->GetNumClassOVR() < 2)
+		engine = ENGINE_PROJECTION;
+	std::unique_ptr<DetectorBandCosts> detector_costs;
+	if(engine == ENGINE_DETECTOR)
+		detector_costs.reset(new DetectorBandCosts(*this, *recognizer, proc_img, 0.0f, 1.0f));
+	else if(engine == ENGINE_MIXED)
+		detector_costs.reset(new DetectorBandCosts(*this, *recognizer, proc_img, 1.0f, (float)options.detector_weight));
+	// other orientations are searched on the same projections; the detector engines read upright cards only
+	NumberDetect::ORIENTATION orientation = NumberDetect::ORIENT_UPRIGHT;
+	double cost;
+	if(engine == ENGINE_PROJECTION && options.orientations != (1 << NumberDetect::ORIENT_UPRIGHT))
+		cost = _NumberDetector.ExtractNumbers(SumGrad, char_regions, pattern, orientation, options.orientations, &budget);
+	else
+		cost = _NumberDetector.ExtractNumbers(SumGrad, char_regions, pattern, &budget, detector_costs.get());
 
 	// oʊi[
 	std::vector<cv::Rect>::iterator rect_it, rect_it_end = char_regions.end();
 	float ratio = (float)img.cols / _input_width;
-	for(rect_it = char_regions.begin(); rect_it != rect_it_end; rect_it++){
-		if(rect_it->width > 0 && rect_it->height > 0){
-			cv::Rect rect((int)(ratio * rect_it->x), (int)(ratio * rect_it->y), 
-				round(ratio * rect_it->width), round(ratio * rect_it->height));
-			num_pos.push_back(TruncateRect(rect, img.size()));
+	cv::Mat char_src = img;	// the digits are cut out of this image
+	std::vector<cv::Rect> char_boxes;	// the boxes in char_src
+	if(rotation.empty()){
+		for(rect_it = char_regions.begin(); rect_it != rect_it_end; rect_it++){
+			if(rect_it->width > 0 && rect_it->height > 0){
+				cv::Rect rect((int)(ratio * rect_it->x), (int)(ratio * rect_it->y), 
+					round(ratio * rect_it->width), round(ratio * rect_it->height));
+				num_pos.push_back(TruncateRect(rect, img.size()));
+			}
 		}
+		char_boxes = num_pos;
+	}
+	else{
+		// only the digit band of the full image is rotated
+		cv::Mat band;
+		MatPool::Use(band);
+		CutRotatedBand(img, rotation, ratio, char_regions, band, char_boxes, num_pos);
+		char_src = band;
 	}
 
 	// F
-	rect_it_end = num_pos.end();
-	for(rect_it = num_pos.begin(); rect_it != rect_it_end; rect_it++){
-		cv::Mat feature;
-		CreateFeature(img(*rect_it).clone(), feature);
-		numbers.push_back(_NumberRecognizer.predict(feature));
+	if(engine == ENGINE_DETECTOR){
+		// the detector has already scored every column of the band
+		CCNR_PROFILE_SCOPE(STAGE_PREDICT);
+		rect_it_end = char_regions.end();
+		for(rect_it = char_regions.begin(); rect_it != rect_it_end; rect_it++){
+			if(rect_it->width > 0 && rect_it->height > 0)
+				numbers.push_back(detector_costs->Classify(*rect_it));
+		}
+	}
+	else{
+		rect_it_end = char_boxes.end();
+		for(rect_it = char_boxes.begin(); rect_it != rect_it_end; rect_it++){
+			cv::Mat char_img, feature;
+			MatPool::Use(char_img);
+			MatPool::Use(feature);
+			{
+				CCNR_PROFILE_SCOPE(STAGE_FEATURE);
+				char_src(*rect_it).copyTo(char_img);
+				if(orientation != NumberDetect::ORIENT_UPRIGHT)
+					cv::flip(char_img, char_img, NumberDetect::FlipCode(orientation));
+				CreateFeature(char_img, feature);
+			}
+			CCNR_PROFILE_SCOPE(STAGE_PREDICT);
+			numbers.push_back(recognizer->predict(feature));
+		}
+	}
+
+	if(!to_photo.empty()){
+		for(rect_it = num_pos.begin(); rect_it != num_pos.end(); rect_it++){
+			*rect_it = CardLocator::MapRect(*rect_it, to_photo, card_img.size());
+		}
+	}
+
+	if(status){
+		status->truncated = budget.Truncated();
+		status->cost = cost;
+		status->search_work = budget.Work();
+		status->elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		status->card_located = !to_photo.empty();
+		status->card_corners = card_corners;
+		status->skew_angle = skew_angle;
+		status->orientation = orientation;
+	}
+}
+
+
+int CreditNumberRecog::RecognizePage(const cv::Mat& page_img, std::vector<CardResult>& cards, const RecogOptions& options,
+	int threads) const
+{
+	cards.clear();
+	if(page_img.empty())
+		return -1;
+
+	// the page is converted and searched once, each card is then read at its own resolution
+	cv::Mat gray;
+	{
+		CCNR_PROFILE_SCOPE(STAGE_GRAYSCALE);
+		if(page_img.channels() > 1)
+			cv::cvtColor(page_img, gray, cv::COLOR_RGB2GRAY);
+		else
+			gray = page_img;
+	}
+
+	CardLocator locator(options.locator);
+	std::vector<std::vector<cv::Point2f> > corners;
+	{
+		CCNR_PROFILE_SCOPE(STAGE_LOCATE);
+		if(locator.LocateAll(gray, corners) < 0)
+			return -1;
 	}
+	cards.resize(corners.size());
+	if(cards.empty())
+		return 0;
 
+	RecogOptions card_options = options;
+	card_options.locate_card = false;
+
+	if(threads <= 0)
+		threads = std::max(1, (int)std::thread::hardware_concurrency());
+	threads = std::min(threads, (int)cards.size());
+	std::atomic<size_t> next_card(0);
+	std::vector<std::thread> workers;
+	for(int t=0; t<threads; t++){
+		workers.push_back(std::thread([&](){
+			size_t c;
+			while((c = next_card++) < cards.size()){
+				cv::Mat card, to_page;
+				{
+					CCNR_PROFILE_SCOPE(STAGE_LOCATE);
+					locator.Rectify(gray, corners[c], card, to_page);
+				}
+				CardResult& result = cards[c];
+				RecognizeCreditCardNumber(card, result.numbers, result.num_pos, card_options, &result.status);
+				for(std::vector<cv::Rect>::iterator it = result.num_pos.begin(); it != result.num_pos.end(); it++){
+					*it = CardLocator::MapRect(*it, to_page, page_img.size());
+				}
+				result.status.card_located = true;
+				result.status.card_corners = corners[c];
+			}
+		}));
+	}
+	for(size_t t=0; t<workers.size(); t++){
+		workers[t].join();
+	}
+	return (int)cards.size();
 }
 
 
 //! ij̑݊mɂƂÂeꏊ̃RXgZo
 void CreditNumberRecog::CreateCharExistingCost(const cv::Mat& img, int size, std::vector<double>& char_exist_cost, std::vector<double>& char_non_exist_cost) const
+{
+	ScopedMatPool pool_scope(_MatPool.get());
+	cv::Mat exist_cost, non_exist_cost;
+	CreateCharExistingCost(*_Model.Get(), img, size, exist_cost, non_exist_cost);
+
+	char_exist_cost.clear(), char_non_exist_cost.clear();
+	for(int i=0; i<size; i++){
+		char_exist_cost.push_back(exist_cost.at<float>(0,i));
+		char_non_exist_cost.push_back(non_exist_cost.at<float>(0,i));
+	}
+}
+
+
+void CreditNumberRecog::CreateCharExistingCost(const NumberRecog& recognizer, const cv::Mat& img, int size,
+	cv::Mat& char_exist_cost, cv::Mat& char_non_exist_cost, cv::Mat* responses) const
 {
 	// ̈̍P摜̂̂ɍ킹
 	cv::Mat resize_img;
@@ -151,9 +912,9 @@ void CreditNumberRecog::CreateCharExistingCost(const cv::Mat& img, int size, std
 	_FeatureExtractor(resize_img, features);
 	
 	// ʂɕ̑݃RXgƔ񑶍݃RXgZo
+	std::vector<cv::Mat> response_map;
 	cv::Mat pos_map, neg_map;
-	_NumberRecognizer.CharExistingCostOVR(features, pos_map, neg_map);
-	//_NumberRecognizer.CharExistingCost(features, pos_map, neg_map);
+	recognizer.CharExistingCostOVR(features, pos_map, neg_map, responses ? &response_map : 0);
 
 	// ʂ̃TCY摜TCY֕ύX
 	cv::Mat pos_map2, neg_map2;
@@ -168,8 +929,8 @@ void CreditNumberRecog::CreateCharExistingCost(const cv::Mat& img, int size, std
 	// ݃RXgP֕ϊ
 	int r = pos_map2.rows / 2;
 	cv::Mat exist_cost(1, resize_img.cols, CV_64FC1), non_exist_cost(1, resize_img.cols, CV_64FC1);
-	pos_map3(cv::Rect(0,r,pos_map3.cols,1)).copyTo(exist_cost);
-	neg_map3(cv::Rect(0,r,neg_map3.cols,1)).copyTo(non_exist_cost);
+	pos_map3(cv::Rect(0,r,pos_map3.cols,1)).copyTo(exist_cost.colRange(0,pos_map3.cols));
+	neg_map3(cv::Rect(0,r,neg_map3.cols,1)).copyTo(non_exist_cost.colRange(0,neg_map3.cols));
 
 	// ̃TCYƂ̕s
 	if(pos_map3.cols < detect_size.width){
@@ -186,12 +947,37 @@ void CreditNumberRecog::CreateCharExistingCost(const cv::Mat& img, int size, std
 	cv::Mat exist_cost2, non_exist_cost2;
 	cv::resize(exist_cost, exist_cost2, cv::Size(size,1));
 	cv::resize(non_exist_cost, non_exist_cost2, cv::Size(size,1));
+	exist_cost2.convertTo(char_exist_cost, CV_32F);
+	non_exist_cost2.convertTo(char_non_exist_cost, CV_32F);
 
-	// zi[
-	char_exist_cost.clear(), char_non_exist_cost.clear();
-	for(int i=0; i<size; i++){
-		char_exist_cost.push_back(exist_cost2.at<double>(0,i));
-		char_non_exist_cost.push_back(non_exist_cost2.at<double>(0,i));
+	// raw responses along the same row, the right end filled with the lowest response
+	if(responses){
+		int class_num = (int)response_map.size();
+		responses->create(class_num, size, CV_32FC1);
+		for(int c=0; c<class_num; c++){
+			cv::Mat resp_map;
+			_FeatureExtractor.ConvertFeature2ImageSize(response_map[c], resp_map);
+			cv::Mat resp_row(1, detect_size.width, CV_32FC1);
+			resp_map(cv::Rect(0,r,resp_map.cols,1)).copyTo(resp_row.colRange(0,resp_map.cols));
+			if(resp_map.cols < detect_size.width){
+				double resp_min, resp_max;
+				cv::minMaxLoc(response_map[c], &resp_min, &resp_max);
+				resp_row.colRange(resp_map.cols, detect_size.width) = cv::Scalar::all(resp_min);
+			}
+			cv::Mat dst = responses->row(c);
+			cv::resize(resp_row, dst, cv::Size(size,1));
+		}
+	}
+}
+
+
+void CreditNumberRecog::GetMatPoolStatistics(MatPoolStatistics& stats) const
+{
+	if(_MatPool){
+		_MatPool->GetStatistics(stats);
+	}
+	else{
+		stats.hits = stats.misses = stats.oversize = stats.cached_bytes = stats.outstanding = 0;
 	}
 }
 
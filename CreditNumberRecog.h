@@ -37,9 +37,76 @@
 #include "EdgeDirFeatures.h"
 #include "NumberDetect.h"
 #include "NumberRecog.h"
+#include "ModelHandle.h"
+#include "Profiler.h"
+#include "MatPool.h"
+#include "Augmenter.h"
+#include "CardLocator.h"
+#include "SkewEstimator.h"
 
 namespace ccnr{
 
+//! Source of the per-column costs of the character-break search
+typedef enum{
+	ENGINE_PROJECTION,	// gradient projections (NumberDetect::CreateAppearanceCosts)
+	ENGINE_DETECTOR,	// one-vs-rest detector costs; the digits are read from its responses
+	ENGINE_MIXED,	// projections plus detector_weight times the detector costs; the digits by the one-vs-one classifier
+	ENGINE_NUM
+}SEGMENT_ENGINE;
+
+//! Per-call limits of RecognizeCreditCardNumber
+struct RecogOptions
+{
+	double time_limit_ms;	// deadline of the character-range search from the start of the call, <= 0 for none
+	long long max_search_work;	// work units of the character-range search, <= 0 for no limit
+	int engine;	// SEGMENT_ENGINE; the detector engines fall back to ENGINE_PROJECTION without a detector
+	double detector_weight;	// weight of the detector costs of ENGINE_MIXED
+	bool locate_card;	// find the card in the photo first (CardLocator); the whole image if none is found
+	LocatorParams locator;
+	bool deskew;	// measure and undo a small skew of the card (SkewEstimator)
+	DeskewParams skew;
+	int orientations;	// bit (1 << o) of every NumberDetect::ORIENTATION o searched; the detector engines read upright cards only
+
+	RecogOptions() : time_limit_ms(0), max_search_work(0), engine(ENGINE_PROJECTION), detector_weight(1.0), locate_card(false), deskew(false),
+		orientations(1 << NumberDetect::ORIENT_UPRIGHT){};
+};
+
+//! What happened in one RecognizeCreditCardNumber call
+struct RecogStatus
+{
+	bool truncated;	// the search ran out of budget; the result is the best found so far
+	double cost;	// cost of the detected boxes, smaller is better
+	long long search_work;
+	double elapsed_ms;
+	bool card_located;	// the digits were read on the rectified card
+	std::vector<cv::Point2f> card_corners;	// corners of that card in card_img
+	double skew_angle;	// rotation that deskewed the card [degree], 0 if none
+	int orientation;	// NumberDetect::ORIENTATION the card was read in
+
+	RecogStatus() : truncated(false), cost(0), search_work(0), elapsed_ms(0), card_located(false), skew_angle(0),
+		orientation(NumberDetect::ORIENT_UPRIGHT){};
+};
+
+//! One card of a page read by RecognizePage
+struct CardResult
+{
+	std::vector<int> numbers;
+	std::vector<cv::Rect> num_pos;	// boxes of the digits in page_img
+	RecogStatus status;	// card_corners are the corners of the card in page_img
+};
+
+//! Selection of the background windows collected by MineHardNegatives
+struct MiningParams
+{
+	int max_per_image;	// negatives kept per card, the highest scores first
+	double min_score;	// digit probability of the detector above which a window is a false positive
+	double max_overlap;	// largest intersection over union of a negative with a digit box
+	double nms_overlap;	// largest intersection over union of two negatives of a card
+	bool shifted_bands;	// also scan the bands half a digit above and below the digits
+
+	MiningParams() : max_per_image(20), min_score(0.5), max_overlap(0.3), nms_overlap(0.5), shifted_bands(true){};
+};
+
 class CreditNumberRecog
 {
 public:
@@ -48,13 +115,94 @@ public:
 
 	void RecognizeCreditCardNumber(const cv::Mat& card_img, std::vector<int>& numbers, std::vector<cv::Rect>& num_pos) const;
 
+	//! Anytime version for a hard latency limit
+	/*!
+	The character-range search stops when options run out and the best boxes found so far
+	are recognized. status->truncated tells whether that happened.
+	With options.locate_card the card is searched in the photo and rectified first, and with
+	options.deskew a small skew is undone before the digits are searched; num_pos are still
+	boxes in card_img. With more than one of options.orientations the digits and num_pos are in
+	the reading order of the upright card, e.g. from right to left in an upside-down photo.
+	*/
+	void RecognizeCreditCardNumber(const cv::Mat& card_img, std::vector<int>& numbers, std::vector<cv::Rect>& num_pos,
+		const RecogOptions& options, RecogStatus* status = 0) const;
+
+	//! Read every card of a page, e.g. a flatbed scan of several cards, using several threads
+	/*!
+	The cards are proposed by one CardLocator::LocateAll() pass over the grayscale page with
+	options.locator, and each rectified card is recognized as by RecognizeCreditCardNumber()
+	with its own options.time_limit_ms and options.max_search_work.
+	\param[out] cards one per card, row by row from the top-left of the page
+	\param[in] threads number of threads (0: all cores)
+	\return number of cards, -1 if the card search ran out of options.locator.time_limit_ms
+	*/
+	int RecognizePage(const cv::Mat& page_img, std::vector<CardResult>& cards, const RecogOptions& options = RecogOptions(),
+		int threads = 0) const;
+
+	//! Load or replace the classifier, also while other threads are recognizing
+	/*!
+	Recognitions that have already started finish on the previous model.
+	\return number of classes, -1 if the file cannot be read or does not fit the feature size
+	*/
 	int LoadClassifier(const std::string& train_file){
-		return _NumberRecognizer.Load(train_file);
+		return _Model.Load(train_file);
 	};
 
+	//! Load the one-vs-rest detector used by MineHardNegatives and the detector engines
 	int LoadDetector(const std::string& detector_file){
 		//return _NumberRecognizer.LoadDetector(detector_file, _FeatureExtractor.calcSizeImg2Feature(_train_size));
-		return _NumberRecognizer.LoadOVR(detector_file, _FeatureExtractor.calcSizeImg2Feature(_train_size));
+		return _Model.LoadDetector(detector_file, _FeatureExtractor.calcSizeImg2Feature(_train_size));
+	}
+
+	bool HasDetector() const{
+		return _Model.Get()->GetNumClassOVR() >= 2;
+	}
+
+	//! "projection", "detector" or "mixed"
+	static const char* EngineName(int engine);
+
+	//! \return SEGMENT_ENGINE of an EngineName(), -1 if unknown
+	static int ParseEngine(const std::string& name);
+
+	//! "upright", "mirrored", "flipped" or "upside_down"
+	static const char* OrientationName(int orientation);
+
+	//! \return bits of RecogOptions::orientations from comma-separated OrientationName()s ("all": every one), -1 if unknown
+	static int ParseOrientations(const std::string& names);
+
+	//! Load the last classifier file again
+	int ReloadClassifier(){
+		return _Model.Reload();
+	}
+
+	//! Reload the classifier in a background thread when its file changes or on SIGHUP
+	/*!
+	SIGHUP is only seen after ModelHandle::InstallReloadSignal().
+	\return -1 if no classifier file has been loaded
+	*/
+	int WatchClassifier(double interval_sec = 1.0){
+		return _Model.StartWatching(interval_sec);
+	}
+
+	void StopWatchingClassifier(){
+		_Model.StopWatching();
+	}
+
+	//! Incremented every time a classifier is loaded
+	unsigned long long GetModelVersion() const{
+		return _Model.Version();
+	}
+
+	//! Digit layouts searched on the card (4-4-4-4, 4-6-5 and 4-6-4 by default)
+	/*!
+	\return -1 if layouts is empty
+	*/
+	int SetLayouts(const std::vector<CreditLayout>& layouts){
+		return _NumberDetector.SetLayouts(layouts);
+	}
+
+	const std::vector<CreditLayout>& GetLayouts() const{
+		return _NumberDetector.GetLayouts();
 	}
 
 	void CreateFeature(const cv::Mat& img, cv::Mat& feature, bool resize = true) const;
@@ -63,6 +211,48 @@ public:
 
 	void CreateFeatures(const std::vector<std::string>& imglist, cv::Mat& features, bool resize = true) const;
 
+	//! Write the features of labeled images into a FeatureFile, using several threads
+	/*!
+	Rows are written in the order of imglist. Images that cannot be read are skipped.
+	With resume, samples already in the file's index are not processed again.
+	Each image is followed by augment.variants variants made in memory (see Augmenter),
+	indexed as "image#1", "image#2", ...
+	\param[in] threads number of threads (0: all cores)
+	\return number of rows in the file, -1 if the file cannot be written
+	*/
+	long long CreateFeatureFile(const std::vector<std::string>& imglist, const std::vector<int>& labels,
+		const std::string& file, int threads = 0, bool resume = false, const AugmentParams& augment = AugmentParams()) const;
+
+	//! Background windows of a card that the one-vs-rest detector takes for digits
+	/*!
+	The detector scores every position of the digit band densely (as CreateCharExistingCost
+	does), and the windows that are not on a digit box and score above params.min_score
+	become hard negatives, with the features the detector saw there.
+	\param[in] digit_boxes true digit boxes in card_img, all on one line
+	\param[out] features one row per negative
+	\param[out] windows boxes of the negatives in card_img (may be NULL)
+	\return number of negatives, -1 if no detector is loaded
+	*/
+	int MineHardNegatives(const cv::Mat& card_img, const std::vector<cv::Rect>& digit_boxes, const MiningParams& params,
+		std::vector<cv::Mat>& features, std::vector<cv::Rect>* windows = 0) const;
+
+	//! Append the hard negatives of many cards to a FeatureFile as background, using several threads
+	/*!
+	Rows are indexed as "image@x,y,w,h:detector" with the CRC32 of the detector, and are
+	always added to the rows already in the file.
+	\param[in] threads number of threads (0: all cores)
+	\param[in] resume skip the cards this detector has already mined into the file; the rows
+	of the last card in the file may be incomplete, so that card is mined again
+	\return number of rows added, -1 if no detector is loaded or the file cannot be written
+	*/
+	long long MineHardNegativeFile(const std::vector<std::string>& imglist, const std::vector<std::vector<cv::Rect> >& digit_boxes,
+		const std::string& file, const MiningParams& params, int threads = 0, bool resume = false) const;
+
+	//! Dimensions of a feature vector (without the bias)
+	int GetFeatureDims() const{
+		return _FeatureExtractor.GetNumDirections() * _FeatureExtractor.calcSizeImg2Feature(_train_size).area();
+	}
+
 	int GetProcImageSize() const{
 		return _input_width;
 	}
@@ -71,16 +261,57 @@ public:
 		return _train_size;
 	}
 
+	//! Latency statistics of each pipeline stage, merged over all threads
+	/*!
+	Empty unless the library was built with CCNR_PROFILE (CCNR_ENABLE_PROFILE in CMake).
+	*/
+	static void GetStageStatistics(std::vector<StageStatistics>& stats){
+		Profiler::Collect(stats);
+	}
+
+	static void ResetStageStatistics(){
+		Profiler::Reset();
+	}
+
+	static void PrintStageStatistics(std::ostream& os){
+		Profiler::Print(os);
+	}
+
+	//! Recycle the buffers of pipeline temporaries (enabled by default)
+	/*!
+	The pool is shared by copies of this object and is only used by their own
+	temporaries; OpenCV's default allocator is not changed.
+	*/
+	void EnableMatPool(bool enable){
+		_MatPool = enable ? MatPool::Create() : std::shared_ptr<MatPool>();
+	}
+
+	//! All zero if the pool is disabled
+	void GetMatPoolStatistics(MatPoolStatistics& stats) const;
+
 	//! ij̑݊mɂƂÂeꏊ̃RXgZo
 	void CreateCharExistingCost(const cv::Mat& img, int size, std::vector<double>& char_exist_cost, std::vector<double>& char_non_exist_cost) const;
 
 private:
 	EdgeDirFeatures _FeatureExtractor;
 	NumberDetect _NumberDetector;
-	NumberRecog _NumberRecognizer;
+	ModelHandle _Model;
 
 	cv::Size _train_size;
 	int _input_width;
+
+	std::shared_ptr<MatPool> _MatPool;
+
+	//! Detector costs of the bands searched by one recognition, computed once per band
+	class DetectorBandCosts;
+
+	//! CreateCharExistingCost with a model snapshot
+	/*!
+	\param[out] char_exist_cost, char_non_exist_cost 1 x size, CV_32FC1
+	\param[out] responses one-vs-rest responses along the same row, one 1 x size row per class (may be NULL)
+	*/
+	void CreateCharExistingCost(const NumberRecog& recognizer, const cv::Mat& img, int size,
+		cv::Mat& char_exist_cost, cv::Mat& char_non_exist_cost, cv::Mat* responses = 0) const;
 };
 
 }
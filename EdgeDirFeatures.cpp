@@ -33,6 +33,7 @@
 
 #include "EdgeDirFeatures.h"
 #include <opencv2/imgproc/imgproc.hpp>
+#include "MatPool.h"
 //#include <opencv2/highgui/highgui.hpp>
 
 namespace ccnr{
@@ -72,7 +73,9 @@ void EdgeDirFeatures::operator()(const cv::Mat& src_img, std::vector<cv::Mat>& f
 	cv::Rect trunc_rect(1,1, src_img.cols-2, src_img.rows-2);
 	std::vector<cv::Mat>::iterator it, it_end = edge_dir.end();
 	for(it = edge_dir.begin(); it != it_end; it++){
-		cv::Mat feature = (*it)(trunc_rect).clone();
+		cv::Mat feature;
+		MatPool::Use(feature);
+		(*it)(trunc_rect).copyTo(feature);
 		edge_dir2.push_back(feature);
 	}
 
@@ -91,16 +94,22 @@ void EdgeDirFeatures::ExtractEdgeDir(const cv::Mat& src_img, std::vector<cv::Mat
 {
 	dir_imgs.resize(dir_num);
 	for(int i=0; i<dir_num; i++){
-		dir_imgs[i] = cv::Mat::zeros(src_img.size(), CV_64FC1);
+		MatPool::Use(dir_imgs[i]);
+		dir_imgs[i].create(src_img.size(), CV_64FC1);
+		dir_imgs[i] = cv::Scalar::all(0);
 	}
 
 	cv::Mat gray;
-	if(src_img.channels() > 1)
+	if(src_img.channels() > 1){
+		MatPool::Use(gray);
 		cv::cvtColor(src_img, gray, cv::COLOR_RGB2GRAY);
+	}
 	else
 		gray = src_img;
 
 	cv::Mat X_sobelMat, Y_sobelMat;
+	MatPool::Use(X_sobelMat);
+	MatPool::Use(Y_sobelMat);
 
 	cv::Sobel(gray, X_sobelMat, CV_64F, 1, 0);
 	cv::Sobel(gray, Y_sobelMat, CV_64F, 0, 1);
@@ -147,7 +156,9 @@ void EdgeDirFeatures::MaxPooling(const cv::Mat& img, cv::Mat& output, int pool_s
 	cv::Size out_size = calcSizeEdge2Max(img.size(), pool_size, overlap);
 	int step = pool_size * (1.0 - overlap);
 		
-	output = cv::Mat::zeros(out_size.height, out_size.width, CV_32FC1);
+	MatPool::Use(output);
+	output.create(out_size.height, out_size.width, CV_32FC1);
+	output = cv::Scalar::all(0);
 	cv::Rect rect(0,0,pool_size,pool_size);
 	int x, y;
 	int max_rect_x = img.cols - step;
@@ -171,6 +182,7 @@ void EdgeDirFeatures::MaxPooling(const std::vector<cv::Mat>& dir_imgs, std::vect
 	std::vector<cv::Mat>::const_iterator cit, cit_end = dir_imgs.end();
 	for(cit = dir_imgs.begin(); cit != cit_end; cit++){
 		cv::Mat out;
+		MatPool::Use(out);
 		MaxPooling(*cit, out, pool_size, overlap);
 		output.push_back(out);
 	}
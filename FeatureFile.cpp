@@ -0,0 +1,309 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "FeatureFile.h"
+#include <fstream>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace ccnr{
+
+const unsigned int FeatureFile::VERSION;
+const int FeatureFile::LABEL_BACKGROUND;
+
+namespace{
+
+const char MAGIC[8] = {'C', 'C', 'N', 'R', 'F', 'E', 'A', '\0'};
+const size_t HEADER_SIZE = 64;
+
+struct Header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t cols;
+	uint64_t rows;
+	char reserved[HEADER_SIZE - 24];
+};
+
+int ReadHeader(std::istream& is, Header& header)
+{
+	if(!is.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return -1;
+	if(std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != FeatureFile::VERSION || header.cols < 2)
+		return -1;
+	return 0;
+}
+
+long long FileSize(const std::string& file)
+{
+	std::ifstream ifs(file.c_str(), std::ios::binary | std::ios::ate);
+	if(!ifs.is_open())
+		return -1;
+	return (long long)ifs.tellg();
+}
+
+int TruncateFile(const std::string& file, long long size)
+{
+#ifdef _WIN32
+	int fd = _open(file.c_str(), _O_RDWR | _O_BINARY);
+	if(fd < 0)
+		return -1;
+	int ret = _chsize_s(fd, size);
+	_close(fd);
+	return ret == 0 ? 0 : -1;
+#else
+	return truncate(file.c_str(), (off_t)size) == 0 ? 0 : -1;
+#endif
+}
+
+}
+
+
+FeatureFile::FeatureFile() : _data(0), _index(0), _cols(0), _rows(0)
+{
+}
+
+
+FeatureFile::~FeatureFile()
+{
+	Close();
+}
+
+
+std::string FeatureFile::IndexFile(const std::string& file)
+{
+	return file + ".idx";
+}
+
+
+int FeatureFile::Open(const std::string& file, int feature_dims, bool resume, std::vector<std::string>* done)
+{
+	Close();
+	if(feature_dims <= 0)
+		return -1;
+	_file = file;
+	_cols = feature_dims + 1;
+	_rows = 0;
+	_row_buf.assign(_cols, 0.0f);
+	if(done)
+		done->clear();
+
+	if(resume && FileSize(file) >= 0)
+		return Resume(done);
+
+	_data = std::fopen(file.c_str(), "wb");
+	_index = std::fopen(IndexFile(file).c_str(), "wb");
+	if(!_data || !_index){
+		Close();
+		return -1;
+	}
+	Header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.cols = (uint32_t)_cols;
+	if(std::fwrite(&header, sizeof(header), 1, _data) != 1){
+		Close();
+		return -1;
+	}
+	return 0;
+}
+
+
+int FeatureFile::Resume(std::vector<std::string>* done)
+{
+	size_t row_bytes = _cols * sizeof(float);
+	{
+		std::ifstream ifs(_file.c_str(), std::ios::binary);
+		Header header;
+		// a file of other features is not overwritten by accident
+		if(ReadHeader(ifs, header) < 0 || (int)header.cols != _cols)
+			return -1;
+	}
+	long long data_rows = (FileSize(_file) - (long long)HEADER_SIZE) / (long long)row_bytes;
+
+	// complete index lines, as many as there are complete rows
+	std::vector<std::string> sources;
+	{
+		std::ifstream idx(IndexFile(_file).c_str(), std::ios::binary);
+		std::string line;
+		while((long long)sources.size() < data_rows && std::getline(idx, line)){
+			if(idx.eof())
+				break;	// no newline: cut off in the middle
+			sources.push_back(line);
+		}
+	}
+	_rows = (long long)sources.size();
+
+	// drop the partial tail of both files
+	if(TruncateFile(_file, (long long)HEADER_SIZE + _rows * (long long)row_bytes) < 0)
+		return -1;
+	_index = std::fopen(IndexFile(_file).c_str(), "wb");
+	if(!_index)
+		return -1;
+	for(size_t i=0; i<sources.size(); i++){
+		std::fputs(sources[i].c_str(), _index);
+		std::fputc('\n', _index);
+	}
+	_data = std::fopen(_file.c_str(), "r+b");
+	if(!_data || std::fseek(_data, 0, SEEK_END) != 0){
+		Close();
+		return -1;
+	}
+	if(done)
+		done->swap(sources);
+	return Flush();
+}
+
+
+int FeatureFile::Append(int label, const cv::Mat& feature, const std::string& source)
+{
+	if(!_data || (int)feature.total() * feature.channels() != _cols - 1)
+		return -1;
+	_row_buf[0] = (float)label;
+	cv::Mat row(1, _cols - 1, CV_32FC1, &_row_buf[1]);
+	cv::Mat src = feature.isContinuous() ? feature : feature.clone();
+	src.reshape(1, 1).convertTo(row, CV_32F);
+
+	if(std::fwrite(&_row_buf[0], sizeof(float), _cols, _data) != (size_t)_cols)
+		return -1;
+	std::fputs(source.c_str(), _index);
+	std::fputc('\n', _index);
+	_rows++;
+	return 0;
+}
+
+
+int FeatureFile::DropRows(long long rows)
+{
+	if(!_data || rows < 0 || rows > _rows || Flush() < 0)
+		return -1;
+	if(rows == 0)
+		return 0;
+	long long keep = _rows - rows;
+
+	std::vector<std::string> sources;
+	{
+		std::ifstream idx(IndexFile(_file).c_str(), std::ios::binary);
+		std::string line;
+		while((long long)sources.size() < keep && std::getline(idx, line)){
+			sources.push_back(line);
+		}
+	}
+	if((long long)sources.size() != keep)
+		return -1;
+	if(TruncateFile(_file, (long long)HEADER_SIZE + keep * (long long)(_cols * sizeof(float))) < 0
+		|| std::fseek(_data, 0, SEEK_END) != 0)
+		return -1;
+	std::fclose(_index);
+	_index = std::fopen(IndexFile(_file).c_str(), "wb");
+	if(!_index)
+		return -1;
+	for(size_t i=0; i<sources.size(); i++){
+		std::fputs(sources[i].c_str(), _index);
+		std::fputc('\n', _index);
+	}
+	_rows = keep;
+	return Flush();
+}
+
+
+int FeatureFile::Flush()
+{
+	if(!_data)
+		return -1;
+	// either file may get ahead of the other; Open() keeps the common prefix
+	if(std::fflush(_data) != 0 || std::fflush(_index) != 0)
+		return -1;
+	return 0;
+}
+
+
+int FeatureFile::Close()
+{
+	int ret = 0;
+	if(_data){
+		ret = Flush();
+		uint64_t rows = (uint64_t)_rows;
+		if(std::fseek(_data, offsetof(Header, rows), SEEK_SET) != 0 || std::fwrite(&rows, sizeof(rows), 1, _data) != 1)
+			ret = -1;
+		std::fclose(_data);
+		_data = 0;
+	}
+	if(_index){
+		std::fclose(_index);
+		_index = 0;
+	}
+	return ret;
+}
+
+
+int FeatureFile::Read(const std::string& file, cv::Mat& features, cv::Mat& labels)
+{
+	std::ifstream ifs(file.c_str(), std::ios::binary);
+	Header header;
+	if(!ifs.is_open() || ReadHeader(ifs, header) < 0)
+		return -1;
+	int cols = (int)header.cols;
+	size_t row_bytes = cols * sizeof(float);
+	long long rows = (FileSize(file) - (long long)HEADER_SIZE) / (long long)row_bytes;
+
+	features.create((int)rows, cols - 1, CV_32FC1);
+	labels.create((int)rows, 1, CV_32SC1);
+	// in chunks, so that the file is never held twice
+	const int chunk = 4096;
+	std::vector<float> buf((size_t)chunk * cols);
+	for(long long r=0; r<rows; r+=chunk){
+		int n = (int)std::min<long long>(chunk, rows - r);
+		if(!ifs.read(reinterpret_cast<char*>(&buf[0]), n * row_bytes))
+			return -1;
+		for(int i=0; i<n; i++){
+			const float* src = &buf[(size_t)i * cols];
+			labels.at<int>((int)r + i) = (int)src[0];
+			std::memcpy(features.ptr<float>((int)r + i), src + 1, (cols - 1) * sizeof(float));
+		}
+	}
+	return 0;
+}
+
+}
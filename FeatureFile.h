@@ -0,0 +1,128 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __FEATURE_FILE__
+#define __FEATURE_FILE__
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <opencv2/core/core.hpp>
+
+namespace ccnr{
+
+//! Binary file of training features with a label column
+/*!
+Layout (native byte order):
+\code
+ 0  char[8]  "CCNRFEA\0"
+ 8  uint32   version
+12  uint32   columns (1 + feature dimensions)
+16  uint64   rows (set by Close(), informational)
+24  reserved up to 64
+64  rows of float32: label, features...
+\endcode
+Rows are appended as they are produced, so the file can be written without
+holding the matrix in memory. Readers count the rows from the file size.
+
+The index file (IndexFile()) has one line per row naming the image it came
+from. It is written after the rows it describes, which lets Open() resume an
+interrupted run: rows without a complete index line are dropped and the images
+already in the index are reported as done.
+*/
+class FeatureFile
+{
+public:
+	static const unsigned int VERSION = 1;
+
+	//! Label of background samples
+	static const int LABEL_BACKGROUND = 10;
+
+	FeatureFile();
+	~FeatureFile();
+
+	//! Open for appending rows of feature_dims values
+	/*!
+	\param[in] resume keep the rows of an earlier run with the same dimensions instead of starting over
+	\param[out] done sources of the kept rows (may be NULL)
+	\return 0 on success, -1 on failure
+	*/
+	int Open(const std::string& file, int feature_dims, bool resume = false, std::vector<std::string>* done = 0);
+
+	//! Append one row
+	/*!
+	\param[in] feature feature_dims values of any depth
+	\param[in] source written to the index, must not contain a newline
+	*/
+	int Append(int label, const cv::Mat& feature, const std::string& source);
+
+	//! Remove the last rows, also those kept by Open()
+	int DropRows(long long rows);
+
+	//! Write buffered rows and index lines to the files
+	int Flush();
+
+	//! Flush, write the row count and close
+	int Close();
+
+	long long Rows() const{
+		return _rows;
+	}
+
+	//! Read a whole file
+	/*!
+	\param[out] features CV_32FC1, one row per sample
+	\param[out] labels CV_32SC1 column
+	*/
+	static int Read(const std::string& file, cv::Mat& features, cv::Mat& labels);
+
+	//! "<file>.idx"
+	static std::string IndexFile(const std::string& file);
+
+private:
+	std::FILE* _data;
+	std::FILE* _index;
+	std::string _file;
+	int _cols;
+	long long _rows;
+	std::vector<float> _row_buf;
+
+	FeatureFile(const FeatureFile&);
+	FeatureFile& operator=(const FeatureFile&);
+
+	int Resume(std::vector<std::string>* done);
+};
+
+}
+
+#endif
@@ -38,8 +38,55 @@
 #include <opencv2/videoio/videoio.hpp>
 #include <boost/filesystem/path.hpp>
 #include "util.h"
+#include "ModelFile.h"
+#include "ShmRing.h"
+#include "RawImage.h"
+#include "FeatureFile.h"
+#include "ResultCache.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <csignal>
+#include <cstring>
+#include <thread>
+#include <atomic>
+
+namespace{
+
+bool ReadFileBytes(const std::string& file, std::vector<uchar>& bytes)
+{
+	std::ifstream ifs(file.c_str(), std::ios::binary);
+	if(!ifs)
+		return false;
+	ifs.seekg(0, std::ios::end);
+	std::streamoff size = ifs.tellg();
+	if(size <= 0)
+		return false;
+	bytes.resize((size_t)size);
+	ifs.seekg(0, std::ios::beg);
+	return (bool)ifs.read((char*)bytes.data(), size);
+}
 
-MainAPI::MainAPI(void)
+//! Everything besides the input and the model that a cached result depends on
+unsigned long long OptionsFingerprint(const ccnr::RecogOptions& opt, bool multi_card, const std::vector<ccnr::CreditLayout>& layouts)
+{
+	std::ostringstream oss;
+	oss << opt.time_limit_ms << ' ' << opt.max_search_work << ' ' << opt.engine << ' ' << opt.detector_weight << ' '
+		<< opt.locate_card << ' ' << opt.locator.work_width << ' ' << opt.locator.time_limit_ms << ' ' << opt.locator.min_area << ' '
+		<< opt.locator.aspect << ' ' << opt.locator.aspect_tolerance << ' ' << opt.locator.card_width << ' '
+		<< opt.deskew << ' ' << opt.skew.max_angle << ' ' << opt.skew.min_angle << ' ' << opt.skew.coarse_step << ' '
+		<< opt.skew.strip_width << ' ' << opt.skew.max_evaluations << ' ' << opt.orientations << ' ' << multi_card;
+	for(size_t i=0; i<layouts.size(); i++){
+		oss << ' ' << layouts[i].Name();
+	}
+	std::string text = oss.str();
+	return ccnr::ResultCache::Hash(text.data(), text.size());
+}
+
+}
+
+
+MainAPI::MainAPI(void) : MultiCard(false), PageThreads(0)
 {
 }
 
@@ -109,6 +156,105 @@ void MainAPI::CreateTrainingAllFeatures(const std::string& directory, const std:
 }
 
 
+bool MainAPI::CreateTrainingFeatureFile(const std::string& directory, const std::string& save_file, int threads, bool resume,
+	const ccnr::AugmentParams& augment)
+{
+	using namespace boost::filesystem;
+
+	std::vector<std::string> img_list;
+	std::vector<int> labels;
+	for(int i=0; i<11; i++){
+		int label = (i == 10) ? ccnr::FeatureFile::LABEL_BACKGROUND : i;
+		path dir = path(directory) / path(i == 10 ? std::string("bg") : Int2String(i));
+		std::vector<std::string> class_list;
+		if(!ReadImageFilesInDirectory(dir.generic_string(), class_list)){
+			std::cerr << "Skip " << dir.generic_string() << std::endl;
+			continue;
+		}
+		// same order on every run, so that the file can be resumed
+		std::sort(class_list.begin(), class_list.end());
+		img_list.insert(img_list.end(), class_list.begin(), class_list.end());
+		labels.insert(labels.end(), class_list.size(), label);
+	}
+	if(img_list.empty()){
+		std::cerr << "No images in " << directory << std::endl;
+		return false;
+	}
+
+	long long rows = CCNR.CreateFeatureFile(img_list, labels, save_file, threads, resume, augment);
+	if(rows < 0){
+		std::cerr << "Fail to write " << save_file << (resume ? " (features of other dimensions?)" : "") << std::endl;
+		return false;
+	}
+	std::cout << "Save " << rows << " features of " << img_list.size() << " images to " << save_file << std::endl;
+	return true;
+}
+
+
+namespace{
+
+void PrintTrainStatistics(const std::vector<ccnr::SvmProblemStatistics>& stats)
+{
+	long long samples = 0, errors = 0;
+	for(size_t i=0; i<stats.size(); i++){
+		samples += stats[i].samples;
+		errors += stats[i].train_errors;
+		if(!stats[i].converged){
+			std::cerr << "Problem " << stats[i].positive << " vs "
+				<< (stats[i].negative < 0 ? std::string("rest") : Int2String(stats[i].negative))
+				<< " stopped after " << stats[i].iterations << " iterations" << std::endl;
+		}
+	}
+	std::cout << stats.size() << " problems, training error " << (samples > 0 ? (double)errors / samples : 0) << std::endl;
+}
+
+}
+
+
+bool MainAPI::Train(const std::string& feature_file, const std::string& model_file, const std::string& ovr_file,
+	const ccnr::SvmTrainParams& params)
+{
+	cv::Mat features, labels;
+	if(ccnr::FeatureFile::Read(feature_file, features, labels) < 0){
+		std::cerr << "Fail to read " << feature_file << std::endl;
+		return false;
+	}
+	if(features.cols != CCNR.GetFeatureDims()){
+		std::cerr << feature_file << " has " << features.cols << " dimensions, " << CCNR.GetFeatureDims() << " expected" << std::endl;
+		return false;
+	}
+	std::cout << "Train on " << features.rows << " samples" << std::endl;
+
+	std::vector<ccnr::SvmProblemStatistics> stats;
+	cv::Mat coeffs;
+	if(ccnr::SvmTrainer::TrainOneVsOne(features, labels, 10, params, coeffs, &stats) < 0){
+		std::cerr << "Every digit 0-9 needs training samples" << std::endl;
+		return false;
+	}
+	PrintTrainStatistics(stats);
+	if(ccnr::SvmTrainer::Save(model_file, coeffs) < 0){
+		std::cerr << "Fail to save " << model_file << std::endl;
+		return false;
+	}
+	std::cout << "Save " << model_file << std::endl;
+
+	if(!ovr_file.empty()){
+		cv::Mat ovr_coeffs;
+		if(ccnr::SvmTrainer::TrainOneVsRest(features, labels, ccnr::FeatureFile::LABEL_BACKGROUND + 1, params, ovr_coeffs, &stats) < 0){
+			std::cerr << "The detector needs samples of every digit and the background" << std::endl;
+			return false;
+		}
+		PrintTrainStatistics(stats);
+		if(ccnr::SvmTrainer::Save(ovr_file, ovr_coeffs) < 0){
+			std::cerr << "Fail to save " << ovr_file << std::endl;
+			return false;
+		}
+		std::cout << "Save " << ovr_file << std::endl;
+	}
+	return LoadClassifier(model_file);
+}
+
+
 bool MainAPI::LoadClassifier(const std::string& filename)
 {
 	if(CCNR.LoadClassifier(filename) < 0){
@@ -119,18 +265,125 @@ bool MainAPI::LoadClassifier(const std::string& filename)
 }
 
 
+bool MainAPI::LoadDetector(const std::string& filename)
+{
+	if(CCNR.LoadDetector(filename) < 0){
+		std::cerr << "Fail to load " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
 
-bool MainAPI::Recognize(const std::string& img_file, const std::string& save_name, bool display)
+
+namespace{
+
+//! Lines of "<image> <x> <y> <w> <h> ..."
+bool ReadDigitBoxes(const std::string& box_file, std::vector<std::string>& img_list, std::vector<std::vector<cv::Rect> >& boxes)
 {
-	cv::Mat card_img = cv::imread(img_file);
-	if(card_img.empty()){
-		std::cerr << "Fail to read " << img_file << std::endl;
+	std::ifstream ifs(box_file.c_str());
+	if(!ifs.is_open())
 		return false;
+	boost::filesystem::path dir = boost::filesystem::path(box_file).parent_path();
+	std::string line;
+	while(std::getline(ifs, line)){
+		std::istringstream iss(line);
+		std::string file;
+		if(!(iss >> file))
+			continue;
+		std::vector<cv::Rect> card_boxes;
+		cv::Rect rect;
+		while(iss >> rect.x >> rect.y >> rect.width >> rect.height){
+			card_boxes.push_back(rect);
+		}
+		boost::filesystem::path img_path(file);
+		if(img_path.is_relative())
+			img_path = dir / img_path;
+		img_list.push_back(img_path.generic_string());
+		boxes.push_back(card_boxes);
 	}
+	return true;
+}
 
-	std::vector<int> numbers;
-	std::vector<cv::Rect> num_pos;
-	CCNR.RecognizeCreditCardNumber(card_img, numbers, num_pos);
+}
+
+
+bool MainAPI::MineHardNegatives(const std::string& box_file, const std::string& feature_file, const ccnr::MiningParams& params, int threads,
+	bool resume)
+{
+	std::vector<std::string> img_list;
+	std::vector<std::vector<cv::Rect> > boxes;
+	if(!ReadDigitBoxes(box_file, img_list, boxes)){
+		std::cerr << "Fail to read " << box_file << std::endl;
+		return false;
+	}
+	long long rows = CCNR.MineHardNegativeFile(img_list, boxes, feature_file, params, threads, resume);
+	if(rows < 0){
+		std::cerr << "Fail to write " << feature_file << " (no detector loaded or features of other dimensions?)" << std::endl;
+		return false;
+	}
+	std::cout << "Add " << rows << " background features of " << img_list.size() << " cards to " << feature_file << std::endl;
+	return true;
+}
+
+
+bool MainAPI::WatchClassifier(double interval_sec)
+{
+	if(interval_sec <= 0){
+		CCNR.StopWatchingClassifier();
+		return true;
+	}
+	ccnr::ModelHandle::InstallReloadSignal();
+	if(CCNR.WatchClassifier(interval_sec) < 0){
+		std::cerr << "Fail to watch the model file (\"" << ccnr::ModelFile::BUILTIN_MODEL << "\" cannot be reloaded)" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+
+
+bool MainAPI::ConvertModel(const std::string& src_file, const std::string& dst_file, bool quantize)
+{
+	ccnr::ModelFile::MODEL_TYPE type = quantize ? ccnr::ModelFile::MODEL_Q8 : ccnr::ModelFile::MODEL_F32;
+	if(ccnr::ModelFile::Convert(src_file, dst_file, type) < 0){
+		std::cerr << "Fail to convert " << src_file << " to " << dst_file << std::endl;
+		return false;
+	}
+	std::cout << "Save " << dst_file << std::endl;
+	return true;
+}
+
+
+bool MainAPI::SetLayouts(const std::string& layouts)
+{
+	std::vector<ccnr::CreditLayout> layout_list;
+	if (ccnr::CreditLayout::ParseList(layouts, layout_list) < 0 || CCNR.SetLayouts(layout_list) < 0) {
+		std::cerr << "Wrong layout list: " << layouts << std::endl;
+		return false;
+	}
+	return true;
+}
+
+
+bool MainAPI::Recognize(const std::string& img_file, const std::string& save_name, bool display)
+{
+	if(MultiCard)
+		return RecognizePage(img_file, save_name, display, PageThreads);
+
+	cv::Mat card_img;
+	std::vector<ccnr::CardResult> cards;
+	if(!RecognizeFile(img_file, false, 0, display || !save_name.empty(), card_img, cards))
+		return false;
+
+	const std::vector<int>& numbers = cards[0].numbers;
+	const std::vector<cv::Rect>& num_pos = cards[0].num_pos;
+	const ccnr::RecogStatus& status = cards[0].status;
+	if(status.truncated){
+		std::cerr << "Search truncated after " << status.elapsed_ms << " ms (" << status.search_work << " steps); best result so far." << std::endl;
+	}
+	if(status.orientation != ccnr::NumberDetect::ORIENT_UPRIGHT){
+		std::cerr << "Card read as " << ccnr::CreditNumberRecog::OrientationName(status.orientation) << "." << std::endl;
+	}
 	
 	if(numbers.empty()){
 		std::cerr << "Fail to recognize. Classifier may not be loaded." << std::endl;
@@ -139,9 +392,16 @@ bool MainAPI::Recognize(const std::string& img_file, const std::string& save_nam
 
 	int num = numbers.size();
 	double font_scale = (double)card_img.cols / 300;
+	if(status.card_located && !card_img.empty()){
+		for(int i=0; i<4; i++){
+			cv::line(card_img, status.card_corners[i], status.card_corners[(i + 1) % 4], cv::Scalar(0,255,0), 2);
+		}
+	}
 	for(int i=0; i<num; i++){
-		cv::rectangle(card_img, num_pos[i], cv::Scalar(0,0,255));
-		cv::putText(card_img, Int2String(numbers[i]), cv::Point(num_pos[i].x, num_pos[i].y), cv::FONT_HERSHEY_PLAIN, font_scale, cv::Scalar(0,0,255), 2);
+		if(!card_img.empty()){
+			cv::rectangle(card_img, num_pos[i], cv::Scalar(0,0,255));
+			cv::putText(card_img, Int2String(numbers[i]), cv::Point(num_pos[i].x, num_pos[i].y), cv::FONT_HERSHEY_PLAIN, font_scale, cv::Scalar(0,0,255), 2);
+		}
 		std::cout << numbers[i];
 		//if(i < num-1)
 		//	std::cout << ",";
@@ -168,6 +428,113 @@ bool MainAPI::Recognize(const std::string& img_file, const std::string& save_nam
 }
 
 
+bool MainAPI::RecognizePage(const std::string& img_file, const std::string& save_name, bool display, int threads)
+{
+	cv::Mat page_img;
+	std::vector<ccnr::CardResult> cards;
+	if(!RecognizeFile(img_file, true, threads, display || !save_name.empty(), page_img, cards))
+		return false;
+	if(cards.empty()){
+		std::cerr << "No card found in " << img_file << std::endl;
+		return false;
+	}
+
+	double font_scale = (double)page_img.cols / 600;
+	for(size_t c=0; c<cards.size(); c++){
+		const ccnr::CardResult& card = cards[c];
+		if(!page_img.empty()){
+			for(int i=0; i<4; i++){
+				cv::line(page_img, card.status.card_corners[i], card.status.card_corners[(i + 1) % 4], cv::Scalar(0,255,0), 2);
+			}
+			for(size_t i=0; i<card.numbers.size(); i++){
+				cv::rectangle(page_img, card.num_pos[i], cv::Scalar(0,0,255));
+				cv::putText(page_img, Int2String(card.numbers[i]), cv::Point(card.num_pos[i].x, card.num_pos[i].y), cv::FONT_HERSHEY_PLAIN, font_scale, cv::Scalar(0,0,255), 2);
+			}
+		}
+		std::cout << "card " << c << ": ";
+		for(size_t i=0; i<card.numbers.size(); i++){
+			std::cout << card.numbers[i];
+		}
+		if(card.status.truncated)
+			std::cout << " (truncated)";
+		if(card.status.orientation != ccnr::NumberDetect::ORIENT_UPRIGHT)
+			std::cout << " (" << ccnr::CreditNumberRecog::OrientationName(card.status.orientation) << ")";
+		std::cout << std::endl;
+	}
+	if(display){
+		cv::namedWindow("Recognize");
+		cv::imshow("Recognize", page_img);
+		cv::waitKey();
+		cv::destroyWindow("Recognize");
+	}
+
+	if (!save_name.empty()) {
+		bool ret = cv::imwrite(save_name, page_img);
+		if (!ret) {
+			std::cerr << "Fail to save " << save_name << std::endl;
+			return false;
+		}
+		else {
+			std::cout << "Save " << save_name << std::endl;
+		}
+	}
+	return true;
+}
+
+
+bool MainAPI::RecognizeFile(const std::string& img_file, bool multi_card, int threads, bool decode, cv::Mat& img,
+	std::vector<ccnr::CardResult>& cards)
+{
+	std::vector<uchar> bytes;
+	std::shared_ptr<ccnr::ResultCache> cache = Cache;
+	ccnr::ResultCache::Key key;
+	if(cache){
+		if(!ReadFileBytes(img_file, bytes)){
+			std::cerr << "Fail to read " << img_file << std::endl;
+			return false;
+		}
+		key = ccnr::ResultCache::MakeKey(bytes.data(), bytes.size(), CCNR.GetModelVersion(),
+			OptionsFingerprint(Options, multi_card, CCNR.GetLayouts()));
+		// a hit is neither decoded nor recognized unless the image is shown
+		if(cache->Get(key, cards)){
+			if(decode)
+				img = cv::imdecode(bytes, cv::IMREAD_COLOR);
+			return true;
+		}
+		img = cv::imdecode(bytes, cv::IMREAD_COLOR);
+	}
+	else{
+		img = cv::imread(img_file);
+	}
+	if(img.empty()){
+		std::cerr << "Fail to read " << img_file << std::endl;
+		return false;
+	}
+
+	if(multi_card){
+		if(CCNR.RecognizePage(img, cards, Options, threads) < 0){
+			std::cerr << "Card search truncated after " << Options.locator.time_limit_ms << " ms." << std::endl;
+			return false;
+		}
+	}
+	else{
+		cards.assign(1, ccnr::CardResult());
+		CCNR.RecognizeCreditCardNumber(img, cards[0].numbers, cards[0].num_pos, Options, &cards[0].status);
+	}
+
+	// a truncated search depends on the load of the machine and is not repeated
+	if(cache){
+		bool truncated = false;
+		for(size_t c=0; c<cards.size(); c++){
+			truncated = truncated || cards[c].status.truncated;
+		}
+		if(!truncated)
+			cache->Put(key, cards);
+	}
+	return true;
+}
+
+
 bool MainAPI::RecognizeFolder(const std::string& directory, const std::string& save_dir)
 {
 	std::vector<std::string> img_list;
@@ -190,10 +557,133 @@ bool MainAPI::RecognizeFolder(const std::string& directory, const std::string& s
 			Recognize(*it, save_file, false);
 		}
 	}
+	PrintCacheStatistics(std::cout);
 	return true;
 }
 
 
+namespace{
+
+volatile std::sig_atomic_t stop_serving = 0;
+
+extern "C" void OnStopSignal(int)
+{
+	stop_serving = 1;
+}
+
+}
+
+
+bool MainAPI::ServeSharedMemory(const std::string& name, int slot_num, size_t frame_bytes, int threads, int producers)
+{
+	ccnr::ShmRing ring;
+	if(ring.Create(name, slot_num, frame_bytes, producers) < 0){
+		std::cerr << "Fail to create shared memory " << name << std::endl;
+		return false;
+	}
+	stop_serving = 0;
+	std::signal(SIGINT, OnStopSignal);
+	std::signal(SIGTERM, OnStopSignal);
+	std::cout << "Serving " << name << " (" << slot_num << " slots of " << frame_bytes << " bytes, up to " << producers << " producers)" << std::endl;
+
+	std::atomic<long long> frames(0), errors(0), dropped(0);
+	std::shared_ptr<ccnr::ResultCache> cache = Cache;
+	unsigned long long options = OptionsFingerprint(Options, false, CCNR.GetLayouts());
+	std::vector<std::thread> workers;
+	for(int t=0; t<std::max(1, threads); t++){
+		workers.push_back(std::thread([&](){
+			cv::Mat buf;
+			ccnr::ShmRing::Slot slot;
+			ccnr::ShmFrameInfo info;
+			while(!stop_serving){
+				if(ring.ReceiveFrame(slot, info, 100) < 0)
+					continue;
+
+				ccnr::ShmResult res;
+				std::memset(&res, 0, sizeof(res));
+				res.frame_id = info.frame_id;
+				res.status = CCNR_OK;
+				// the frame description comes from another process
+				long long bytes = ccnr::RawImage::Bytes(info.width, info.height, info.stride, info.format);
+				if(bytes < 0 || bytes > (long long)slot.capacity){
+					res.status = CCNR_ERROR_ARGUMENT;
+				}
+				else{
+					// the same pixels in another layout are another frame
+					std::vector<ccnr::CardResult> cards;
+					ccnr::ResultCache::Key key;
+					bool hit = false;
+					if(cache){
+						int32_t layout[4] = {info.width, info.height, info.stride, info.format};
+						key = ccnr::ResultCache::MakeKey(slot.data, (size_t)bytes, CCNR.GetModelVersion(),
+							ccnr::ResultCache::Hash(layout, sizeof(layout), options));
+						hit = cache->Get(key, cards);
+					}
+					try{
+						cv::Mat img;
+						if(!hit && ccnr::RawImage::Wrap(slot.data, info.width, info.height, info.stride, info.format, buf, img) < 0){
+							res.status = CCNR_ERROR_ARGUMENT;
+						}
+						else{
+							if(!hit){
+								cards.assign(1, ccnr::CardResult());
+								CCNR.RecognizeCreditCardNumber(img, cards[0].numbers, cards[0].num_pos, Options, &cards[0].status);
+								if(cache && !cards[0].status.truncated)
+									cache->Put(key, cards);
+							}
+							res.status = ccnr::RawImage::StoreResult(cards[0].numbers, cards[0].num_pos, cards[0].status, res.result);
+						}
+					}
+					catch(const std::exception& e){
+						std::cerr << "Frame " << info.frame_id << ": " << e.what() << std::endl;
+						res.status = CCNR_ERROR_INTERNAL;
+					}
+				}
+				ring.ReleaseFrame(slot);
+				frames++;
+				if(res.status != CCNR_OK)
+					errors++;
+				// a producer that stopped reading results must not stall the others
+				if(ring.SendResult(slot, res, 1000) < 0)
+					dropped++;
+			}
+		}));
+	}
+	for(size_t t=0; t<workers.size(); t++){
+		workers[t].join();
+	}
+	std::signal(SIGINT, SIG_DFL);
+	std::signal(SIGTERM, SIG_DFL);
+	std::cout << "Served " << frames << " frames, " << errors << " errors, " << dropped << " results dropped" << std::endl;
+	PrintCacheStatistics(std::cout);
+	return true;
+}
+
+
+void MainAPI::PrintProfile(std::ostream& os) const
+{
+	ccnr::CreditNumberRecog::PrintStageStatistics(os);
+}
+
+
+void MainAPI::EnableResultCache(size_t entries)
+{
+	Cache = entries > 0 ? std::make_shared<ccnr::ResultCache>(entries) : std::shared_ptr<ccnr::ResultCache>();
+}
+
+
+void MainAPI::PrintCacheStatistics(std::ostream& os) const
+{
+	std::shared_ptr<ccnr::ResultCache> cache = Cache;
+	if(!cache)
+		return;
+	ccnr::ResultCacheStatistics stats;
+	cache->GetStatistics(stats);
+	os << "Result cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.evictions << " evictions, "
+		<< stats.entries << "/" << cache->Capacity() << " entries" << std::endl;
+}
+
+
 bool MainAPI::RecognizeVideoCapture(const std::string& output)
 {
 	cv::VideoCapture cap(0);
@@ -226,7 +716,11 @@ bool MainAPI::RecognizeVideoCapture(const std::string& output)
 
 	std::vector<int> numbers;
 	std::vector<cv::Rect> num_pos;
-	CCNR.RecognizeCreditCardNumber(card_img(roi).clone(), numbers, num_pos);
+	ccnr::RecogStatus status;
+	CCNR.RecognizeCreditCardNumber(card_img(roi).clone(), numbers, num_pos, Options, &status);
+	if (status.truncated) {
+		std::cerr << "Search truncated after " << status.elapsed_ms << " ms (" << status.search_work << " steps); best result so far." << std::endl;
+	}
 
 	if (numbers.empty()) {
 		std::cerr << "Fail to recognize. Classifier may not be loaded." << std::endl;
@@ -35,6 +35,9 @@
 #define __MAIN_API__
 
 #include "CreditNumberRecog.h"
+#include "SvmTrainer.h"
+#include "ResultCache.h"
+#include <memory>
 
 class MainAPI
 {
@@ -48,15 +51,102 @@ public:
 
 	void CreateTrainingAllFeatures(const std::string& directory, const std::string& save_diretory);
 
+	//! Features of directory/0 ... directory/9 and directory/bg in one binary FeatureFile
+	/*!
+	\param[in] threads number of threads (0: all cores)
+	\param[in] resume continue an interrupted run on save_file
+	\param[in] augment in-memory variants added after each image
+	*/
+	bool CreateTrainingFeatureFile(const std::string& directory, const std::string& save_file, int threads = 0, bool resume = false,
+		const ccnr::AugmentParams& augment = ccnr::AugmentParams());
+
 	bool LoadClassifier(const std::string& filename);
 
+	//! Load the one-vs-rest detector (as written by Train)
+	bool LoadDetector(const std::string& filename);
+
+	//! Add the detector's false positives on annotated cards to a FeatureFile as background
+	/*!
+	Every line of box_file is "<image> <x> <y> <w> <h> ..." with the boxes of all digits of
+	the card; relative image paths start at the directory of box_file. A detector must be loaded.
+	\param[in] threads number of threads (0: all cores)
+	\param[in] resume continue an interrupted run of the same detector
+	*/
+	bool MineHardNegatives(const std::string& box_file, const std::string& feature_file, const ccnr::MiningParams& params, int threads = 0,
+		bool resume = false);
+
+	//! Train the one-vs-one classifier (and optionally the one-vs-rest detector) from a FeatureFile
+	/*!
+	Digits 0-9 are used for the classifier; the detector also learns the background
+	(FeatureFile::LABEL_BACKGROUND) as its last class. The new classifier is loaded.
+	\param[in] ovr_file empty: no detector
+	*/
+	bool Train(const std::string& feature_file, const std::string& model_file, const std::string& ovr_file,
+		const ccnr::SvmTrainParams& params);
+
+	//! Reload the classifier when its file changes or on SIGHUP (interval_sec <= 0: off)
+	bool WatchClassifier(double interval_sec);
+
+	//! Save a text or binary model in the binary format
+	bool ConvertModel(const std::string& src_file, const std::string& dst_file, bool quantize = false);
+
+	//! Set the digit layouts to search from "4-4-4-4,4-6-5"-style text
+	bool SetLayouts(const std::string& layouts);
+
+	//! Read one card, or every card of the image if MultiCard is set
 	bool Recognize(const std::string& img_file, const std::string& save_name = std::string(), bool display = true);
 
+	//! Read every card of a page and print one line of digits per card
+	/*!
+	\param[in] threads number of threads (0: all cores)
+	*/
+	bool RecognizePage(const std::string& img_file, const std::string& save_name = std::string(), bool display = true, int threads = 0);
+
 	bool RecognizeFolder(const std::string& dir_name, const std::string& save_dir);
 
 	bool RecognizeVideoCapture(const std::string& output = std::string());
 
+	//! Recognize raw frames that producers write into a shared-memory ring (see ShmRing)
+	/*!
+	Runs until SIGINT or SIGTERM.
+	\param[in] frame_bytes largest frame a producer may write
+	\param[in] producers producers that can be connected at the same time
+	*/
+	bool ServeSharedMemory(const std::string& name, int slot_num, size_t frame_bytes, int threads = 1, int producers = 8);
+
+	void PrintProfile(std::ostream& os) const;
+
+	//! Keep the results of up to entries distinct inputs (0: no cache)
+	/*!
+	Recognize(), RecognizeFolder() and ServeSharedMemory() then return the cached result
+	of byte-identical files or frames without decoding or recognizing them again.
+	*/
+	void EnableResultCache(size_t entries);
+
+	//! Hits and misses of the result cache (nothing without one)
+	void PrintCacheStatistics(std::ostream& os) const;
+
 	ccnr::CreditNumberRecog	CCNR;
+
+	//! Limits applied to every recognition (none by default)
+	ccnr::RecogOptions	Options;
+
+	//! Recognize() reads every card of the image with PageThreads threads
+	bool	MultiCard;
+	int	PageThreads;
+
+	//! Results of earlier inputs shared by all threads, see EnableResultCache()
+	std::shared_ptr<ccnr::ResultCache>	Cache;
+
+private:
+	//! Read img_file and recognize it, or take its result from Cache
+	/*!
+	\param[in] decode decode the image also on a cache hit
+	\param[out] img the decoded image, empty on a cache hit without decode
+	\param[out] cards one result per card, a single one without multi_card
+	*/
+	bool RecognizeFile(const std::string& img_file, bool multi_card, int threads, bool decode, cv::Mat& img,
+		std::vector<ccnr::CardResult>& cards);
 };
 
 #endif
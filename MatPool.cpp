@@ -0,0 +1,298 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "MatPool.h"
+#include <atomic>
+#include <mutex>
+#include <new>
+
+namespace ccnr{
+
+namespace{
+
+// Size classes: one class up to 64 byte, then four per power of two up to 16 MB
+const int MIN_BITS = 6;
+const int MAX_BITS = 24;
+const int SUB_NUM = 4;
+const int CLASS_NUM = 1 + (MAX_BITS - MIN_BITS) * SUB_NUM;
+
+// CV_AUTOSTEP of the C API
+const size_t AUTO_STEP = 0x7fffffff;
+
+int HighestBit(size_t v)
+{
+	int n = 0;
+	while(v >>= 1)
+		n++;
+	return n;
+}
+
+//! Size class index of a block, or -1 if it is too large to pool
+int SizeClass(size_t size, size_t& class_size)
+{
+	if(size <= ((size_t)1 << MIN_BITS)){
+		class_size = (size_t)1 << MIN_BITS;
+		return 0;
+	}
+	int exp = HighestBit(size - 1);
+	if(exp >= MAX_BITS)
+		return -1;
+	int sub = (int)(((size - 1) >> (exp - 2)) & (SUB_NUM - 1));
+	class_size = ((size_t)1 << exp) + (size_t)(sub + 1) * ((size_t)1 << (exp - 2));
+	return 1 + (exp - MIN_BITS) * SUB_NUM + sub;
+}
+
+size_t ClassSize(int idx)
+{
+	if(idx == 0)
+		return (size_t)1 << MIN_BITS;
+	int exp = MIN_BITS + (idx - 1) / SUB_NUM;
+	int sub = (idx - 1) % SUB_NUM;
+	return ((size_t)1 << exp) + (size_t)(sub + 1) * ((size_t)1 << (exp - 2));
+}
+
+struct FreeList
+{
+	std::mutex mutex;
+	std::vector<void*> blocks;
+};
+
+}
+
+
+struct MatPool::Impl
+{
+	size_t max_cached_bytes;
+	FreeList lists[CLASS_NUM];
+	FreeList headers;	// storage of UMatData
+
+	// One reference of the owner plus one per allocated UMatData
+	std::atomic<long long> refs;
+
+	std::atomic<unsigned long long> hits;
+	std::atomic<unsigned long long> misses;
+	std::atomic<unsigned long long> oversize;
+	std::atomic<unsigned long long> cached_bytes;
+
+	explicit Impl(size_t max_cached) : max_cached_bytes(max_cached), refs(1), hits(0), misses(0), oversize(0), cached_bytes(0){};
+};
+
+
+std::shared_ptr<MatPool> MatPool::Create(size_t max_cached_bytes)
+{
+	return std::shared_ptr<MatPool>(new MatPool(max_cached_bytes), &MatPool::Retire);
+}
+
+
+MatPool::MatPool(size_t max_cached_bytes)
+{
+	_impl = new Impl(max_cached_bytes);
+}
+
+
+MatPool::~MatPool()
+{
+	Clear();
+	delete _impl;
+}
+
+
+void MatPool::Retire(MatPool* pool)
+{
+	pool->Clear();
+	if(--pool->_impl->refs == 0)
+		delete pool;
+}
+
+
+cv::UMatData* MatPool::allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+	int flags, cv::UMatUsageFlags usageFlags) const
+{
+	size_t total = CV_ELEM_SIZE(type);
+	for(int i=dims-1; i>=0; i--){
+		if(step){
+			if(data0 && step[i] != AUTO_STEP){
+				CV_Assert(total <= step[i]);
+				total = step[i];
+			}
+			else{
+				step[i] = total;
+			}
+		}
+		total *= sizes[i];
+	}
+
+	uchar* data = (uchar*)data0;
+	if(!data){
+		size_t class_size;
+		int idx = SizeClass(total, class_size);
+		if(idx < 0){
+			_impl->oversize++;
+			data = (uchar*)cv::fastMalloc(total);
+		}
+		else{
+			FreeList& list = _impl->lists[idx];
+			{
+				std::lock_guard<std::mutex> lock(list.mutex);
+				if(!list.blocks.empty()){
+					data = (uchar*)list.blocks.back();
+					list.blocks.pop_back();
+				}
+			}
+			if(data){
+				_impl->hits++;
+				_impl->cached_bytes -= class_size;
+			}
+			else{
+				_impl->misses++;
+				data = (uchar*)cv::fastMalloc(class_size);
+			}
+		}
+	}
+
+	void* header = 0;
+	{
+		std::lock_guard<std::mutex> lock(_impl->headers.mutex);
+		if(!_impl->headers.blocks.empty()){
+			header = _impl->headers.blocks.back();
+			_impl->headers.blocks.pop_back();
+		}
+	}
+	if(!header)
+		header = ::operator new(sizeof(cv::UMatData));
+	cv::UMatData* u = new(header) cv::UMatData(this);
+	u->data = u->origdata = data;
+	u->size = total;
+	if(data0)
+		u->flags |= cv::UMatData::USER_ALLOCATED;
+	_impl->refs++;
+	return u;
+}
+
+
+bool MatPool::allocate(cv::UMatData* u, int /*accessFlags*/, cv::UMatUsageFlags /*usageFlags*/) const
+{
+	return u != 0;
+}
+
+
+void MatPool::deallocate(cv::UMatData* u) const
+{
+	if(!u)
+		return;
+	CV_Assert(u->urefcount == 0);
+	CV_Assert(u->refcount == 0);
+
+	if(!(u->flags & cv::UMatData::USER_ALLOCATED) && u->origdata){
+		size_t class_size;
+		int idx = SizeClass(u->size, class_size);
+		bool cached = false;
+		if(idx >= 0 && _impl->cached_bytes + class_size <= _impl->max_cached_bytes){
+			FreeList& list = _impl->lists[idx];
+			std::lock_guard<std::mutex> lock(list.mutex);
+			list.blocks.push_back(u->origdata);
+			_impl->cached_bytes += class_size;
+			cached = true;
+		}
+		if(!cached)
+			cv::fastFree(u->origdata);
+		u->origdata = 0;
+	}
+
+	u->~UMatData();
+	{
+		std::lock_guard<std::mutex> lock(_impl->headers.mutex);
+		_impl->headers.blocks.push_back(u);
+	}
+
+	if(--_impl->refs == 0)
+		delete this;
+}
+
+
+void MatPool::GetStatistics(MatPoolStatistics& stats) const
+{
+	stats.hits = _impl->hits;
+	stats.misses = _impl->misses;
+	stats.oversize = _impl->oversize;
+	stats.cached_bytes = _impl->cached_bytes;
+	long long refs = _impl->refs;
+	stats.outstanding = (refs > 1) ? refs - 1 : 0;
+}
+
+
+void MatPool::Clear()
+{
+	for(int i=0; i<CLASS_NUM; i++){
+		FreeList& list = _impl->lists[i];
+		std::lock_guard<std::mutex> lock(list.mutex);
+		for(size_t b=0; b<list.blocks.size(); b++){
+			cv::fastFree(list.blocks[b]);
+		}
+		_impl->cached_bytes -= list.blocks.size() * ClassSize(i);
+		list.blocks.clear();
+	}
+
+	std::lock_guard<std::mutex> lock(_impl->headers.mutex);
+	for(size_t b=0; b<_impl->headers.blocks.size(); b++){
+		::operator delete(_impl->headers.blocks[b]);
+	}
+	_impl->headers.blocks.clear();
+}
+
+
+namespace{
+
+thread_local MatPool* current_pool = 0;
+
+}
+
+
+MatPool* MatPool::Current()
+{
+	return current_pool;
+}
+
+
+ScopedMatPool::ScopedMatPool(MatPool* pool) : _prev(current_pool)
+{
+	current_pool = pool;
+}
+
+
+ScopedMatPool::~ScopedMatPool()
+{
+	current_pool = _prev;
+}
+
+}
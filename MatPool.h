@@ -0,0 +1,133 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __MAT_POOL__
+#define __MAT_POOL__
+
+#include <memory>
+#include <opencv2/core/core.hpp>
+
+namespace ccnr{
+
+//! Allocation statistics of a MatPool
+struct MatPoolStatistics
+{
+	unsigned long long hits;	// served from a free list
+	unsigned long long misses;	// new block of a size class
+	unsigned long long oversize;	// larger than the biggest size class, not pooled
+	unsigned long long cached_bytes;	// bytes kept in the free lists
+	unsigned long long outstanding;	// blocks currently used by cv::Mat
+};
+
+
+//! cv::MatAllocator recycling buffers by size class
+/*!
+Block sizes are rounded up to four classes per power of two (64 byte to 16 MB).
+Released blocks are kept in per-class free lists up to max_cached_bytes, so the
+buffers of one card are reused by the next one.
+
+The pool is never installed as OpenCV's default allocator. A Mat uses it only
+if Use() was called on it while a ScopedMatPool is active on the thread:
+\code
+ScopedMatPool scope(pool.get());
+cv::Mat tmp;
+MatPool::Use(tmp);
+cv::Sobel(src, tmp, CV_32F, 1, 0);	// allocated from the pool
+\endcode
+Mats allocated from the pool may outlive the pool handle; the pool is deleted
+when the last of them is released.
+*/
+class MatPool : public cv::MatAllocator
+{
+public:
+	//! Create a pool
+	static std::shared_ptr<MatPool> Create(size_t max_cached_bytes = 64 << 20);
+
+	cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+		int flags, cv::UMatUsageFlags usageFlags) const;
+	bool allocate(cv::UMatData* data, int accessflags, cv::UMatUsageFlags usageFlags) const;
+	void deallocate(cv::UMatData* data) const;
+
+	void GetStatistics(MatPoolStatistics& stats) const;
+
+	//! Free all cached blocks
+	void Clear();
+
+	//! Pool of the innermost ScopedMatPool of the calling thread, or 0
+	static MatPool* Current();
+
+	//! Allocate the next create() of the Mat from the current pool (no-op without one)
+	static void Use(cv::Mat& m){
+		MatPool* pool = Current();
+		if(pool)
+			m.allocator = pool;
+	}
+
+	static void Use(std::vector<cv::Mat>& mats){
+		for(size_t i=0; i<mats.size(); i++){
+			Use(mats[i]);
+		}
+	}
+
+private:
+	struct Impl;
+	Impl* _impl;
+
+	explicit MatPool(size_t max_cached_bytes);
+	~MatPool();
+
+	//! Called by the shared_ptr deleter
+	static void Retire(MatPool* pool);
+
+	MatPool(const MatPool&);
+	MatPool& operator=(const MatPool&);
+};
+
+
+//! Install a pool on the calling thread for the lifetime of the object
+class ScopedMatPool
+{
+public:
+	explicit ScopedMatPool(MatPool* pool);
+	~ScopedMatPool();
+
+private:
+	MatPool* _prev;
+
+	ScopedMatPool(const ScopedMatPool&);
+	ScopedMatPool& operator=(const ScopedMatPool&);
+};
+
+}
+
+#endif
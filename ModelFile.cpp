@@ -0,0 +1,394 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "ModelFile.h"
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CCNR_MODEL_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace ccnr{
+
+const ModelFile::MODEL_TYPE
+	ModelFile::MODEL_F32,
+	ModelFile::MODEL_Q8;
+const unsigned int ModelFile::VERSION;
+const char* const ModelFile::BUILTIN_MODEL = "builtin";
+
+#ifdef CCNR_EMBED_MODEL
+//! Generated by cmake/EmbedModel.cmake
+const float* EmbeddedModelData(int& rows, int& cols);
+#endif
+
+namespace{
+
+const char MAGIC[8] = {'C', 'C', 'N', 'R', 'M', 'D', 'L', '\0'};
+const size_t ALIGN = 64;
+
+struct Header
+{
+	char magic[8];
+	unsigned int version;
+	unsigned int type;
+	unsigned int rows;
+	unsigned int cols;
+	unsigned int row_step;
+	unsigned int reserved;
+	unsigned long long data_offset;
+	unsigned long long data_size;
+	unsigned int data_crc;
+	unsigned int header_crc;
+	char padding[8];
+};
+
+static_assert(sizeof(Header) == 64, "model header must be 64 bytes");
+
+size_t AlignUp(size_t v)
+{
+	return (v + ALIGN - 1) / ALIGN * ALIGN;
+}
+
+//! Size of the scale table in front of MODEL_Q8 rows
+size_t ScaleSize(const Header& h)
+{
+	return (h.type == ModelFile::MODEL_Q8) ? AlignUp(h.rows * sizeof(float)) : 0;
+}
+
+//! Check the header against the file and the data checksum
+int CheckModel(const char* file_data, size_t file_size, Header& h)
+{
+	if(file_size < sizeof(Header))
+		return -1;
+	memcpy(&h, file_data, sizeof(Header));
+	if(memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.version != ModelFile::VERSION)
+		return -1;
+	if(ModelFile::CRC32(&h, offsetof(Header, header_crc)) != h.header_crc)
+		return -1;
+	if(h.rows == 0 || h.cols == 0 || h.data_offset % ALIGN != 0 || h.data_offset < sizeof(Header))
+		return -1;
+
+	size_t elem_size;
+	if(h.type == (unsigned int)ModelFile::MODEL_F32)
+		elem_size = sizeof(float);
+	else if(h.type == (unsigned int)ModelFile::MODEL_Q8)
+		elem_size = 1;
+	else
+		return -1;
+	if(h.row_step < h.cols * elem_size || h.row_step % ALIGN != 0)
+		return -1;
+	if(h.data_size != ScaleSize(h) + (unsigned long long)h.rows * h.row_step)
+		return -1;
+	if(h.data_offset + h.data_size > file_size)
+		return -1;
+
+	if(ModelFile::CRC32(file_data + h.data_offset, h.data_size) != h.data_crc)
+		return -1;
+	return 0;
+}
+
+//! Expand MODEL_Q8 data or copy MODEL_F32 data into a new Mat
+void CopyCoeffs(const char* data, const Header& h, cv::Mat& coeffs)
+{
+	coeffs.create(h.rows, h.cols, CV_32FC1);
+	if(h.type == (unsigned int)ModelFile::MODEL_F32){
+		for(unsigned int r=0; r<h.rows; r++){
+			memcpy(coeffs.ptr<float>(r), data + (size_t)r * h.row_step, h.cols * sizeof(float));
+		}
+	}
+	else{
+		const float* scales = (const float*)data;
+		const signed char* q = (const signed char*)(data + ScaleSize(h));
+		for(unsigned int r=0; r<h.rows; r++){
+			float* dst = coeffs.ptr<float>(r);
+			const signed char* src = q + (size_t)r * h.row_step;
+			for(unsigned int c=0; c<h.cols; c++){
+				dst[c] = scales[r] * src[c];
+			}
+		}
+	}
+}
+
+#ifdef CCNR_MODEL_MMAP
+//! Hands out one Mat over a file mapping and unmaps the file with it
+class MappedAllocator : public cv::MatAllocator
+{
+public:
+	MappedAllocator(void* addr, size_t length, size_t offset, size_t row_step)
+		: _addr(addr), _length(length), _offset(offset), _row_step(row_step){};
+
+	cv::UMatData* allocate(int dims, const int* sizes, int type, void* /*data0*/, size_t* step,
+		int /*flags*/, cv::UMatUsageFlags /*usageFlags*/) const
+	{
+		step[dims-1] = CV_ELEM_SIZE(type);
+		step[0] = _row_step;
+		cv::UMatData* u = new cv::UMatData(this);
+		u->data = u->origdata = (uchar*)_addr + _offset;
+		u->size = _row_step * sizes[0];
+		u->flags |= cv::UMatData::USER_ALLOCATED;
+		return u;
+	}
+
+	bool allocate(cv::UMatData* u, int /*accessFlags*/, cv::UMatUsageFlags /*usageFlags*/) const{
+		return u != 0;
+	}
+
+	void deallocate(cv::UMatData* u) const
+	{
+		if(!u)
+			return;
+		delete u;
+		munmap(_addr, _length);
+		delete this;
+	}
+
+private:
+	void* _addr;
+	size_t _length;
+	size_t _offset;
+	size_t _row_step;
+};
+#endif
+
+}
+
+
+unsigned int ModelFile::CRC32(const void* data, size_t size, unsigned int crc)
+{
+	static struct Table{
+		unsigned int v[256];
+		Table(){
+			for(unsigned int i=0; i<256; i++){
+				unsigned int c = i;
+				for(int k=0; k<8; k++){
+					c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+				}
+				v[i] = c;
+			}
+		}
+	} table;
+
+	const unsigned char* p = (const unsigned char*)data;
+	crc = ~crc;
+	for(size_t i=0; i<size; i++){
+		crc = table.v[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+
+bool ModelFile::IsBinary(const std::string& file)
+{
+	std::ifstream ifs(file.c_str(), std::ios::binary);
+	char magic[sizeof(MAGIC)];
+	if(!ifs.read(magic, sizeof(magic)))
+		return false;
+	return memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+
+int ModelFile::Save(const std::string& file, const cv::Mat& coeffs, MODEL_TYPE type)
+{
+	if(coeffs.empty() || coeffs.dims != 2 || coeffs.channels() != 1)
+		return -1;
+	cv::Mat fcoeffs;
+	coeffs.convertTo(fcoeffs, CV_32FC1);
+
+	Header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, MAGIC, sizeof(MAGIC));
+	h.version = VERSION;
+	h.type = type;
+	h.rows = fcoeffs.rows;
+	h.cols = fcoeffs.cols;
+
+	std::vector<char> data;
+	if(type == MODEL_F32){
+		h.row_step = AlignUp(h.cols * sizeof(float));
+		data.assign((size_t)h.rows * h.row_step, 0);
+		for(unsigned int r=0; r<h.rows; r++){
+			memcpy(&data[(size_t)r * h.row_step], fcoeffs.ptr<float>(r), h.cols * sizeof(float));
+		}
+	}
+	else if(type == MODEL_Q8){
+		// symmetric per-row scale so that the largest coefficient maps to 127
+		h.row_step = AlignUp(h.cols);
+		size_t scale_size = ScaleSize(h);
+		data.assign(scale_size + (size_t)h.rows * h.row_step, 0);
+		for(unsigned int r=0; r<h.rows; r++){
+			const float* src = fcoeffs.ptr<float>(r);
+			float max_abs = 0;
+			for(unsigned int c=0; c<h.cols; c++){
+				max_abs = std::max(max_abs, std::abs(src[c]));
+			}
+			float scale = (max_abs > 0) ? max_abs / 127 : 1.0f;
+			memcpy(&data[r * sizeof(float)], &scale, sizeof(float));
+			signed char* dst = (signed char*)&data[scale_size + (size_t)r * h.row_step];
+			for(unsigned int c=0; c<h.cols; c++){
+				dst[c] = (signed char)std::max(-127, std::min(127, cvRound(src[c] / scale)));
+			}
+		}
+	}
+	else{
+		return -1;
+	}
+
+	h.data_offset = AlignUp(sizeof(Header));
+	h.data_size = data.size();
+	h.data_crc = CRC32(&data[0], data.size());
+	h.header_crc = CRC32(&h, offsetof(Header, header_crc));
+
+	std::ofstream ofs(file.c_str(), std::ios::binary);
+	if(!ofs.is_open())
+		return -1;
+	std::vector<char> gap(h.data_offset - sizeof(Header), 0);
+	ofs.write((const char*)&h, sizeof(h));
+	if(!gap.empty())
+		ofs.write(&gap[0], gap.size());
+	ofs.write(&data[0], data.size());
+	return ofs.good() ? 0 : -1;
+}
+
+
+int ModelFile::Load(const std::string& file, cv::Mat& coeffs)
+{
+	Header h;
+#ifdef CCNR_MODEL_MMAP
+	int fd = open(file.c_str(), O_RDONLY);
+	if(fd < 0)
+		return -1;
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header)){
+		close(fd);
+		return -1;
+	}
+	size_t length = st.st_size;
+	// private writable mapping: pages are shared with the page cache until written
+	void* addr = mmap(0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(addr == MAP_FAILED)
+		return -1;
+
+	if(CheckModel((const char*)addr, length, h) < 0){
+		munmap(addr, length);
+		return -1;
+	}
+	if(h.type == (unsigned int)MODEL_F32){
+		cv::Mat mapped;
+		mapped.allocator = new MappedAllocator(addr, length, h.data_offset, h.row_step);
+		mapped.create(h.rows, h.cols, CV_32FC1);
+		// the UMatData keeps the allocator; do not reuse it for another create()
+		mapped.allocator = 0;
+		coeffs = mapped;
+	}
+	else{
+		CopyCoeffs((const char*)addr + h.data_offset, h, coeffs);
+		munmap(addr, length);
+	}
+#else
+	std::ifstream ifs(file.c_str(), std::ios::binary);
+	if(!ifs.is_open())
+		return -1;
+	std::vector<char> buf((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	if(CheckModel(buf.empty() ? 0 : &buf[0], buf.size(), h) < 0)
+		return -1;
+	CopyCoeffs(&buf[h.data_offset], h, coeffs);
+#endif
+	return 0;
+}
+
+
+bool ModelFile::HasBuiltin()
+{
+#ifdef CCNR_EMBED_MODEL
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+int ModelFile::LoadBuiltin(cv::Mat& coeffs)
+{
+#ifdef CCNR_EMBED_MODEL
+	int rows, cols;
+	const float* data = EmbeddedModelData(rows, cols);
+	coeffs = cv::Mat(rows, cols, CV_32FC1, (void*)data);
+	return 0;
+#else
+	coeffs.release();
+	return -1;
+#endif
+}
+
+
+std::string ModelFile::DefaultModel()
+{
+	return HasBuiltin() ? BUILTIN_MODEL : "CreditModel.txt";
+}
+
+
+int ModelFile::Read(const std::string& file, cv::Mat& coeffs)
+{
+	if(file == BUILTIN_MODEL)
+		return LoadBuiltin(coeffs);
+	if(IsBinary(file))
+		return Load(file, coeffs);
+
+	cv::FileStorage fs(file, cv::FileStorage::READ);
+	if(!fs.isOpened())
+		return -1;
+	fs["svm_coeff"] >> coeffs;
+	return coeffs.empty() ? -1 : 0;
+}
+
+
+int ModelFile::Convert(const std::string& src_file, const std::string& dst_file, MODEL_TYPE type)
+{
+	cv::Mat coeffs;
+	if(Read(src_file, coeffs) < 0)
+		return -1;
+	return Save(dst_file, coeffs, type);
+}
+
+}
@@ -0,0 +1,120 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __MODEL_FILE__
+#define __MODEL_FILE__
+
+#include <string>
+#include <opencv2/core/core.hpp>
+
+namespace ccnr{
+
+//! Binary SVM coefficient file
+/*!
+Layout (native byte order, sections aligned to 64 bytes):
+\code
+ 0  char[8]  "CCNRMDL\0"
+ 8  uint32   version
+12  uint32   data type (MODEL_F32 or MODEL_Q8)
+16  uint32   rows
+20  uint32   cols
+24  uint32   row step [byte]
+28  uint32   reserved (0)
+32  uint64   data offset
+40  uint64   data size [byte]
+48  uint32   CRC32 of the data
+52  uint32   CRC32 of bytes 0-51
+56  reserved up to 64
+\endcode
+MODEL_F32 stores rows of float padded to 64 bytes. On POSIX systems the file is
+memory-mapped and the returned cv::Mat points into the mapping, so loading does
+not parse or copy anything; the mapping is released with the last Mat using it.
+MODEL_Q8 stores one float scale per row (padded to 64 bytes) followed by the
+int8 rows, and is expanded to float on load.
+*/
+class ModelFile
+{
+public:
+	typedef int MODEL_TYPE;
+
+	static const MODEL_TYPE
+		MODEL_F32 = 0,
+		MODEL_Q8 = 1;
+
+	static const unsigned int VERSION = 1;
+
+	//! true if the file starts with the binary model magic
+	static bool IsBinary(const std::string& file);
+
+	//! Write coefficients (CV_32FC1 or CV_64FC1) in the binary format
+	/*!
+	\return 0 on success, -1 on failure
+	*/
+	static int Save(const std::string& file, const cv::Mat& coeffs, MODEL_TYPE type = MODEL_F32);
+
+	//! Read a binary model as CV_32FC1
+	/*!
+	\return 0 on success, -1 if the file cannot be read or fails the checks
+	*/
+	static int Load(const std::string& file, cv::Mat& coeffs);
+
+	//! Read a binary model, or the "svm_coeff" node of a YAML/XML model as a fallback
+	/*!
+	BUILTIN_MODEL selects the coefficients compiled in with CCNR_EMBED_MODEL.
+	*/
+	static int Read(const std::string& file, cv::Mat& coeffs);
+
+	//! Model name of the compiled-in coefficients
+	static const char* const BUILTIN_MODEL;
+
+	//! true if the library was built with CCNR_EMBED_MODEL
+	static bool HasBuiltin();
+
+	//! Wrap the compiled-in coefficients (CV_32FC1) without copying
+	/*!
+	\return -1 if the library was built without CCNR_EMBED_MODEL
+	*/
+	static int LoadBuiltin(cv::Mat& coeffs);
+
+	//! BUILTIN_MODEL if it is available, CreditModel.txt otherwise
+	static std::string DefaultModel();
+
+	//! Convert any readable model to the binary format
+	static int Convert(const std::string& src_file, const std::string& dst_file, MODEL_TYPE type = MODEL_F32);
+
+	static unsigned int CRC32(const void* data, size_t size, unsigned int crc = 0);
+};
+
+}
+
+#endif
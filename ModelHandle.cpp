@@ -0,0 +1,273 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "ModelHandle.h"
+#include "ModelFile.h"
+#include <csignal>
+#include <chrono>
+#include <cmath>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace ccnr{
+
+namespace{
+
+//! Number of SIGHUPs received, only written by the handler
+volatile std::sig_atomic_t reload_signals = 0;
+
+extern "C" void OnReloadSignal(int)
+{
+	reload_signals = reload_signals + 1;
+}
+
+//! What the watcher compares to detect a new model file
+struct FileSignature
+{
+	long long mtime_sec;
+	long long mtime_nsec;
+	long long size;
+
+	bool operator==(const FileSignature& other) const{
+		return mtime_sec == other.mtime_sec && mtime_nsec == other.mtime_nsec && size == other.size;
+	}
+};
+
+bool GetSignature(const std::string& file, FileSignature& sig)
+{
+	struct stat st;
+	if(stat(file.c_str(), &st) != 0)
+		return false;
+	sig.mtime_sec = st.st_mtime;
+#if defined(__linux__)
+	sig.mtime_nsec = st.st_mtim.tv_nsec;
+#else
+	sig.mtime_nsec = 0;
+#endif
+	sig.size = st.st_size;
+	return true;
+}
+
+}
+
+
+ModelHandle::ModelHandle() : _model(std::make_shared<NumberRecog>()), _version(0), _failures(0), _expected_cols(0), _stop(true)
+{
+}
+
+
+ModelHandle::ModelHandle(const ModelHandle& other)
+	: _model(other.Get()), _version(other.Version()), _failures(0), _expected_cols(other._expected_cols), _stop(true)
+{
+	std::lock_guard<std::mutex> lock(other._load_mutex);
+	_file = other._file;
+}
+
+
+ModelHandle& ModelHandle::operator=(const ModelHandle& other)
+{
+	if(this == &other)
+		return *this;
+	StopWatching();
+	std::string file;
+	{
+		std::lock_guard<std::mutex> lock(other._load_mutex);
+		file = other._file;
+	}
+	std::lock_guard<std::mutex> lock(_load_mutex);
+	std::atomic_store(&_model, other.Get());
+	_version = other.Version();
+	_expected_cols = other._expected_cols;
+	_file = file;
+	return *this;
+}
+
+
+ModelHandle::~ModelHandle()
+{
+	StopWatching();
+}
+
+
+int ModelHandle::Publish(const cv::Mat& coeffs)
+{
+	if(coeffs.empty() || coeffs.dims != 2)
+		return -1;
+	if(_expected_cols > 0 && coeffs.cols != _expected_cols)
+		return -1;
+	// one-vs-one: one row per pair of classes
+	int num_class = (int)std::floor(std::sqrt(2.0 * coeffs.rows + 0.25) + 0.5);
+	if(num_class < 2 || num_class * (num_class - 1) / 2 != coeffs.rows)
+		return -1;
+
+	// copy of the current model so that the detector filters are kept
+	std::shared_ptr<NumberRecog> next = std::make_shared<NumberRecog>(*Get());
+	int ret = next->Load(coeffs);
+	if(ret < 0)
+		return -1;
+	std::atomic_store(&_model, std::shared_ptr<const NumberRecog>(next));
+	_version++;
+	return ret;
+}
+
+
+int ModelHandle::Load(const std::string& file)
+{
+	cv::Mat coeffs;
+	if(ModelFile::Read(file, coeffs) < 0)
+		return -1;
+
+	std::lock_guard<std::mutex> lock(_load_mutex);
+	int ret = Publish(coeffs);
+	if(ret >= 0)
+		_file = file;
+	return ret;
+}
+
+
+int ModelHandle::Reload()
+{
+	std::string file;
+	{
+		std::lock_guard<std::mutex> lock(_load_mutex);
+		file = _file;
+	}
+	if(file.empty())
+		return -1;
+	return Load(file);
+}
+
+
+int ModelHandle::LoadDetector(const std::string& file, const cv::Size& filter_size)
+{
+	cv::Mat coeffs;
+	if(ModelFile::Read(file, coeffs) < 0)
+		return -1;
+
+	std::lock_guard<std::mutex> lock(_load_mutex);
+	std::shared_ptr<NumberRecog> next = std::make_shared<NumberRecog>(*Get());
+	if(next->LoadOVR(coeffs, filter_size) < 0)
+		return -1;
+	std::atomic_store(&_model, std::shared_ptr<const NumberRecog>(next));
+	_version++;
+	return 0;
+}
+
+
+int ModelHandle::StartWatching(double interval_sec)
+{
+	{
+		std::lock_guard<std::mutex> lock(_load_mutex);
+		// the compiled-in model has no file to watch
+		if(_file.empty() || _file == ModelFile::BUILTIN_MODEL)
+			return -1;
+	}
+	StopWatching();
+	_stop = false;
+	_watcher = std::thread(&ModelHandle::Watch, this, interval_sec > 0 ? interval_sec : 1.0);
+	return 0;
+}
+
+
+void ModelHandle::StopWatching()
+{
+	{
+		std::lock_guard<std::mutex> lock(_watch_mutex);
+		_stop = true;
+	}
+	_watch_cond.notify_all();
+	if(_watcher.joinable())
+		_watcher.join();
+}
+
+
+void ModelHandle::InstallReloadSignal()
+{
+#ifdef SIGHUP
+	std::signal(SIGHUP, OnReloadSignal);
+#endif
+}
+
+
+void ModelHandle::Watch(double interval_sec)
+{
+	std::string watched;
+	FileSignature loaded;
+	bool known = false;
+	std::sig_atomic_t seen_signals = reload_signals;
+
+	std::unique_lock<std::mutex> lock(_watch_mutex);
+	while(!_stop){
+		std::string file;
+		{
+			std::lock_guard<std::mutex> load_lock(_load_mutex);
+			file = _file;
+		}
+		if(file != watched){
+			// first round or another file was loaded explicitly
+			watched = file;
+			known = GetSignature(watched, loaded);
+		}
+
+		_watch_cond.wait_for(lock, std::chrono::duration<double>(interval_sec));
+		if(_stop)
+			break;
+
+		FileSignature sig;
+		bool changed = GetSignature(watched, sig) && !(known && sig == loaded);
+		bool signaled = (reload_signals != seen_signals);
+		if(!changed && !signaled)
+			continue;
+		seen_signals = reload_signals;
+		if(changed){
+			// a file that fails is not retried until it changes again
+			loaded = sig;
+			known = true;
+		}
+
+		lock.unlock();
+		cv::Mat coeffs;
+		int ret = ModelFile::Read(watched, coeffs);
+		if(ret >= 0){
+			std::lock_guard<std::mutex> load_lock(_load_mutex);
+			// a file loaded explicitly during the wait is not replaced by the old one
+			if(_file == watched)
+				ret = Publish(coeffs);
+		}
+		if(ret < 0)
+			_failures++;
+		lock.lock();
+	}
+}
+
+}
@@ -0,0 +1,133 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __MODEL_HANDLE__
+#define __MODEL_HANDLE__
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include "NumberRecog.h"
+
+namespace ccnr{
+
+//! Classifier that can be replaced while recognitions are running
+/*!
+Get() returns a snapshot of the current model. A reload builds a new
+NumberRecog next to it and publishes it with an atomic shared_ptr store, so
+callers that already hold a snapshot finish on the old model, which is freed
+with the last of them.
+Models whose shape does not match the feature (SetExpectedCols) are rejected
+and the current model stays.
+
+Copies share the current model but not the file watcher.
+*/
+class ModelHandle
+{
+public:
+	ModelHandle();
+	ModelHandle(const ModelHandle& other);
+	ModelHandle& operator=(const ModelHandle& other);
+	~ModelHandle();
+
+	//! Number of coefficients per row including the bias (0: not checked)
+	void SetExpectedCols(int cols){
+		_expected_cols = cols;
+	}
+
+	//! Load a one-vs-one classifier (text, binary or ModelFile::BUILTIN_MODEL)
+	/*!
+	\return number of classes, -1 if the file cannot be read or has a wrong shape
+	*/
+	int Load(const std::string& file);
+
+	//! Reload the file given to the last successful Load()
+	int Reload();
+
+	//! Load one-vs-rest detector filters into the current model
+	int LoadDetector(const std::string& file, const cv::Size& filter_size);
+
+	//! Current model (never null)
+	std::shared_ptr<const NumberRecog> Get() const{
+		return std::atomic_load(&_model);
+	}
+
+	//! Incremented every time a model is published
+	unsigned long long Version() const{
+		return _version;
+	}
+
+	//! Reloads that were rejected by the watcher
+	unsigned long long Failures() const{
+		return _failures;
+	}
+
+	//! Reload in a background thread when the model file changes or SIGHUP arrives
+	/*!
+	\param[in] interval_sec polling interval of the file's modification time and size
+	\return -1 if no model file has been loaded
+	*/
+	int StartWatching(double interval_sec = 1.0);
+
+	void StopWatching();
+
+	//! Make SIGHUP request a reload from every watching handle (POSIX only)
+	static void InstallReloadSignal();
+
+private:
+	std::shared_ptr<const NumberRecog> _model;
+	std::atomic<unsigned long long> _version;
+	std::atomic<unsigned long long> _failures;
+	int _expected_cols;
+
+	//! Serializes loads and protects _file
+	mutable std::mutex _load_mutex;
+	std::string _file;
+
+	std::thread _watcher;
+	std::mutex _watch_mutex;
+	std::condition_variable _watch_cond;
+	bool _stop;
+
+	//! Validate and publish a model, called with _load_mutex held
+	int Publish(const cv::Mat& coeffs);
+
+	void Watch(double interval_sec);
+};
+
+}
+
+#endif
@@ -129,7 +129,7 @@ void CreateMserRegionTree(const std::vector<_T>& histogram, std::vector<REGION_1
 \param[in] tree_regions Slł̑S̈Ƃ̖؍\
 \param[out] clustered_idx ؍\qm[hPƂȂ̈ŃNX^OIDil̏Ɂj
 */
-void ClusterRegionsFromTree(const std::vector<REGION_1D>& tree_regions, std::vector<std::vector<int> >& clustered_idx)
+inline void ClusterRegionsFromTree(const std::vector<REGION_1D>& tree_regions, std::vector<std::vector<int> >& clustered_idx)
 {
 	std::vector<bool> check(tree_regions.size(), false);
 	for(int i=0; i<tree_regions.size(); i++){
@@ -155,7 +155,7 @@ void ClusterRegionsFromTree(const std::vector<REGION_1D>& tree_regions, std::vec
 \param[out] area_variation clustered_idxɑΉʐς̕ω
 \param[in] clustered_idx ؍\qm[hPƂȂ̈ŃNX^OIDil̏Ɂj
 */
-void AreaVariation(const std::vector<REGION_1D>& tree_regions, 
+inline void AreaVariation(const std::vector<REGION_1D>& tree_regions, 
 	std::vector<std::vector<double> >& area_variation, 
 	const std::vector<std::vector<int> >& clustered_idx,
 	int delta, int min_area, int max_area)
@@ -193,7 +193,7 @@ void AreaVariation(const std::vector<REGION_1D>& tree_regions,
 \param[in] area_variation clustered_idxɑΉʐς̕ω
 \param[in] mser_idx area_variationŋɏlƂCfbNX
 */
-void GetLocalVariationMaxima(const std::vector<std::vector<int> >& clustered_idx,
+inline void GetLocalVariationMaxima(const std::vector<std::vector<int> >& clustered_idx,
 	const std::vector<std::vector<double> >& area_variation, 
 	std::vector<int>& mser_idx)
 {
@@ -32,9 +32,14 @@
 //M*/
 
 #include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <map>
 #include "common.h"
 #include "NumberDetect.h"
 #include "Mser1D.hpp"
+#include "Profiler.h"
+#include "MatPool.h"
 
 
 namespace ccnr{
@@ -46,6 +51,18 @@ const NumberDetect::CHAR_EDGE_TYPE
 	NumberDetect::CHAR_STRING_LEFT,
 	NumberDetect::CHAR_STRING_RIGHT;
 const int NumberDetect::CHAR_EDGE_TYPE_NUM;
+const NumberDetect::CREDIT_PATTERN
+	NumberDetect::TYPE4444,
+	NumberDetect::TYPE465,
+	NumberDetect::TYPE464,
+	NumberDetect::TYPE44443,
+	NumberDetect::TYPE445;
+const NumberDetect::ORIENTATION
+	NumberDetect::ORIENT_UPRIGHT,
+	NumberDetect::ORIENT_MIRRORED,
+	NumberDetect::ORIENT_FLIPPED,
+	NumberDetect::ORIENT_UPSIDE_DOWN;
+const int NumberDetect::ORIENTATION_NUM;
 
 NumberDetect::NumberDetect(void)
 {
@@ -53,15 +70,10 @@ NumberDetect::NumberDetect(void)
 	_char_width_div = 0.2;
 	_min_char_height_ratio = 0.05;
 	_max_char_height_ratio = 0.1;
-	_PATTERN_TYPES.push_back(TYPE4444);
-	_PATTERN_TYPES.push_back(TYPE465);
-	_PATTERN_TYPES.push_back(TYPE464);
-	std::vector<CREDIT_PATTERN>::iterator it, it_end = _PATTERN_TYPES.end();
-	for(it=_PATTERN_TYPES.begin(); it != it_end; it++){
-		std::vector<int> break_pattern;
-		CreateCreditBreakPattern(break_pattern, *it);
-		_CHAR_BREAK_PATTERNS.push_back(break_pattern);
-	}
+	_position_sigma_ratio = 0.1;
+	_Layouts.push_back(CreditLayout::Builtin(TYPE4444));
+	_Layouts.push_back(CreditLayout::Builtin(TYPE465));
+	_Layouts.push_back(CreditLayout::Builtin(TYPE464));
 }
 
 
@@ -69,8 +81,22 @@ NumberDetect::~NumberDetect(void)
 {
 }
 
+int NumberDetect::SetLayouts(const std::vector<CreditLayout>& layouts)
+{
+	if(layouts.empty())
+		return -1;
+	for(size_t i=0; i<layouts.size(); i++){
+		if(layouts[i].empty())
+			return -1;
+	}
+	_Layouts = layouts;
+	return 0;
+}
+
+
 //! NWbgJ[hԍ̈ʒu擾
-void NumberDetect::ExtractNumbers(const cv::Mat& edge_img, std::vector<cv::Rect>& num_pos, CREDIT_PATTERN& pattern) const
+double NumberDetect::ExtractNumbers(const cv::Mat& edge_img, std::vector<cv::Rect>& num_pos, CREDIT_PATTERN& pattern, SearchBudget* budget,
+	BandCostSource* learned) const
 {
 	// NWbgJ[hԍ̈ʒu擾
 	std::vector<cv::Rect> candidates;
@@ -78,7 +104,106 @@ void NumberDetect::ExtractNumbers(const cv::Mat& edge_img, std::vector<cv::Rect>
 	int max_char_height = round(_max_char_height_ratio * edge_img.cols);
 	DetectStringHeight(edge_img, candidates, min_char_height, max_char_height);
 
-	double cost = DetectCharacterBoxes(edge_img, candidates, num_pos, pattern);
+	return DetectCharacterBoxes(edge_img, candidates, num_pos, pattern, budget, learned);
+}
+
+
+double NumberDetect::ExtractNumbers(const cv::Mat& edge_img, std::vector<cv::Rect>& num_pos, CREDIT_PATTERN& pattern,
+	ORIENTATION& orientation, int orientations, SearchBudget* budget) const
+{
+	int min_char_height = round(_min_char_height_ratio * edge_img.cols);
+	int max_char_height = round(_max_char_height_ratio * edge_img.cols);
+
+	// bands of the image and of the image flipped top to bottom, from one row projection
+	std::vector<cv::Rect> candidates[2];
+	{
+		CCNR_PROFILE_SCOPE(STAGE_STRING_HEIGHT);
+		std::vector<float> profile;
+		StringProfile(edge_img, profile);
+		if(orientations & ((1 << ORIENT_UPRIGHT) | (1 << ORIENT_MIRRORED)))
+			DetectStringHeight(profile, edge_img.cols, candidates[0], min_char_height, max_char_height);
+		if(orientations & ((1 << ORIENT_FLIPPED) | (1 << ORIENT_UPSIDE_DOWN))){
+			std::reverse(profile.begin(), profile.end());
+			DetectStringHeight(profile, edge_img.cols, candidates[1], min_char_height, max_char_height);
+		}
+	}
+
+	// column projection of every band of edge_img, shared by the orientations that search it
+	std::map<std::pair<int,int>, cv::Mat> projections;
+
+	double min_cost = 10000;
+	std::vector<int> min_break_pos;
+	cv::Rect min_band;
+	orientation = ORIENT_UPRIGHT;
+	for(int o=0; o<ORIENTATION_NUM; o++){
+		if(!(orientations & (1 << o)))
+			continue;
+		bool flip_rows = (o & ORIENT_FLIPPED) != 0;
+		bool flip_cols = (o & ORIENT_MIRRORED) != 0;
+		const std::vector<cv::Rect>& bands = candidates[flip_rows ? 1 : 0];
+		for(size_t i=0; i<bands.size(); i++){
+			if(budget && !budget->Check())
+				break;
+			// the band in the flipped image; the number line of an upright card is a little below the center
+			const cv::Rect& band = bands[i];
+			double deviation = ((band.y + band.height / 2.0) / edge_img.rows - 0.6) / _position_sigma_ratio;
+			double position_cost = deviation * deviation / 2;
+			if(position_cost >= min_cost)
+				continue;
+
+			cv::Mat app_costs;
+			MatPool::Use(app_costs);
+			{
+				CCNR_PROFILE_SCOPE(STAGE_APPEARANCE_COSTS);
+				int y = flip_rows ? edge_img.rows - band.y - band.height : band.y;
+				cv::Mat& prj = projections[std::make_pair(y, band.height)];
+				if(prj.empty())
+					Projection(edge_img(cv::Rect(0, y, edge_img.cols, band.height)), prj);
+				if(flip_cols){
+					cv::Mat reversed;
+					MatPool::Use(reversed);
+					cv::flip(prj, reversed, 1);
+					CreateAppearanceCosts(reversed, band.height, app_costs);
+				}
+				else{
+					CreateAppearanceCosts(prj, band.height, app_costs);
+				}
+			}
+
+			CREDIT_PATTERN cur_pattern;
+			std::vector<int> break_pos;
+			double cost = SearchCharacterRange(app_costs, band.height, break_pos, cur_pattern, min_cost - position_cost, budget);
+			if(!break_pos.empty() && cost + position_cost < min_cost){
+				min_cost = cost + position_cost;
+				min_break_pos = break_pos;
+				pattern = cur_pattern;
+				min_band = band;
+				orientation = o;
+			}
+		}
+	}
+
+	// boxes of the flipped image back in edge_img, still in the reading order
+	if(!min_break_pos.empty()){
+		std::vector<cv::Rect> boxes;
+		_Layouts[pattern].ConvertToRects(min_break_pos, boxes, min_band);
+		for(size_t i=0; i<boxes.size(); i++){
+			cv::Rect rect = boxes[i];
+			if(orientation & ORIENT_MIRRORED)
+				rect.x = edge_img.cols - rect.x - rect.width;
+			if(orientation & ORIENT_FLIPPED)
+				rect.y = edge_img.rows - rect.y - rect.height;
+			num_pos.push_back(rect);
+		}
+	}
+	return min_cost;
+}
+
+
+int NumberDetect::FlipCode(ORIENTATION orientation)
+{
+	static const int codes[ORIENTATION_NUM] = {2, 1, 0, -1};
+	return codes[orientation & (ORIENTATION_NUM - 1)];
 }
 
 
@@ -89,31 +214,7 @@ void NumberDetect::ConvertXtoRects(const std::vector<int>& breaks, std::vector<c
 		return;
 
 	// NWbgJ[hԍ̈i[
-	std::vector<int> break_b, break_e;
-	if(pattern == TYPE4444){
-		int b[] = {0,5,10,15};
-		int e[] = {4,9,14,19};
-		break_b.insert(break_b.end(),b,b+4);
-		break_e.insert(break_e.end(),e,e+4);
-	}
-	else if(pattern == TYPE465){
-		int b[] = {0,5,12};
-		int e[] = {4,11,17};
-		break_b.insert(break_b.end(),b,b+3);
-		break_e.insert(break_e.end(),e,e+3);
-	}
-	else if(pattern == TYPE464){
-		int b[] = {0,5,12};
-		int e[] = {4,11,16};
-		break_b.insert(break_b.end(),b,b+3);
-		break_e.insert(break_e.end(),e,e+3);
-	}
-	for(int j=0; j<break_b.size(); j++){
-		for(int i=break_b[j]; i<break_e[j]; i++){
-			cv::Rect rect(breaks[i], region.y, breaks[i+1] - breaks[i], region.height);
-			number_rects.push_back(rect);
-		}
-	}
+	CreditLayout::Builtin(pattern).ConvertToRects(breaks, number_rects, region);
 }
 
 
@@ -133,22 +234,41 @@ void NumberDetect::EvaluateNumberStrings(const std::vector<std::pair<int,int> >&
 }
 
 
-void NumberDetect::DetectStringHeight(const cv::Mat& edge_img, std::vector<cv::Rect>& candidates, int min_char_height, int max_char_height)
+void NumberDetect::StringProfile(const cv::Mat& edge_img, std::vector<float>& profile)
 {
 	cv::Mat prj;
+	MatPool::Use(prj);
 	Projection(edge_img, prj, true);
 	
 	int filter_width = edge_img.cols / 80;
 	filter_width = (filter_width < 3) ? 3 : filter_width + (1 - filter_width % 2);
 
 	cv::Mat gprj;
+	MatPool::Use(gprj);
 	cv::GaussianBlur(prj, gprj, cv::Size(1,filter_width), 0.0, 1.0);
 
+	Mat2Vector(gprj, profile);
+}
+
+
+void NumberDetect::DetectStringHeight(const cv::Mat& edge_img, std::vector<cv::Rect>& candidates, int min_char_height, int max_char_height)
+{
+	CCNR_PROFILE_SCOPE(STAGE_STRING_HEIGHT);
+
 	std::vector<float> gprj_vec;
-	Mat2Vector(gprj, gprj_vec);
+	StringProfile(edge_img, gprj_vec);
+	DetectStringHeight(gprj_vec, edge_img.cols, candidates, min_char_height, max_char_height);
+}
 
+
+void NumberDetect::DetectStringHeight(const std::vector<float>& gprj_vec, int cols, std::vector<cv::Rect>& candidates,
+	int min_char_height, int max_char_height)
+{
 	std::vector<std::pair<int,int> > msers;
-	Mser1D(gprj_vec, msers, 1.0, 2.0, min_char_height, max_char_height);
+	{
+		CCNR_PROFILE_SCOPE(STAGE_MSER);
+		Mser1D(gprj_vec, msers, 1.0, 2.0, min_char_height, max_char_height);
+	}
 //	Mser1D(gprj_vec, msers, 1.0, 2.0, 20, 32);
 
 	if(msers.empty())
@@ -165,7 +285,7 @@ void NumberDetect::DetectStringHeight(const cv::Mat& edge_img, std::vector<cv::R
 	for(int i=idx.size() -1; i>=0; i--){
 		if(scores[idx[i]] / max_score < 0.90)
 			break;
-		cv::Rect rect(0, msers[idx[i]].first, edge_img.cols, msers[idx[i]].second);
+		cv::Rect rect(0, msers[idx[i]].first, cols, msers[idx[i]].second);
 		candidates.push_back(rect);
 	}
 }
@@ -174,147 +294,91 @@ void NumberDetect::DetectStringHeight(const cv::Mat& edge_img, std::vector<cv::R
 
 void NumberDetect::CreateCreditBreakPattern(std::vector<CHAR_EDGE_TYPE>& pattern, CREDIT_PATTERN type)
 {
-	pattern.push_back(CHAR_STRING_LEFT);
-
-	if(type == TYPE4444){
-		for(int j=0; j<4; j++){
-			for(int i=0; i<3; i++){
-				pattern.push_back(CHAR_BLANK);
-			}
-			if(j<3){
-				pattern.push_back(CHAR_RIGHT);
-				pattern.push_back(CHAR_LEFT);
-			}
-		}
-	}
-	else if(type == TYPE465){
-		for(int i=0; i<3; i++){
-			pattern.push_back(CHAR_BLANK);
-		}
-		pattern.push_back(CHAR_RIGHT);
-		pattern.push_back(CHAR_LEFT);
-		for(int i=0; i<5; i++){
-			pattern.push_back(CHAR_BLANK);
-		}
-		pattern.push_back(CHAR_RIGHT);
-		pattern.push_back(CHAR_LEFT);
-		for(int i=0; i<4; i++){
-			pattern.push_back(CHAR_BLANK);
-		}
-	}
-	else if(type == TYPE464){
-		for(int i=0; i<3; i++){
-			pattern.push_back(CHAR_BLANK);
-		}
-		pattern.push_back(CHAR_RIGHT);
-		pattern.push_back(CHAR_LEFT);
-		for(int i=0; i<5; i++){
-			pattern.push_back(CHAR_BLANK);
-		}
-		pattern.push_back(CHAR_RIGHT);
-		pattern.push_back(CHAR_LEFT);
-		for(int i=0; i<3; i++){
-			pattern.push_back(CHAR_BLANK);
-		}
-	}
-	pattern.push_back(CHAR_STRING_RIGHT);
+	CreditLayout layout = CreditLayout::Builtin(type);
+	pattern.insert(pattern.end(), layout.BreakPattern().begin(), layout.BreakPattern().end());
 }
 
 
-void NumberDetect::CreateCharLeftCost(const cv::Mat& derivmap, std::vector<double>& char_left_cost, int slide)
+void NumberDetect::CreateCharLeftCost(const cv::Mat& derivmap, cv::Mat& char_left_cost, int slide)
 {
 	assert(derivmap.type() == CV_64FC1);
-	cv::Mat tmp_map, edgecost;
-	cv::exp(-derivmap, tmp_map);
-	cv::log(tmp_map + 1, edgecost);
-
-	int num = edgecost.total();
-	double* ptr = (double*)edgecost.data;
-	for(int i=slide; i<num; i++){
-		char_left_cost.push_back(ptr[i]);
-	}
-	for(int i=0; i<slide; i++){
-		char_left_cost.push_back(1.0);
-	}
+	int num = derivmap.total();
+	cv::Mat shifted = char_left_cost.colRange(0, num-slide);
+	SoftPlus(derivmap.colRange(slide, num), -1.0, shifted);
+	char_left_cost.colRange(num-slide, num) = cv::Scalar::all(1.0);
 }
 
 
-void NumberDetect::CreateCharRightCost(const cv::Mat& derivmap, std::vector<double>& char_right_cost, int slide)
+void NumberDetect::CreateCharRightCost(const cv::Mat& derivmap, cv::Mat& char_right_cost, int slide)
 {
 	assert(derivmap.type() == CV_64FC1);
-
-	cv::Mat tmp_map, edgecost;
-	cv::exp(derivmap, tmp_map);
-	cv::log(tmp_map + 1, edgecost);
-
-	int num = edgecost.total();
-	double* ptr = (double*)edgecost.data;
-	for(int i=0; i<slide; i++){
-		char_right_cost.push_back(1.0);
-	}
-	for(int i=0; i<num-slide; i++){
-		char_right_cost.push_back(ptr[i]);
-	}
+	int num = derivmap.total();
+	char_right_cost.colRange(0, slide) = cv::Scalar::all(1.0);
+	cv::Mat shifted = char_right_cost.colRange(slide, num);
+	SoftPlus(derivmap.colRange(0, num-slide), 1.0, shifted);
 }
 
 
-void NumberDetect::CreateCharStringLeftCost(const cv::Mat& block_deriv, const cv::Mat& integ, std::vector<double>& char_string_left_cost, int slide)
+void NumberDetect::CreateCharStringLeftCost(const cv::Mat& block_deriv, const cv::Mat& integ, cv::Mat& char_string_left_cost, int slide)
 {
 	assert(integ.type() == CV_64FC1);
 	double _epsilon = 0.00001;
 	double total = integ.at<double>(integ.rows-1, integ.cols-1) + _epsilon;
-	cv::Mat integ2 = (-integ(cv::Rect(1,1,integ.cols-1,integ.rows-1)) + total) / total;
-
-	std::vector<double> char_left_cost;
-	CreateCharLeftCost(block_deriv, char_left_cost, slide);
-	int full_size = char_left_cost.size();
-
-	for(int i=0; i<full_size; i++){
-		//char_string_left_cost.push_back(- std::log(integ2.at<double>(0,i)));
-		//char_string_left_cost.push_back(char_left_cost[i]);
-		char_string_left_cost.push_back(char_left_cost[i] - std::log(integ2.at<double>(0,i)));
-	}
+	double scale = 1.0 / total;
+	cv::Mat integ2;
+	MatPool::Use(integ2);
+	integ(cv::Rect(1,1,integ.cols-1,integ.rows-1)).convertTo(integ2, CV_32F, -scale, total * scale);
+	cv::log(integ2, integ2);
+
+	CreateCharLeftCost(block_deriv, char_string_left_cost, slide);
+	char_string_left_cost -= integ2;
 }
 
 
-void NumberDetect::CreateCharStringRightCost(const cv::Mat& block_deriv, const cv::Mat& integ, std::vector<double>& char_string_right_cost, int slide)
+void NumberDetect::CreateCharStringRightCost(const cv::Mat& block_deriv, const cv::Mat& integ, cv::Mat& char_string_right_cost, int slide)
 {
 	assert(integ.type() == CV_64FC1);
 	double _epsilon = 0.00001;
 	double total = integ.at<double>(integ.rows-1, integ.cols-1) + _epsilon;
-	cv::Mat integ2 = (integ(cv::Rect(1,1,integ.cols-1,integ.rows-1)) + _epsilon)/ total;
+	double scale = 1.0 / total;
+	cv::Mat integ2;
+	MatPool::Use(integ2);
+	integ(cv::Rect(1,1,integ.cols-1,integ.rows-1)).convertTo(integ2, CV_32F, scale, _epsilon * scale);
+	cv::log(integ2, integ2);
+
+	CreateCharRightCost(block_deriv, char_string_right_cost, slide);
+	char_string_right_cost -= integ2;
+}
 
-	std::vector<double> char_right_cost;
-	CreateCharRightCost(block_deriv, char_right_cost, slide);
-	int full_size = char_right_cost.size();
 
-	for(int i=0; i<full_size; i++){
-		//char_string_right_cost.push_back(- std::log(integ2.at<double>(0,i)));
-		//char_string_right_cost.push_back(char_right_cost[i]);
-		char_string_right_cost.push_back(char_right_cost[i] - std::log(integ2.at<double>(0,i)));
-	}
+void NumberDetect::CreateCharBlankCost(const cv::Mat& derivmap, cv::Mat& char_blank_cost)
+{
+	assert(derivmap.type() == CV_64FC1);
+	SoftPlus(derivmap, -1.0, char_blank_cost);
 }
 
 
-void NumberDetect::CreateCharBlankCost(const cv::Mat& derivmap, std::vector<double>& char_blank_cost)
+void NumberDetect::SoftPlus(const cv::Mat& src, double sign, cv::Mat& dst)
 {
-	assert(derivmap.type() == CV_64FC1);
-	cv::Mat tmp_map, edgecost;
-	cv::exp(-derivmap, tmp_map);
-	cv::log(tmp_map + 1, edgecost);
-
-	int num = edgecost.total();
-	double* ptr = (double*)edgecost.data;
-	for(int i=0; i<num; i++){
-		char_blank_cost.push_back(ptr[i]);
-	}
+	// log(1 + exp(x)) = max(x, 0) + log(1 + exp(-|x|))
+	cv::Mat relu;
+	MatPool::Use(relu);
+	src.convertTo(dst, CV_32F, sign);
+	cv::max(dst, 0.0, relu);
+	cv::scaleAdd(relu, -2.0, dst, dst);	// -|x|
+	cv::exp(dst, dst);
+	dst += 1.0;
+	cv::log(dst, dst);
+	dst += relu;
 }
 
 
 //! zij	
 void NumberDetect::CreateDeriv(const cv::Mat& prj, cv::Mat& deriv1st, cv::Mat& deriv2nd)
 {
-	cv::Mat derivfilter(1,3,CV_64FC1);
+	cv::Mat derivfilter;
+	MatPool::Use(derivfilter);
+	derivfilter.create(1,3,CV_64FC1);
 	derivfilter.at<double>(0,0) = -0.5;
 	derivfilter.at<double>(0,1) = 0;
 	derivfilter.at<double>(0,2) = 0.5;
@@ -328,9 +392,12 @@ void NumberDetect::CreateBlockDeriv(const cv::Mat& prj, int block_size, cv::Mat&
 {
 	block_size += (1-block_size%2);
 
-	cv::Mat tprj;
+	cv::Mat tprj, filter;
+	MatPool::Use(tprj);
+	MatPool::Use(filter);
 	cv::boxFilter(prj, tprj, CV_64FC1, cv::Size(block_size, 1), cv::Point(-1,-1), true);
-	cv::Mat filter = cv::Mat::zeros(1, block_size+2, CV_64FC1); 
+	filter.create(1, block_size+2, CV_64FC1);
+	filter = cv::Scalar::all(0);
 	filter.at<double>(0,0) = -0.1;
 	filter.at<double>(0,block_size+1) = 0.1;
 	cv::filter2D(tprj, dst, CV_64FC1, filter);
@@ -338,12 +405,22 @@ void NumberDetect::CreateBlockDeriv(const cv::Mat& prj, int block_size, cv::Mat&
 
 
 //! AsAXɊÂRXg֐̐
-void NumberDetect::CreateAppearanceCosts(const cv::Mat& edge_img, std::vector<std::vector<double> >& app_costs)
+void NumberDetect::CreateAppearanceCosts(const cv::Mat& edge_img, cv::Mat& app_costs)
 {
-	cv::Mat prj, nprj, gprj;
+	cv::Mat prj;
+	MatPool::Use(prj);
 	Projection(edge_img, prj);
+	CreateAppearanceCosts(prj, edge_img.rows, app_costs);
+}
 
-	int filter_width = edge_img.cols / 80;
+
+void NumberDetect::CreateAppearanceCosts(const cv::Mat& prj, int band_height, cv::Mat& app_costs)
+{
+	cv::Mat nprj, gprj;
+	MatPool::Use(nprj);
+	MatPool::Use(gprj);
+
+	int filter_width = prj.cols / 80;
 	filter_width = (filter_width < 3) ? 3 : filter_width + (1 - filter_width % 2);
 	//cv::GaussianBlur(prj, gprj, cv::Size(filter_width,1), 1.0, 1.0);
 	//cv::normalize(gprj, nprj, 100.0, 0.0, cv::NORM_MINMAX, CV_64FC1);
@@ -352,45 +429,68 @@ void NumberDetect::CreateAppearanceCosts(const cv::Mat& edge_img, std::vector<st
 
 	// ϕz
 	cv::Mat integ;
+	MatPool::Use(integ);
 	cv::integral(gprj, integ);
 
 	// vWFNV̔
 	cv::Mat derivmap, derivmap2nd;
+	MatPool::Use(derivmap);
+	MatPool::Use(derivmap2nd);
 	CreateDeriv(nprj, derivmap, derivmap2nd);
 
 	// ubNPʂ̔
 	cv::Mat blockderiv;
-	int block_size = edge_img.rows;
+	MatPool::Use(blockderiv);
+	int block_size = band_height;
 	CreateBlockDeriv(gprj, block_size, blockderiv);
 
-	app_costs.resize(CHAR_EDGE_TYPE_NUM);
+	app_costs.create(CHAR_EDGE_TYPE_NUM, prj.cols, CV_32FC1);
+	cv::Mat char_left_costs = app_costs.row(CHAR_LEFT);
+	cv::Mat char_right_costs = app_costs.row(CHAR_RIGHT);
+	cv::Mat char_string_left_costs = app_costs.row(CHAR_STRING_LEFT);
+	cv::Mat char_string_right_costs = app_costs.row(CHAR_STRING_RIGHT);
+	cv::Mat char_blank_costs = app_costs.row(CHAR_BLANK);
 
 	//BREAK_TYPE::CHAR_LEFTFz̑傫ɂ炷
-	std::vector<double> char_left_costs;
 	CreateCharLeftCost(derivmap, char_left_costs, 1);
-	app_costs[CHAR_LEFT] = char_left_costs;
 
 	//BREAK_TYPE::CHAR_RIGHTFz̑傫Eɂ炷
-	std::vector<double> char_right_costs;
 	CreateCharRightCost(derivmap, char_right_costs, 1);
-	app_costs[CHAR_RIGHT] = char_right_costs;
 
 	//BREAK_TYPE::CHAR_STRING_LEFTFCHAR_LEFTɏꏊɂdݕt
-	std::vector<double> char_string_left_costs;
-	//CreateCharStringLeftCost(char_left_costs, integ, char_string_left_costs);
 	CreateCharStringLeftCost(blockderiv, integ, char_string_left_costs, 1);
-	app_costs[CHAR_STRING_LEFT] = char_string_left_costs;
 
 	//BREAK_TYPE::CHAR_STRING_RIGHTFCHAR_RIGHTɏꏊɂdݕt
-	std::vector<double> char_string_right_costs;
-	//CreateCharStringRightCost(char_right_costs, integ, char_string_right_costs);
 	CreateCharStringRightCost(blockderiv, integ, char_string_right_costs, 1);
-	app_costs[CHAR_STRING_RIGHT] = char_string_right_costs;
 
 	//BREAK_TYPE::CHAR_BLANKF񎟔̑傫
-	std::vector<double> char_blank_costs;
 	CreateCharBlankCost(derivmap2nd, char_blank_costs);
-	app_costs[CHAR_BLANK] = char_blank_costs;
+}
+
+
+//! Appearance costs from the per-column costs of the one-vs-rest detector
+void NumberDetect::LearnedAppearanceCosts(const cv::Mat& exist_cost, const cv::Mat& non_exist_cost, int half_pitch, cv::Mat& app_costs)
+{
+	assert(exist_cost.type() == CV_32FC1 && non_exist_cost.type() == CV_32FC1);
+	int width = exist_cost.cols;
+	app_costs.create(CHAR_EDGE_TYPE_NUM, width, CV_32FC1);
+	const float* exist = exist_cost.ptr<float>(0);
+	const float* non_exist = non_exist_cost.ptr<float>(0);
+	float* blank = app_costs.ptr<float>(CHAR_BLANK);
+	float* left = app_costs.ptr<float>(CHAR_LEFT);
+	float* right = app_costs.ptr<float>(CHAR_RIGHT);
+	float* string_left = app_costs.ptr<float>(CHAR_STRING_LEFT);
+	float* string_right = app_costs.ptr<float>(CHAR_STRING_RIGHT);
+	for(int x=0; x<width; x++){
+		// the border columns stand for the outside of the band
+		int l = std::max(x - half_pitch, 0);
+		int r = std::min(x + half_pitch, width - 1);
+		blank[x] = (exist[l] + exist[r] + non_exist[x]) / 3.0f;
+		left[x] = (non_exist[l] + exist[r]) / 2.0f;
+		right[x] = (exist[l] + non_exist[r]) / 2.0f;
+		string_left[x] = left[x];
+		string_right[x] = right[x];
+	}
 }
 
 
@@ -405,70 +505,82 @@ void NumberDetect::CreateRegularizationCosts(std::vector<double>& reg_costs, int
 }
 
 
-void NumberDetect::InitPositions(const std::vector<double>& app_costs, std::vector<double>& target_costs, std::vector<int>& positions)
-{
-	argsort_vector(app_costs, positions);
-	target_costs.clear();
-	std::vector<int>::iterator it, it_end = positions.end();
-	for(it = positions.begin(); it != it_end; it++){
-		target_costs.push_back(app_costs[*it]);
-	}
-}
-
-
-void NumberDetect::MinScorePositions(const std::vector<double>& app_costs, const std::vector<double>& size_costs, 
+void NumberDetect::MinScorePositions(const float* app_costs, int width, const std::vector<double>& size_costs, 
 	int pos, double* min_cost, int* min_position)
 {
-	int bi = - size_costs.size() + 1;
+	int bi = - (int)size_costs.size() + 1;
 	int bp = pos + bi;
 	int ep = pos + size_costs.size();
 	if(bp < 0){
 		bi -= bp;
 		bp = 0;
 	}
-	if(ep >= app_costs.size())
-		ep = app_costs.size() - 1;
+	if(ep >= width)
+		ep = width - 1;
 
-	std::vector<double> costs;
+	// first minimum as min_arg()
+	int idx = -1;
 	for(int p = bp, i=bi; p<ep; p++, i++){
-		costs.push_back(app_costs[p] + size_costs[std::abs(i)]);
+		double cost = app_costs[p] + size_costs[std::abs(i)];
+		if(idx < 0 || *min_cost > cost){
+			*min_cost = cost;
+			idx = p - bp;
+		}
 	}
-
-	int idx = min_arg(costs, *min_cost);
 	*min_position = bp + idx;
 }
 
 
 
 //! ܂̗[ZoƂŁÄϓ肵ĂꂼōœKȏꏊZo
-double NumberDetect::ExtractCharRange(std::vector<int>& char_breaks, const std::vector<std::vector<double> >& app_costs,
-	const std::vector<double>& pos_costs, float avg_string_len, float string_len_div, const std::vector<int>& char_pattern, double init_cost)
+double NumberDetect::ExtractCharRange(std::vector<int>& char_breaks, const cv::Mat& app_costs,
+	const std::vector<double>& pos_costs, float avg_string_len, float string_len_div, const std::vector<int>& char_pattern, double init_cost, SearchBudget* budget)
 {
-	std::vector<double> start_costs, end_costs;
-	std::vector<int> start_pos, end_pos;
-
+	assert(app_costs.type() == CV_32FC1 && app_costs.rows == CHAR_EDGE_TYPE_NUM);
+	int width = app_costs.cols;
 	int ptn_size = char_pattern.size();
 
 	// RXg֐ɊÂāA̍[ƉE[\[g
-	InitPositions(app_costs[char_pattern[0]], start_costs, start_pos);
-	InitPositions(app_costs[char_pattern[ptn_size-1]], end_costs, end_pos);
+	LazyArgsort<float> start_sorter(app_costs.ptr<float>(char_pattern[0]), width);
+	LazyArgsort<float> end_sorter(app_costs.ptr<float>(char_pattern[ptn_size-1]), width);
+
+	return ExtractCharRange(char_breaks, app_costs, start_sorter, end_sorter, pos_costs, avg_string_len, string_len_div, char_pattern, init_cost, budget);
+}
+
+
+double NumberDetect::ExtractCharRange(std::vector<int>& char_breaks, const cv::Mat& app_costs,
+	LazyArgsort<float>& start_sorter, LazyArgsort<float>& end_sorter,
+	const std::vector<double>& pos_costs, float avg_string_len, float string_len_div, const std::vector<int>& char_pattern, double init_cost, SearchBudget* budget)
+{
+	int width = app_costs.cols;
+	int ptn_size = char_pattern.size();
+	assert(start_sorter.data() == app_costs.ptr<float>(char_pattern[0]) && start_sorter.size() == width);
+	assert(end_sorter.data() == app_costs.ptr<float>(char_pattern[ptn_size-1]) && end_sorter.size() == width);
 
 	std::vector<int> cur_char_breaks(ptn_size);
 
-	int max_string_width = app_costs[0].size();
+	int max_string_width = width;
 	int min_string_width = max_string_width / 3;
 	double min_cost = init_cost;
-	for(int s=0; s<start_costs.size(); s++){
-		double cur_cost = start_costs[s];
-		cur_char_breaks[0] = start_pos[s];
+	// start and end positions are sorted only as far as the pruning lets the search go
+	bool exhausted = false;
+	for(int s=0; s<width && !exhausted; s++){
+		int start_pos = start_sorter.idx(s);
+		double cur_cost = start_sorter.val(s);
+		cur_char_breaks[0] = start_pos;
 		if(cur_cost >= min_cost)
 			break;
 
-		for(int e=0; e<end_costs.size(); e++){
-			double cur_cost2 = cur_cost + end_costs[e];
-			cur_char_breaks[ptn_size-1] = end_pos[e];
+		for(int e=0; e<width; e++){
+			if(budget && !budget->Spend()){
+				exhausted = true;
+				break;
+			}
+			int end_pos = end_sorter.idx(e);
+			double cur_cost2 = cur_cost + end_sorter.val(e);
+			cur_char_breaks[ptn_size-1] = end_pos;
 
-			int char_str_range = end_pos[e] - start_pos[s];
+			int char_str_range = end_pos - start_pos;
 			if(char_str_range < min_string_width)
 				continue;
 			float diff = ((avg_string_len - char_str_range) / string_len_div);
@@ -480,10 +592,14 @@ double NumberDetect::ExtractCharRange(std::vector<int>& char_breaks, const std::
 
 			float char_size = (float)char_str_range / (ptn_size - 1);
 			for(int p=1; p<ptn_size-1; p++){
+				if(budget && !budget->Spend()){
+					exhausted = true;
+					break;
+				}
 				int app_idx = char_pattern[p];
 				double target_cost;
 				int position;
-				MinScorePositions(app_costs[app_idx], pos_costs, start_pos[s] + round(char_size * p), &target_cost, &position);
+				MinScorePositions(app_costs.ptr<float>(app_idx), width, pos_costs, start_pos + round(char_size * p), &target_cost, &position);
 				cur_cost2 += target_cost;
 				cur_char_breaks[p] = position;
 				if(cur_cost2 >= min_cost)
@@ -493,6 +609,8 @@ double NumberDetect::ExtractCharRange(std::vector<int>& char_breaks, const std::
 					char_breaks = cur_char_breaks;
 				}
 			}
+			if(exhausted)
+				break;
 		}
 	}
 	return min_cost;
@@ -500,47 +618,109 @@ double NumberDetect::ExtractCharRange(std::vector<int>& char_breaks, const std::
 
 
 
-double NumberDetect::DetectCharacterRange(const cv::Mat& edge_img, const cv::Rect& area, std::vector<int>& break_pos, CREDIT_PATTERN& pattern, double min_cost) const
+double NumberDetect::DetectCharacterRange(const cv::Mat& edge_img, const cv::Rect& area, std::vector<int>& break_pos, CREDIT_PATTERN& pattern, double min_cost, SearchBudget* budget,
+	BandCostSource* learned) const
 {
-	std::vector<std::vector<double> > app_costs;
-	CreateAppearanceCosts(edge_img(area).clone(), app_costs);
+	float char_size = (float)area.height/_char_aspect_ratio;
+	cv::Mat app_costs;
+	MatPool::Use(app_costs);
+	{
+		CCNR_PROFILE_SCOPE(STAGE_APPEARANCE_COSTS);
+		if(!learned || learned->ProjectionWeight() != 0){
+			cv::Mat area_img;
+			MatPool::Use(area_img);
+			edge_img(area).copyTo(area_img);
+			CreateAppearanceCosts(area_img, app_costs);
+		}
+		if(learned){
+			cv::Mat exist_cost, non_exist_cost, learned_costs;
+			MatPool::Use(learned_costs);
+			learned->CharCosts(area, exist_cost, non_exist_cost);
+			LearnedAppearanceCosts(exist_cost, non_exist_cost, round(char_size / 2), learned_costs);
+			if(app_costs.empty())
+				learned_costs.convertTo(app_costs, CV_32F, learned->LearnedWeight());
+			else
+				cv::addWeighted(app_costs, learned->ProjectionWeight(), learned_costs, learned->LearnedWeight(), 0.0, app_costs);
+		}
+	}
 
+	return SearchCharacterRange(app_costs, area.height, break_pos, pattern, min_cost, budget);
+}
+
+
+double NumberDetect::SearchCharacterRange(const cv::Mat& app_costs, int band_height, std::vector<int>& break_pos, CREDIT_PATTERN& pattern,
+	double min_cost, SearchBudget* budget) const
+{
+	float char_size = (float)band_height/_char_aspect_ratio;
 	std::vector<double> reg_costs, length_costs;
-	float char_size = (float)area.height/_char_aspect_ratio;
 	int win_size = char_size / 2;
 	win_size += (win_size + 1) % 2;	// 
 	CreateRegularizationCosts(reg_costs, win_size, _char_width_div * char_size);
 
-	std::vector<double> min_costs;
-	std::vector<std::vector<int> > char_break_positions;
+	// All layouts begin with CHAR_STRING_LEFT and end with CHAR_STRING_RIGHT
+	int width = app_costs.cols;
+	LazyArgsort<float> start_sorter(app_costs.ptr<float>(CHAR_STRING_LEFT), width);
+	LazyArgsort<float> end_sorter(app_costs.ptr<float>(CHAR_STRING_RIGHT), width);
+	double ends_cost = start_sorter.val(0) + end_sorter.val(0);
+
+	// Search the layout whose length is closest to the best-scoring ends first: it usually
+	// wins, so the others are pruned early and a truncated search has the likeliest answer.
+	int est_length = end_sorter.idx(0) - start_sorter.idx(0);
+	int layout_num = _Layouts.size();
+	std::vector<std::pair<float, int> > order;
+	for(int i=0; i<layout_num; i++){
+		float avg_length = char_size * _Layouts[i].Span();
+		order.push_back(std::make_pair(std::abs(avg_length - est_length) / (_char_width_div * avg_length), i));
+	}
+	std::stable_sort(order.begin(), order.end());
+
 	int min_idx = 0;
-	for(int i=0; i<_PATTERN_TYPES.size(); i++){
-		float avg_length = char_size * (_CHAR_BREAK_PATTERNS[i].size() - 1);
+	for(int j=0; j<layout_num; j++){
+		if(budget && !budget->Check())
+			break;
+		int i = order[j].second;
+		const CreditLayout& layout = _Layouts[i];
+		float avg_length = char_size * layout.Span();
+		float length_div = _char_width_div * avg_length;
+
+		// Lower bound of ExtractCharRange: the best ends and the length penalty of the
+		// feasible string length closest to the layout's. Implausible layouts stop here.
+		float nearest = std::min(std::max(avg_length, (float)(width / 3)), (float)(width - 1));
+		float diff = (avg_length - nearest) / length_div;
+		if(ends_cost + diff * diff / 2.0 >= min_cost)
+			continue;
+
 		std::vector<int> char_break_pos;
-		double cost = 
-			ExtractCharRange(char_break_pos, app_costs, reg_costs, avg_length, _char_width_div * avg_length, _CHAR_BREAK_PATTERNS[i], min_cost);
+		double cost;
+		{
+			CCNR_PROFILE_SCOPE(STAGE_CHAR_RANGE + (layout.Type() >= 0 ? layout.Type() : CreditLayout::BUILTIN_NUM));
+			cost = ExtractCharRange(char_break_pos, app_costs, start_sorter, end_sorter, reg_costs, avg_length, length_div, layout.BreakPattern(), min_cost, budget);
+		}
 		if(cost < min_cost && !char_break_pos.empty()){
 			min_cost = cost;
 			min_idx = i;
 			break_pos = char_break_pos;
 		}
 	}
-	pattern = _PATTERN_TYPES[min_idx];
+	pattern = min_idx;
 
 	return min_cost;
 }
 
 
-double NumberDetect::DetectCharacterBoxes(const cv::Mat& edge_img, const std::vector<cv::Rect>& number_area, std::vector<cv::Rect>& char_boxes, CREDIT_PATTERN& pattern) const
+double NumberDetect::DetectCharacterBoxes(const cv::Mat& edge_img, const std::vector<cv::Rect>& number_area, std::vector<cv::Rect>& char_boxes, CREDIT_PATTERN& pattern, SearchBudget* budget,
+	BandCostSource* learned) const
 {
 	std::vector<int> min_break_pos;
 	double min_cost = 10000;
 	int cand_size = number_area.size();
 	int min_i = -1;
 	for(int i = 0;i<cand_size;i++){
+		if(budget && !budget->Check())
+			break;
 		CREDIT_PATTERN cur_pattern;
 		std::vector<int> break_pos;
-		double cost = DetectCharacterRange(edge_img, number_area[i], break_pos, cur_pattern, min_cost);
+		double cost = DetectCharacterRange(edge_img, number_area[i], break_pos, cur_pattern, min_cost, budget, learned);
 		if(cost < min_cost){
 			min_cost = cost;
 			min_break_pos = break_pos;
@@ -551,7 +731,7 @@ double NumberDetect::DetectCharacterBoxes(const cv::Mat& edge_img, const std::ve
 
 	// NWbgJ[hԍ̈i[
 	if(min_i >= 0){
-		ConvertXtoRects(min_break_pos, char_boxes, number_area[min_i], pattern);
+		_Layouts[pattern].ConvertToRects(min_break_pos, char_boxes, number_area[min_i]);
 	}
 	return min_cost;
 }
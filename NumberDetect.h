@@ -35,9 +35,45 @@
 #define __NUMBER_DETECT__
 
 #include <opencv2/core/core.hpp>
+#include "argsort.hpp"
+#include "SearchBudget.h"
+#include "CreditLayout.h"
 
 namespace ccnr{
 
+//! Learned character costs of the bands searched by NumberDetect::ExtractNumbers
+/*!
+The costs are mixed into the appearance costs of a band as
+projection_weight * CreateAppearanceCosts + learned_weight * LearnedAppearanceCosts.
+*/
+class BandCostSource
+{
+public:
+	BandCostSource(float projection_weight, float learned_weight)
+		: _projection_weight(projection_weight), _learned_weight(learned_weight){};
+	virtual ~BandCostSource(){};
+
+	//! Cost of a character centered at each column of band and of none there
+	/*!
+	\param[in] band area of the edge image given to ExtractNumbers
+	\param[out] exist_cost, non_exist_cost 1 x band.width, CV_32FC1
+	*/
+	virtual void CharCosts(const cv::Rect& band, cv::Mat& exist_cost, cv::Mat& non_exist_cost) = 0;
+
+	float ProjectionWeight() const{
+		return _projection_weight;
+	}
+
+	float LearnedWeight() const{
+		return _learned_weight;
+	}
+
+private:
+	float _projection_weight;
+	float _learned_weight;
+};
+
+
 class NumberDetect
 {
 public:
@@ -54,19 +90,70 @@ public:
 		CHAR_STRING_RIGHT = 4;	// Ŝ̍[iI_j
 	static const int CHAR_EDGE_TYPE_NUM = 5;
 
-	typedef enum{
-		TYPE4444,
-		TYPE465,
-		TYPE464
-	}CREDIT_PATTERN;
+	//! Built-in layout, the index of CreditLayout::Builtin()
+	typedef int CREDIT_PATTERN;
+
+	//! Orientation of the card in the edge image, bits of the flips that make it upright
+	typedef int ORIENTATION;
+
+	static const ORIENTATION
+		ORIENT_UPRIGHT = 0,
+		ORIENT_MIRRORED = 1,	// flipped left to right
+		ORIENT_FLIPPED = 2,	// flipped top to bottom
+		ORIENT_UPSIDE_DOWN = 3;	// rotated by 180 degrees
+	static const int ORIENTATION_NUM = 4;
+
+	static const CREDIT_PATTERN
+		TYPE4444 = 0,
+		TYPE465 = 1,
+		TYPE464 = 2,
+		TYPE44443 = 3,
+		TYPE445 = 4;
 
 	float _char_aspect_ratio;	// ̃AXyNg
 	float _char_width_div;	// ̋؂ʒuɑ΂yieB
 	float _min_char_height_ratio;	// 摜̕ɑ΂ŏ̔
 	float _max_char_height_ratio;	// 摜̕ɑ΂ő啶̔
+	float _position_sigma_ratio;	// spread of the number line around 0.6 of the height, between orientations
 
 	//! NWbgJ[hԍ̈ʒu擾
-	void ExtractNumbers(const cv::Mat& edge_img, std::vector<cv::Rect>& num_pos, CREDIT_PATTERN& pattern) const;
+	/*!
+	\param[in] budget optional deadline/work limit. When it runs out the best boxes found so far are
+	returned and budget->Truncated() is set.
+	\return cost of the boxes, 10000 if nothing was found
+	*/
+	double ExtractNumbers(const cv::Mat& edge_img, std::vector<cv::Rect>& num_pos, CREDIT_PATTERN& pattern, SearchBudget* budget = 0,
+		BandCostSource* learned = 0) const;
+
+	//! ExtractNumbers over several orientations of the card, from the same projections
+	/*!
+	Flipping the edge image only reverses its projections, so the bands of all orientations
+	come from one row projection and each band's appearance costs from one column
+	projection. The cost of an orientation adds the position prior of its band,
+	((center / rows - 0.6) / _position_sigma_ratio)^2 / 2, to the break cost; the cheapest
+	orientation wins, the first one searched on a tie. Learned costs are not used.
+	\param[out] orientation the winner
+	\param[in] orientations bit (1 << o) of every ORIENTATION o to search
+	\param[out] num_pos boxes in edge_img, in the reading order of the upright card
+	\return cost of the boxes including the position prior, 10000 if nothing was found
+	*/
+	double ExtractNumbers(const cv::Mat& edge_img, std::vector<cv::Rect>& num_pos, CREDIT_PATTERN& pattern,
+		ORIENTATION& orientation, int orientations, SearchBudget* budget = 0) const;
+
+	//! cv::flip code that makes a card of the orientation upright, 2 for none
+	static int FlipCode(ORIENTATION orientation);
+
+	//! Layouts searched by ExtractNumbers (4-4-4-4, 4-6-5 and 4-6-4 by default)
+	/*!
+	The pattern returned by ExtractNumbers is an index of this list, which equals
+	TYPE4444, TYPE465 and TYPE464 for the default layouts.
+	\return -1 if layouts is empty
+	*/
+	int SetLayouts(const std::vector<CreditLayout>& layouts);
+
+	const std::vector<CreditLayout>& GetLayouts() const{
+		return _Layouts;
+	}
 
 	/////////////////////////////////////
 	//! NWbgJ[hԍ̈ʒu擾
@@ -75,7 +162,24 @@ public:
 	/////////////////////////////////////
 
 	//! AsAXɊÂRXg֐̐
-	static void CreateAppearanceCosts(const cv::Mat& edge_img, std::vector<std::vector<double> >& app_costs);
+	/*!
+	\param[out] app_costs CHAR_EDGE_TYPE_NUM x edge_img.cols (CV_32FC1), one row per CHAR_EDGE_TYPE
+	*/
+	static void CreateAppearanceCosts(const cv::Mat& edge_img, cv::Mat& app_costs);
+
+	//! CreateAppearanceCosts from the column projection of the band (1 x cols, CV_64FC1)
+	static void CreateAppearanceCosts(const cv::Mat& prj, int band_height, cv::Mat& app_costs);
+
+	//! Appearance costs from the costs of a character centered at each column
+	/*!
+	A break at x has a character centered half a pitch to its left and/or right and
+	none on the other side; between two digits (CHAR_BLANK) no character is centered
+	on the break itself either. Each row is the mean of these terms.
+	\param[in] exist_cost, non_exist_cost 1 x n, CV_32FC1
+	\param[in] half_pitch half of the character pitch [pixel]
+	\param[out] app_costs CHAR_EDGE_TYPE_NUM x n (CV_32FC1), as CreateAppearanceCosts
+	*/
+	static void LearnedAppearanceCosts(const cv::Mat& exist_cost, const cv::Mat& non_exist_cost, int half_pitch, cv::Mat& app_costs);
 
 	//! Ԃ̋؂ʒuɊÂRXg֐̐ij
 	static void CreateRegularizationCosts(std::vector<double>& reg_costs, int window_size, double sigma);
@@ -90,9 +194,22 @@ public:
 	\param[in] sring_len_div ̒̕W΍
 	\paran[in] char_pattern ؂蕶p^[
 	*/
-	static double ExtractCharRange(std::vector<CHAR_EDGE_TYPE>& char_breaks, const std::vector<std::vector<double> >& app_costs,
+	static double ExtractCharRange(std::vector<CHAR_EDGE_TYPE>& char_breaks, const cv::Mat& app_costs,
+		const std::vector<double>& pos_costs, float avg_string_len, float string_len_div,
+		const std::vector<int>& char_pattern, double init_cost = 10000, SearchBudget* budget = 0);
+
+	//! ExtractCharRange with start and end positions sorted by the caller
+	/*!
+	start_sorter and end_sorter must sort the rows char_pattern.front() and char_pattern.back()
+	of app_costs. Patterns with the same first and last edge types can share them, so each
+	position is sorted at most once however many patterns are searched.
+	One unit of budget is spent per start/end pair and per inner break; once it runs out the
+	best breaks found so far are kept.
+	*/
+	static double ExtractCharRange(std::vector<CHAR_EDGE_TYPE>& char_breaks, const cv::Mat& app_costs,
+		LazyArgsort<float>& start_sorter, LazyArgsort<float>& end_sorter,
 		const std::vector<double>& pos_costs, float avg_string_len, float string_len_div,
-		const std::vector<int>& char_pattern, double init_cost = 10000);
+		const std::vector<int>& char_pattern, double init_cost = 10000, SearchBudget* budget = 0);
 
 	//! NWbgJ[hԍ̃p^[擾
 	static void CreateCreditBreakPattern(std::vector<CHAR_EDGE_TYPE>& pattern, CREDIT_PATTERN type = TYPE4444);
@@ -100,8 +217,11 @@ public:
 		const cv::Rect& region, const CREDIT_PATTERN& pattern);
 
 private:
-	std::vector<CREDIT_PATTERN> _PATTERN_TYPES;
-	std::vector<std::vector<CHAR_EDGE_TYPE> > _CHAR_BREAK_PATTERNS;
+	std::vector<CreditLayout> _Layouts;
+
+	//! Best layout and breaks on the appearance costs of a band of height band_height
+	double SearchCharacterRange(const cv::Mat& app_costs, int band_height, std::vector<int>& break_pos, CREDIT_PATTERN& pattern,
+		double min_cost, SearchBudget* budget) const;
 
 	//! J[hԍ̂s當Ԃ̋؂ʒuZo
 	/*!
@@ -112,7 +232,8 @@ private:
 	\param[in] min_cost ŏRXgBvZ̑؂ɎgpB
 	\return ŏRXgBقǁuۂvB
 	*/
-	double DetectCharacterRange(const cv::Mat& edge_img, const cv::Rect& number_area, std::vector<int>& break_pos, CREDIT_PATTERN& pattern, double min_cost = 10000) const;
+	double DetectCharacterRange(const cv::Mat& edge_img, const cv::Rect& number_area, std::vector<int>& break_pos, CREDIT_PATTERN& pattern, double min_cost = 10000, SearchBudget* budget = 0,
+		BandCostSource* learned = 0) const;
 
 	//! J[hԍ̂s當Ԃ̋؂ʒuZo
 	/*!
@@ -122,19 +243,23 @@ private:
 	\param[out] pattern NWbgJ[hԍ̕ѕi4-4-4-4, 4-6-5, 4-6-4j
 	\return ŏRXgBقǁuۂvB
 	*/
-	double DetectCharacterBoxes(const cv::Mat& edge_img, const std::vector<cv::Rect>& number_area, std::vector<cv::Rect>& char_boxes, CREDIT_PATTERN& pattern) const;
+	double DetectCharacterBoxes(const cv::Mat& edge_img, const std::vector<cv::Rect>& number_area, std::vector<cv::Rect>& char_boxes, CREDIT_PATTERN& pattern, SearchBudget* budget = 0,
+		BandCostSource* learned = 0) const;
 
 	//! NWbgJ[hԍ̃p^[擾
 	//static void CreateCreditBreakPattern(std::vector<int>& pattern, CREDIT_PATTERN type = TYPE4444);
 
 	//! RXg}bv
-	static void CreateCharLeftCost(const cv::Mat& derivmap, std::vector<double>& char_left_cost, int slide = 1);
-	static void CreateCharRightCost(const cv::Mat& derivmap, std::vector<double>& char_right_cost, int slide = 1);
-	static void CreateCharStringLeftCost(const cv::Mat& block_deriv, const cv::Mat& integ, std::vector<double>& char_string_left_cost, int slide = 1);
-	static void CreateCharStringRightCost(const cv::Mat& block_deriv, const cv::Mat& integ, std::vector<double>& char_string_right_cost, int slide = 1);
+	static void CreateCharLeftCost(const cv::Mat& derivmap, cv::Mat& char_left_cost, int slide = 1);
+	static void CreateCharRightCost(const cv::Mat& derivmap, cv::Mat& char_right_cost, int slide = 1);
+	static void CreateCharStringLeftCost(const cv::Mat& block_deriv, const cv::Mat& integ, cv::Mat& char_string_left_cost, int slide = 1);
+	static void CreateCharStringRightCost(const cv::Mat& block_deriv, const cv::Mat& integ, cv::Mat& char_string_right_cost, int slide = 1);
 	//static void CreateCharStringLeftCost(const std::vector<double>& char_left_cost, const cv::Mat& integ, std::vector<double>& char_string_left_cost);
 	//static void CreateCharStringRightCost(const std::vector<double>& char_right_cost, const cv::Mat& integ, std::vector<double>& char_string_right_cost);
-	static void CreateCharBlankCost(const cv::Mat& derivmap, std::vector<double>& char_blank_cost);
+	static void CreateCharBlankCost(const cv::Mat& derivmap, cv::Mat& char_blank_cost);
+
+	//! dst = log(1 + exp(sign * src)) in place of a 1 x n CV_32FC1 row
+	static void SoftPlus(const cv::Mat& src, double sign, cv::Mat& dst);
 
 	//! zij
 	static void CreateDeriv(const cv::Mat& prj, cv::Mat& div1st, cv::Mat& div2nd);
@@ -146,11 +271,16 @@ private:
 	//static void ConvertXtoRects(const std::vector<int>& breaks, std::vector<cv::Rect>& number_rects, 
 	//	const cv::Rect& region, const CREDIT_PATTERN& pattern);
 
-	static void InitPositions(const std::vector<double>& app_costs, std::vector<double>& target_costs, std::vector<int>& positions);
-
-	static void MinScorePositions(const std::vector<double>& app_costs, const std::vector<double>& size_costs, 
+	static void MinScorePositions(const float* app_costs, int width, const std::vector<double>& size_costs, 
 		int pos, double* min_cost, int* min_position);
 
+	//! Smoothed row projection searched by DetectStringHeight
+	static void StringProfile(const cv::Mat& edge_img, std::vector<float>& profile);
+
+	//! DetectStringHeight on a StringProfile of an image cols wide
+	static void DetectStringHeight(const std::vector<float>& profile, int cols, std::vector<cv::Rect>& candidates,
+		int min_char_height, int max_char_height);
+
 	//! NWbgJ[hԍ̖ޓx]
 	static void EvaluateNumberStrings(const std::vector<std::pair<int,int> >& line_pos, std::vector<double>& scores, const std::vector<float>& prj);
 };
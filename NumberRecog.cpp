@@ -33,7 +33,12 @@
 
 #include "NumberRecog.h"
 #include "common.h"
+#include "MatPool.h"
+#include "ModelFile.h"
 #include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
 namespace ccnr{
 
@@ -57,7 +62,9 @@ cv::Mat NumberRecog::HomogeneousVector(const cv::Mat& feature)
 		feature.convertTo(conv_mat, CV_32FC1);
 	}
 
-	cv::Mat dest_mat(feature.rows, feature.cols+1, CV_32FC1);
+	cv::Mat dest_mat;
+	MatPool::Use(dest_mat);
+	dest_mat.create(feature.rows, feature.cols+1, CV_32FC1);
 	conv_mat.copyTo(dest_mat(cv::Rect(0,0,feature.cols,feature.rows)));
 
 	int c = feature.cols;
@@ -109,19 +116,25 @@ int NumberRecog::SvmCoeff2Filters(const cv::Mat& svm_param, const cv::Size& filt
 
 int NumberRecog::Load(const std::string& svm_file)
 {
-	cv::FileStorage fs(svm_file, cv::FileStorage::READ);
-	if(!fs.isOpened())
+	cv::Mat svm_coeffs;
+	if(ModelFile::Read(svm_file, svm_coeffs) < 0)
 		return -1;
+	return Load(svm_coeffs);
+}
 
-	cv::Mat svm_coeffs;
-	fs["svm_coeff"] >> svm_coeffs;
+
+int NumberRecog::Load(const cv::Mat& svm_coeffs)
+{
 	if(svm_coeffs.empty())
 		return -1;
 
+	// never convert into the current buffer: copies of this object may share it
+	cv::Mat coeffs;
 	if(svm_coeffs.type() == CV_32FC1)
-		_SvmCoeffs = svm_coeffs;
+		coeffs = svm_coeffs;
 	else
-		svm_coeffs.convertTo(_SvmCoeffs, CV_32FC1);
+		svm_coeffs.convertTo(coeffs, CV_32FC1);
+	_SvmCoeffs = coeffs;
 
 	_NumClass = round(std::sqrt(2 * _SvmCoeffs.rows - 0.25) + 0.5);
 
@@ -135,7 +148,10 @@ cv::Mat NumberRecog::score(const cv::Mat& feature) const
 		return cv::Mat();
 
 	cv::Mat hom_feat = HomogeneousVector(feature);
-	return _SvmCoeffs * hom_feat.t();
+	cv::Mat scores;
+	MatPool::Use(scores);
+	cv::gemm(_SvmCoeffs, hom_feat, 1.0, cv::noArray(), 0.0, scores, cv::GEMM_2_T);
+	return scores;
 }
 
 
@@ -166,13 +182,8 @@ int NumberRecog::predict(const cv::Mat& feature) const
 
 int NumberRecog::LoadDetector(const std::string& train_file, const cv::Size& filter_size)
 {
-	cv::FileStorage fs(train_file, cv::FileStorage::READ);
-	if(!fs.isOpened())
-		return -1;
-
 	cv::Mat svm_coeffs;
-	fs["svm_coeff"] >> svm_coeffs;
-	if(svm_coeffs.empty())
+	if(ModelFile::Read(train_file, svm_coeffs) < 0)
 		return -1;
 
 	int ret = SvmCoeff2Filters(svm_coeffs, filter_size, _Filters, _Bias, CV_32FC1);
@@ -190,6 +201,7 @@ void NumberRecog::ScoreMap(const std::vector<cv::Mat>& feature_map, cv::Mat& res
 	int num_filter = filter.size();
 	for(int i=0; i<num_filter; i++){
 		cv::Mat dst;
+		MatPool::Use(dst);
 		cv::filter2D(feature_map[i], dst, feature_map[i].type(), filter[i]);
 		if(i==0)
 			response_map = dst;
@@ -206,7 +218,10 @@ void NumberRecog::Score2Cost(const cv::Mat& response_map, cv::Mat& pos_cost_map,
 	assert(response_map.type() == CV_32FC1 || response_map.type() == CV_64FC1);
 
 	cv::Mat pos_exp_map, neg_exp_map;
-	cv::exp(-response_map, pos_exp_map);
+	MatPool::Use(pos_exp_map);
+	MatPool::Use(neg_exp_map);
+	response_map.convertTo(pos_exp_map, -1, -1.0);
+	cv::exp(pos_exp_map, pos_exp_map);
 	pos_exp_map += 1.0;
 	cv::log(pos_exp_map, pos_cost_map);
 
@@ -218,77 +233,169 @@ void NumberRecog::Score2Cost(const cv::Mat& response_map, cv::Mat& pos_cost_map,
 ////////// One-vs-Rest Filter /////////
 int NumberRecog::LoadOVR(const std::string& train_file, const cv::Size& filter_size)
 {
-	cv::FileStorage fs(train_file, cv::FileStorage::READ);
-	if(!fs.isOpened())
+	cv::Mat svm_coeffs;
+	if(ModelFile::Read(train_file, svm_coeffs) < 0)
 		return -1;
+	return LoadOVR(svm_coeffs, filter_size);
+}
 
-	cv::Mat svm_coeffs;
-	fs["svm_coeff"] >> svm_coeffs;
-	if(svm_coeffs.empty())
+
+int NumberRecog::LoadOVR(const cv::Mat& svm_coeffs, const cv::Size& filter_size)
+{
+	int filter_area = filter_size.area();
+	if(svm_coeffs.empty() || filter_area <= 0 || svm_coeffs.cols % filter_area != 1)
 		return -1;
 
-	int ret = SvmCoeff2Filters(svm_coeffs, filter_size, _FilterOVR, _BiasOVR, CV_32FC1);
-	if(ret < 0)
-		return ret;
+	// never convert into the current buffer: copies of this object may share it
+	cv::Mat coeffs;
+	if(svm_coeffs.type() == CV_32FC1)
+		coeffs = svm_coeffs.clone();
+	else
+		svm_coeffs.convertTo(coeffs, CV_32FC1);
+	_CoeffsOVR = coeffs;
+	_FilterSizeOVR = filter_size;
 
 	return 0;
 }
 
 
-int NumberRecog::SvmCoeff2Filters(const cv::Mat& svm_param, const cv::Size& filter_size, 
-	std::vector<std::vector<cv::Mat> >& filterOVR, std::vector<double>& biasOVR, int type)
+unsigned int NumberRecog::GetChecksumOVR() const
+{
+	if(_CoeffsOVR.empty())
+		return 0;
+	return ModelFile::CRC32(_CoeffsOVR.data, _CoeffsOVR.total() * _CoeffsOVR.elemSize());
+}
+
+
+void NumberRecog::ResponseMatrixOVR(const std::vector<cv::Mat>& feature_map, cv::Mat& responses) const
 {
-	filterOVR.clear();
-	biasOVR.clear();
-	for(int i=0; i<svm_param.rows; i++){
-		std::vector<cv::Mat> filter;
-		double bias;
-		int ret = SvmCoeff2Filters(svm_param(cv::Rect(0,i,svm_param.cols,1)), filter_size, filter, bias, type);
-		if(ret < 0)
-			return ret;
-		filterOVR.push_back(filter);
-		biasOVR.push_back(bias);
+	int dir_num = (int)feature_map.size();
+	int fw = _FilterSizeOVR.width;
+	int fh = _FilterSizeOVR.height;
+	assert(dir_num * fw * fh + 1 == _CoeffsOVR.cols);
+	int rows = feature_map[0].rows;
+	int cols = feature_map[0].cols;
+
+	// one row per position: the fh x fw window of every direction and 1 for the bias
+	cv::Mat patches;
+	MatPool::Use(patches);
+	patches.create(rows * cols, _CoeffsOVR.cols, CV_32FC1);
+	patches.col(_CoeffsOVR.cols - 1) = cv::Scalar::all(1.0);
+
+	// filter2D anchors the filters at their center
+	int anchor_x = fw / 2;
+	int anchor_y = fh / 2;
+	size_t window_bytes = fw * sizeof(float);
+	for(int d=0; d<dir_num; d++){
+		cv::Mat feature, padded;
+		MatPool::Use(feature);
+		MatPool::Use(padded);
+		feature_map[d].convertTo(feature, CV_32F);
+		cv::copyMakeBorder(feature, padded, anchor_y, fh - 1 - anchor_y, anchor_x, fw - 1 - anchor_x, cv::BORDER_REFLECT_101);
+		for(int y=0; y<rows; y++){
+			for(int j=0; j<fh; j++){
+				const float* src = padded.ptr<float>(y + j);
+				int offset = (d * fh + j) * fw;
+				for(int x=0; x<cols; x++){
+					std::memcpy(patches.ptr<float>(y * cols + x) + offset, src + x, window_bytes);
+				}
+			}
+		}
 	}
-	return 0;
+
+	MatPool::Use(responses);
+	cv::gemm(_CoeffsOVR, patches, 1.0, cv::noArray(), 0.0, responses, cv::GEMM_2_T);
 }
 
 
 void NumberRecog::ScoreMapOVR(const std::vector<cv::Mat>& feature_map, std::vector<cv::Mat>& response_map) const
 {
-	int size = _FilterOVR.size();
 	response_map.clear();
-	for(int i=0; i<size; i++){
-		cv::Mat response;
-		ScoreMap(feature_map, response, _FilterOVR[i], _BiasOVR[i]);
-		response_map.push_back(response);
+	if(_CoeffsOVR.empty() || feature_map.empty())
+		return;
+	cv::Mat responses;
+	ResponseMatrixOVR(feature_map, responses);
+	for(int c=0; c<responses.rows; c++){
+		response_map.push_back(responses.row(c).reshape(1, feature_map[0].rows));
 	}
 }
 
 
-void NumberRecog::Score2CostOVR(const std::vector<cv::Mat>& response_map, cv::Mat& pos_cost_map, cv::Mat& neg_cost_map)
+void NumberRecog::CharExistingCostOVR(const std::vector<cv::Mat>& feature_map, cv::Mat& pos_cost_map, cv::Mat& neg_cost_map,
+	std::vector<cv::Mat>* response_map) const
 {
-	// Ō̉wi
-	int class_num = response_map.size();
-	std::vector<cv::Mat> exp_mats;
-	for(int i=0; i<class_num; i++){
-		cv::Mat expMat;
-		cv::exp(response_map[i], expMat);
-		exp_mats.push_back(expMat);
+	if(response_map)
+		response_map->clear();
+	if(_CoeffsOVR.empty() || feature_map.empty())
+		return;
+	cv::Mat responses;
+	ResponseMatrixOVR(feature_map, responses);
+
+	int rows = feature_map[0].rows;
+	cv::Mat pos_cost, neg_cost;
+	ResponseCostOVR(responses, pos_cost, neg_cost);
+	pos_cost_map = pos_cost.reshape(1, rows);
+	neg_cost_map = neg_cost.reshape(1, rows);
+	if(response_map){
+		for(int c=0; c<responses.rows; c++){
+			response_map->push_back(responses.row(c).reshape(1, rows));
+		}
 	}
+}
+
 
-	cv::Mat sum_mat = exp_mats[0].clone();
-	for(int i=1; i<class_num; i++){
-		sum_mat += exp_mats[i];
+void NumberRecog::ResponseCostOVR(const cv::Mat& responses, cv::Mat& pos_cost, cv::Mat& neg_cost)
+{
+	assert(responses.type() == CV_32FC1 && responses.rows >= 2);
+	int class_num = responses.rows;
+	int num = responses.cols;
+	pos_cost.create(1, num, CV_32FC1);
+	neg_cost.create(1, num, CV_32FC1);
+	float* pos = pos_cost.ptr<float>(0);
+	float* neg = neg_cost.ptr<float>(0);
+
+	std::vector<const float*> resp(class_num);
+	for(int c=0; c<class_num; c++){
+		resp[c] = responses.ptr<float>(c);
 	}
-	
-	cv::Mat neg_prob = exp_mats[class_num-1] / sum_mat;
-	cv::Mat pos_prob = -neg_prob + 1.0;
-
-	cv::Mat neglog, poslog;
-	cv::log(neg_prob,neglog);
-	cv::log(pos_prob,poslog);
-	pos_cost_map = poslog * -1.0;
-	neg_cost_map = neglog * -1.0;
+	const float* background = resp[class_num - 1];
+	for(int i=0; i<num; i++){
+		// log-sum-exp of the digits, and of all classes, each shifted by its maximum
+		float digit_max = resp[0][i];
+		for(int c=1; c<class_num-1; c++){
+			digit_max = std::max(digit_max, resp[c][i]);
+		}
+		double digit_sum = 0;
+		for(int c=0; c<class_num-1; c++){
+			digit_sum += std::exp((double)resp[c][i] - digit_max);
+		}
+		double digit_lse = digit_max + std::log(digit_sum);
+		double all_max = std::max((double)background[i], digit_lse);
+		double all_lse = all_max + std::log(std::exp(digit_lse - all_max) + std::exp(background[i] - all_max));
+
+		// -log(1 - p_bg) and -log(p_bg) of the softmax
+		pos[i] = (float)(all_lse - digit_lse);
+		neg[i] = (float)(all_lse - background[i]);
+	}
+}
+
+
+void NumberRecog::Score2CostOVR(const std::vector<cv::Mat>& response_map, cv::Mat& pos_cost_map, cv::Mat& neg_cost_map)
+{
+	int class_num = (int)response_map.size();
+	int rows = response_map[0].rows;
+	cv::Mat responses;
+	MatPool::Use(responses);
+	responses.create(class_num, (int)response_map[0].total(), CV_32FC1);
+	for(int c=0; c<class_num; c++){
+		cv::Mat dst = responses.row(c).reshape(1, rows);
+		response_map[c].convertTo(dst, CV_32F);
+	}
+
+	cv::Mat pos_cost, neg_cost;
+	ResponseCostOVR(responses, pos_cost, neg_cost);
+	pos_cost_map = pos_cost.reshape(1, rows);
+	neg_cost_map = neg_cost.reshape(1, rows);
 }
 
 
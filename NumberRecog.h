@@ -46,6 +46,7 @@ public:
 
 	///// One-vs-One Prediction ///////
 	int Load(const std::string& train_file);
+	int Load(const cv::Mat& svm_coeffs);
 	int predict(const cv::Mat& feature) const ;
 	cv::Mat score(const cv::Mat& feature) const;
 
@@ -62,12 +63,28 @@ public:
 
 	////// One-vs-Rest  ////////
 	int LoadOVR(const std::string& train_file, const cv::Size& filter_size);
+	int LoadOVR(const cv::Mat& svm_coeffs, const cv::Size& filter_size);
 
-	void CharExistingCostOVR(const std::vector<cv::Mat>& feature_map, cv::Mat& pos_cost_map, cv::Mat& neg_cost_map) const{
-		std::vector<cv::Mat> response_map;
-		ScoreMapOVR(feature_map, response_map);
-		Score2CostOVR(response_map, pos_cost_map, neg_cost_map);
-	};
+	//! Digit (pos) and background (neg) costs of ScoreMapOVR responses, the background last
+	static void Score2CostOVR(const std::vector<cv::Mat>& response_map, cv::Mat& pos_cost_map, cv::Mat& neg_cost_map);
+
+	//! Number of one-vs-rest filters, the background last (0: no detector)
+	int GetNumClassOVR() const{
+		return _CoeffsOVR.rows;
+	}
+
+	//! CRC32 of the one-vs-rest coefficients, which tells detectors apart (0: no detector)
+	unsigned int GetChecksumOVR() const;
+
+	//! ScoreMapOVR and Score2CostOVR in one pass over the responses
+	/*!
+	\param[out] response_map the responses of ScoreMapOVR (may be NULL)
+	*/
+	void CharExistingCostOVR(const std::vector<cv::Mat>& feature_map, cv::Mat& pos_cost_map, cv::Mat& neg_cost_map,
+		std::vector<cv::Mat>* response_map = 0) const;
+
+	//! 摜ɊwKtB^ĉ߂
+	void ScoreMapOVR(const std::vector<cv::Mat>& feature_map, std::vector<cv::Mat>& response_map) const;
 
 private:
 	/*! SVMW
@@ -82,16 +99,17 @@ private:
 	double _Bias;
 	std::vector<cv::Mat> _Filters;
 
-	//! One-vs-Rest SVM
-	std::vector<double> _BiasOVR;
-	std::vector<std::vector<cv::Mat> > _FilterOVR;
+	//! One-vs-Rest SVM, one row per class with the bias last (CV_32FC1)
+	/*!
+	The coefficients are in the order of the feature vector (direction, row, column),
+	which is also the order of the patch rows built by ResponseMatrixOVR.
+	*/
+	cv::Mat _CoeffsOVR;
+	cv::Size _FilterSizeOVR;
 
 	//! SVM̌WtB^`ɕϊ
 	static int SvmCoeff2Filters(const cv::Mat& svm_coeff, const cv::Size& filter_size, std::vector<cv::Mat>& filters, double& bias, int type = -1);
 
-	//! SVM̌WtB^`ɕϊ
-	static int SvmCoeff2Filters(const cv::Mat& svm_coeff, const cv::Size& filter_size, std::vector<std::vector<cv::Mat> >& filters, std::vector<double>& bias, int type = -1);
-
 	//! 摜ɊwKtB^ĉ߂
 	static void ScoreMap(const std::vector<cv::Mat>& feature_map, cv::Mat& response_map, const std::vector<cv::Mat>& filter, double bias);
 
@@ -99,13 +117,22 @@ private:
 		ScoreMap(feature_map, response_map, _Filters, _Bias);
 	};
 
-	//! 摜ɊwKtB^ĉ߂
-	void ScoreMapOVR(const std::vector<cv::Mat>& feature_map, std::vector<cv::Mat>& response_map) const;
-
 	//! SVMRXg֕ϊ
 	static void Score2Cost(const cv::Mat& response_map, cv::Mat& pos_cost_map, cv::Mat& neg_cost_map);
 
-	static void Score2CostOVR(const std::vector<cv::Mat>& response_map, cv::Mat& pos_cost_map, cv::Mat& neg_cost_map);
+	//! Responses of all classes at all positions of the feature map with one matrix product
+	/*!
+	Every position becomes a patch row of all directions (im2col, borders as cv::filter2D:
+	BORDER_REFLECT_101), multiplied by _CoeffsOVR.
+	\param[out] responses class number x (rows * cols), CV_32FC1
+	*/
+	void ResponseMatrixOVR(const std::vector<cv::Mat>& feature_map, cv::Mat& responses) const;
+
+	//! Costs of the columns of a response matrix (background last) with a stable log-sum-exp
+	/*!
+	\param[out] pos_cost, neg_cost 1 x responses.cols, CV_32FC1
+	*/
+	static void ResponseCostOVR(const cv::Mat& responses, cv::Mat& pos_cost, cv::Mat& neg_cost);
 };
 
 }
@@ -0,0 +1,273 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "Profiler.h"
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <iomanip>
+#include <algorithm>
+
+namespace ccnr{
+
+namespace{
+
+// Log-linear buckets: values below 2^SUB_BITS ns map one-to-one, larger
+// values are split into 2^SUB_BITS buckets per power of two (~9% resolution).
+const int SUB_BITS = 3;
+const int SUB_NUM = 1 << SUB_BITS;
+const int MAX_EXP = 42;	// about 73 minutes
+const int BUCKET_NUM = SUB_NUM + (MAX_EXP - SUB_BITS) * SUB_NUM;
+
+int HighestBit(unsigned long long v)
+{
+	int n = 0;
+	if(v >= (1ULL << 32)){ v >>= 32; n += 32; }
+	if(v >= (1ULL << 16)){ v >>= 16; n += 16; }
+	if(v >= (1ULL << 8)){ v >>= 8; n += 8; }
+	if(v >= (1ULL << 4)){ v >>= 4; n += 4; }
+	if(v >= (1ULL << 2)){ v >>= 2; n += 2; }
+	if(v >= (1ULL << 1)){ n += 1; }
+	return n;
+}
+
+int BucketIndex(unsigned long long v)
+{
+	if(v < (unsigned long long)SUB_NUM)
+		return (int)v;
+	int exp = HighestBit(v);
+	if(exp >= MAX_EXP)
+		return BUCKET_NUM - 1;
+	int sub = (int)((v >> (exp - SUB_BITS)) & (SUB_NUM - 1));
+	return SUB_NUM + (exp - SUB_BITS) * SUB_NUM + sub;
+}
+
+// Representative value (center of the bucket range)
+double BucketValue(int idx)
+{
+	if(idx < SUB_NUM)
+		return idx;
+	int exp = (idx - SUB_NUM) / SUB_NUM + SUB_BITS;
+	int sub = (idx - SUB_NUM) % SUB_NUM;
+	double width = (double)(1ULL << (exp - SUB_BITS));
+	return (double)(1ULL << exp) + width * (sub + 0.5);
+}
+
+typedef std::atomic<unsigned long long> Counter;
+
+// Only the owner thread writes, so relaxed load + store is enough
+inline void Add(Counter& c, unsigned long long v)
+{
+	c.store(c.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
+struct StageHistogram
+{
+	Counter count;
+	Counter sum;
+	Counter max;
+	Counter buckets[BUCKET_NUM];
+};
+
+struct ThreadProfile
+{
+	StageHistogram stages[STAGE_NUM];
+
+	ThreadProfile(){
+		Clear();
+	}
+
+	void Clear(){
+		for(int s=0; s<STAGE_NUM; s++){
+			stages[s].count.store(0, std::memory_order_relaxed);
+			stages[s].sum.store(0, std::memory_order_relaxed);
+			stages[s].max.store(0, std::memory_order_relaxed);
+			for(int i=0; i<BUCKET_NUM; i++){
+				stages[s].buckets[i].store(0, std::memory_order_relaxed);
+			}
+		}
+	}
+};
+
+// Profiles outlive their threads so that samples of finished workers are kept
+struct ProfileRegistry
+{
+	std::mutex mutex;
+	std::vector<std::unique_ptr<ThreadProfile> > profiles;
+};
+
+ProfileRegistry& Registry()
+{
+	static ProfileRegistry* registry = new ProfileRegistry();
+	return *registry;
+}
+
+ThreadProfile& LocalProfile()
+{
+	thread_local ThreadProfile* profile = 0;
+	if(!profile){
+		ProfileRegistry& reg = Registry();
+		std::lock_guard<std::mutex> lock(reg.mutex);
+		reg.profiles.push_back(std::unique_ptr<ThreadProfile>(new ThreadProfile()));
+		profile = reg.profiles.back().get();
+	}
+	return *profile;
+}
+
+double Percentile(const std::vector<unsigned long long>& buckets, unsigned long long count, double ratio)
+{
+	unsigned long long rank = (unsigned long long)(ratio * count + 0.5);
+	if(rank < 1)
+		rank = 1;
+	unsigned long long acc = 0;
+	for(int i=0; i<BUCKET_NUM; i++){
+		acc += buckets[i];
+		if(acc >= rank)
+			return BucketValue(i);
+	}
+	return BucketValue(BUCKET_NUM - 1);
+}
+
+}
+
+
+bool Profiler::Enabled()
+{
+#ifdef CCNR_PROFILE
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+void Profiler::Record(int stage, long long nsec)
+{
+	if(stage < 0 || stage >= STAGE_NUM)
+		return;
+	unsigned long long v = (nsec > 0) ? (unsigned long long)nsec : 0;
+	StageHistogram& hist = LocalProfile().stages[stage];
+	Add(hist.count, 1);
+	Add(hist.sum, v);
+	Add(hist.buckets[BucketIndex(v)], 1);
+	if(v > hist.max.load(std::memory_order_relaxed))
+		hist.max.store(v, std::memory_order_relaxed);
+}
+
+
+void Profiler::Collect(std::vector<StageStatistics>& stats)
+{
+	stats.clear();
+	ProfileRegistry& reg = Registry();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+	for(int s=0; s<STAGE_NUM; s++){
+		std::vector<unsigned long long> buckets(BUCKET_NUM, 0);
+		unsigned long long count = 0, sum = 0, max = 0;
+		for(size_t t=0; t<reg.profiles.size(); t++){
+			const StageHistogram& hist = reg.profiles[t]->stages[s];
+			count += hist.count.load(std::memory_order_relaxed);
+			sum += hist.sum.load(std::memory_order_relaxed);
+			unsigned long long m = hist.max.load(std::memory_order_relaxed);
+			if(m > max)
+				max = m;
+			for(int i=0; i<BUCKET_NUM; i++){
+				buckets[i] += hist.buckets[i].load(std::memory_order_relaxed);
+			}
+		}
+		if(count == 0)
+			continue;
+
+		StageStatistics st;
+		st.name = StageName(s);
+		st.count = count;
+		st.total_ms = sum * 1e-6;
+		st.mean_ms = st.total_ms / count;
+		st.max_ms = max * 1e-6;
+		st.p50_ms = std::min(Percentile(buckets, count, 0.50) * 1e-6, st.max_ms);
+		st.p90_ms = std::min(Percentile(buckets, count, 0.90) * 1e-6, st.max_ms);
+		st.p99_ms = std::min(Percentile(buckets, count, 0.99) * 1e-6, st.max_ms);
+		stats.push_back(st);
+	}
+}
+
+
+void Profiler::Reset()
+{
+	ProfileRegistry& reg = Registry();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+	for(size_t t=0; t<reg.profiles.size(); t++){
+		reg.profiles[t]->Clear();
+	}
+}
+
+
+void Profiler::Print(std::ostream& os)
+{
+	if(!Enabled()){
+		os << "Profiling is disabled. Rebuild with -DCCNR_ENABLE_PROFILE=ON." << std::endl;
+		return;
+	}
+
+	std::vector<StageStatistics> stats;
+	Collect(stats);
+
+	std::ios::fmtflags flags = os.flags();
+	os << std::left << std::setw(22) << "stage" << std::right
+		<< std::setw(10) << "count" << std::setw(12) << "total[ms]" << std::setw(10) << "mean"
+		<< std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+	os << std::fixed << std::setprecision(3);
+	for(size_t i=0; i<stats.size(); i++){
+		os << std::left << std::setw(22) << stats[i].name << std::right
+			<< std::setw(10) << stats[i].count << std::setw(12) << stats[i].total_ms
+			<< std::setw(10) << stats[i].mean_ms << std::setw(10) << stats[i].p50_ms
+			<< std::setw(10) << stats[i].p90_ms << std::setw(10) << stats[i].p99_ms
+			<< std::setw(10) << stats[i].max_ms << std::endl;
+	}
+	os.flags(flags);
+}
+
+
+std::string Profiler::StageName(int stage)
+{
+	static const char* names[] = {
+		"total", "grayscale", "resize", "sobel", "string_height", "mser1d",
+		"appearance_costs", "char_range[4-4-4-4]", "char_range[4-6-5]", "char_range[4-6-4]",
+		"char_range[4-4-4-4-3]", "char_range[4-4-5]", "char_range[other]", "feature", "predict",
+		"locate_card", "deskew"
+	};
+	if(stage < 0 || stage >= STAGE_NUM)
+		return std::string();
+	return names[stage];
+}
+
+}
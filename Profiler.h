@@ -0,0 +1,133 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __PROFILER__
+#define __PROFILER__
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <chrono>
+
+namespace ccnr{
+
+//! Pipeline stages measured by the profiler
+typedef enum{
+	STAGE_TOTAL,	// RecognizeCreditCardNumber as a whole
+	STAGE_GRAYSCALE,
+	STAGE_RESIZE,
+	STAGE_SOBEL,
+	STAGE_STRING_HEIGHT,	// DetectStringHeight including Mser1D
+	STAGE_MSER,
+	STAGE_APPEARANCE_COSTS,
+	STAGE_CHAR_RANGE,	// ExtractCharRange, one slot per built-in CreditLayout and one for the others
+	STAGE_FEATURE = STAGE_CHAR_RANGE + 6,
+	STAGE_PREDICT,
+	STAGE_LOCATE,	// CardLocator::Locate (LocateAll) and Rectify
+	STAGE_DESKEW,	// SkewEstimator::Estimate and the rotation of the working image
+	STAGE_NUM
+}PROFILE_STAGE;
+
+//! Latency statistics of one stage (milliseconds)
+struct StageStatistics
+{
+	std::string name;
+	unsigned long long count;
+	double total_ms;
+	double mean_ms;
+	double p50_ms;
+	double p90_ms;
+	double p99_ms;
+	double max_ms;
+};
+
+
+//! Per-stage latency histograms
+/*!
+Every thread records into its own counters, so recording never takes a lock.
+Collect() merges the counters of all threads that have recorded so far.
+Timers are only compiled in when CCNR_PROFILE is defined.
+*/
+class Profiler
+{
+public:
+	//! true if the library was built with CCNR_PROFILE
+	static bool Enabled();
+
+	//! Record one sample of a stage in the calling thread's histogram
+	static void Record(int stage, long long nsec);
+
+	//! Merge all threads' histograms. Stages without samples are skipped.
+	static void Collect(std::vector<StageStatistics>& stats);
+
+	//! Clear all threads' histograms
+	static void Reset();
+
+	//! Print the result of Collect() as a table
+	static void Print(std::ostream& os);
+
+	static std::string StageName(int stage);
+};
+
+
+//! Record the time between construction and destruction
+class ScopedTimer
+{
+public:
+	explicit ScopedTimer(int stage) : _stage(stage), _start(std::chrono::steady_clock::now()){};
+
+	~ScopedTimer(){
+		std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - _start;
+		Profiler::Record(_stage, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+	};
+
+private:
+	int _stage;
+	std::chrono::steady_clock::time_point _start;
+
+	ScopedTimer(const ScopedTimer&);
+	ScopedTimer& operator=(const ScopedTimer&);
+};
+
+}
+
+#define CCNR_PROFILE_CONCAT_(a, b) a##b
+#define CCNR_PROFILE_CONCAT(a, b) CCNR_PROFILE_CONCAT_(a, b)
+
+#ifdef CCNR_PROFILE
+#define CCNR_PROFILE_SCOPE(stage) ccnr::ScopedTimer CCNR_PROFILE_CONCAT(_ccnr_timer_, __LINE__)(stage)
+#else
+#define CCNR_PROFILE_SCOPE(stage)
+#endif
+
+#endif
@@ -0,0 +1,140 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "RawImage.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <climits>
+
+namespace ccnr{
+
+namespace{
+
+int Channels(int format)
+{
+	switch(format){
+	case CCNR_PIXEL_GRAY8:
+	case CCNR_PIXEL_YUV_NV12:
+	case CCNR_PIXEL_YUV_I420:
+		return 1;
+	case CCNR_PIXEL_BGR8:
+	case CCNR_PIXEL_RGB8:
+		return 3;
+	case CCNR_PIXEL_BGRA8:
+	case CCNR_PIXEL_RGBA8:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+}
+
+
+long long RawImage::Bytes(int width, int height, int stride, int format)
+{
+	int channels = Channels(format);
+	if(channels == 0 || width <= 0 || height <= 0 || stride < 0)
+		return -1;
+	// the header may come from another process, so the row must fit the int of cv::Mat
+	long long row_bytes = (long long)width * channels;
+	if(row_bytes > INT_MAX)
+		return -1;
+	if(stride == 0)
+		stride = (int)row_bytes;
+	if((long long)stride < row_bytes)
+		return -1;
+
+	long long bytes = (long long)stride * height;
+	long long chroma_rows = ((long long)height + 1) / 2;
+	if(format == CCNR_PIXEL_YUV_NV12)
+		bytes += (long long)stride * chroma_rows;	// interleaved UV, full stride
+	else if(format == CCNR_PIXEL_YUV_I420)
+		bytes += 2 * (((long long)stride + 1) / 2) * chroma_rows;	// U and V planes
+	return bytes;
+}
+
+
+int RawImage::Wrap(const unsigned char* pixels, int width, int height, int stride, int format,
+	cv::Mat& buf, cv::Mat& img)
+{
+	if(!pixels || Bytes(width, height, stride, format) < 0)
+		return -1;
+	int channels = Channels(format);
+	if(stride == 0)
+		stride = (int)((long long)width * channels);	// checked by Bytes()
+
+	// the Y plane of a YUV image is its gray image
+	cv::Mat src(height, width, CV_8UC(channels), const_cast<unsigned char*>(pixels), (size_t)stride);
+
+	// The pipeline converts color with COLOR_RGB2GRAY because cv::imread gives BGR
+	// to the command line tool. The other orders use the weights that give the
+	// same gray image for the same picture.
+	switch(format){
+	case CCNR_PIXEL_RGB8:
+		cv::cvtColor(src, buf, cv::COLOR_BGR2GRAY);
+		img = buf;
+		break;
+	case CCNR_PIXEL_BGRA8:
+		cv::cvtColor(src, buf, cv::COLOR_RGBA2GRAY);
+		img = buf;
+		break;
+	case CCNR_PIXEL_RGBA8:
+		cv::cvtColor(src, buf, cv::COLOR_BGRA2GRAY);
+		img = buf;
+		break;
+	default:
+		img = src;
+	}
+	return 0;
+}
+
+
+int RawImage::StoreResult(const std::vector<int>& numbers, const std::vector<cv::Rect>& num_pos, const RecogStatus& status,
+	ccnr_result& result)
+{
+	int num = (int)numbers.size();
+	result.num_digits = num;
+	for(int i=0; i<num && i<CCNR_MAX_DIGITS; i++){
+		result.digits[i].digit = numbers[i];
+		result.digits[i].x = num_pos[i].x;
+		result.digits[i].y = num_pos[i].y;
+		result.digits[i].width = num_pos[i].width;
+		result.digits[i].height = num_pos[i].height;
+	}
+	result.truncated = status.truncated ? 1 : 0;
+	result.cost = status.cost;
+	result.elapsed_ms = status.elapsed_ms;
+	return num > CCNR_MAX_DIGITS ? CCNR_ERROR_BUFFER : CCNR_OK;
+}
+
+}
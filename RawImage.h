@@ -0,0 +1,75 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __RAW_IMAGE__
+#define __RAW_IMAGE__
+
+#include <opencv2/core/core.hpp>
+#include "ccnr_c.h"
+#include "CreditNumberRecog.h"
+
+namespace ccnr{
+
+//! Images in caller-owned memory, described by ccnr_pixel_format (ccnr_c.h)
+class RawImage
+{
+public:
+	//! Bytes from the first row to the end of the image
+	/*!
+	For the YUV formats stride is the stride of the Y plane and the chroma planes
+	follow it directly.
+	\return -1 if the format is unknown or the stride is shorter than a row
+	*/
+	static long long Bytes(int width, int height, int stride, int format);
+
+	//! Image that RecognizeCreditCardNumber takes, pointing to pixels when possible
+	/*!
+	Gray, BGR and the Y plane of YUV images are used in place. The other color
+	orders are converted to gray into buf.
+	\param[in] stride bytes from one row to the next (0: packed rows)
+	\return -1 if the format or size is invalid
+	*/
+	static int Wrap(const unsigned char* pixels, int width, int height, int stride, int format,
+		cv::Mat& buf, cv::Mat& img);
+
+	//! Store a recognition in a ccnr_result, as ccnr_recognize returns it
+	/*!
+	\return CCNR_ERROR_BUFFER if only the first CCNR_MAX_DIGITS digits fit, otherwise CCNR_OK
+	*/
+	static int StoreResult(const std::vector<int>& numbers, const std::vector<cv::Rect>& num_pos, const RecogStatus& status,
+		ccnr_result& result);
+};
+
+}
+
+#endif
@@ -0,0 +1,262 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "ResultCache.h"
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <cstring>
+#include <algorithm>
+
+namespace ccnr{
+
+namespace{
+
+const unsigned long long PRIME1 = 11400714785074694791ULL;
+const unsigned long long PRIME2 = 14029467366897019727ULL;
+const unsigned long long PRIME3 = 1609587929392839161ULL;
+const unsigned long long PRIME4 = 9650029242287828579ULL;
+const unsigned long long PRIME5 = 2870177450012600261ULL;
+
+inline unsigned long long Rotl(unsigned long long v, int r)
+{
+	return (v << r) | (v >> (64 - r));
+}
+
+inline unsigned long long Read64(const unsigned char* p)
+{
+	unsigned long long v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+inline unsigned int Read32(const unsigned char* p)
+{
+	unsigned int v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+inline unsigned long long Round(unsigned long long acc, unsigned long long input)
+{
+	acc += input * PRIME2;
+	return Rotl(acc, 31) * PRIME1;
+}
+
+inline unsigned long long MergeRound(unsigned long long acc, unsigned long long val)
+{
+	acc ^= Round(0, val);
+	return acc * PRIME1 + PRIME4;
+}
+
+//! Spread the bits of the whole key over the map and shard indices
+struct KeyHash
+{
+	size_t operator()(const ResultCache::Key& key) const{
+		unsigned long long h = key.content ^ Rotl(key.model_version * PRIME2, 17) ^ Rotl(key.options * PRIME3, 41) ^ key.bytes;
+		h ^= h >> 33;
+		h *= PRIME2;
+		h ^= h >> 29;
+		return (size_t)h;
+	}
+};
+
+}
+
+
+struct ResultCache::Shard
+{
+	typedef std::list<std::pair<Key, std::vector<CardResult> > > LruList;
+
+	std::mutex mutex;
+	size_t capacity;
+	LruList lru;	// the most recently used first
+	std::unordered_map<Key, LruList::iterator, KeyHash> index;
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long evictions;
+
+	explicit Shard(size_t capacity_) : capacity(capacity_), hits(0), misses(0), evictions(0){};
+};
+
+
+ResultCache::ResultCache(size_t capacity, int shard_num) : _capacity(std::max((size_t)1, capacity))
+{
+	// no shard without room, and the capacities add up to the total
+	size_t num = std::min((size_t)std::max(1, shard_num), _capacity);
+	for(size_t i=0; i<num; i++){
+		_shards.push_back(new Shard(_capacity / num + (i < _capacity % num ? 1 : 0)));
+	}
+}
+
+
+ResultCache::~ResultCache()
+{
+	for(size_t i=0; i<_shards.size(); i++){
+		delete _shards[i];
+	}
+}
+
+
+unsigned long long ResultCache::Hash(const void* data, size_t bytes, unsigned long long seed)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	const unsigned char* end = p + bytes;
+	unsigned long long h;
+
+	if(bytes >= 32){
+		unsigned long long v1 = seed + PRIME1 + PRIME2;
+		unsigned long long v2 = seed + PRIME2;
+		unsigned long long v3 = seed;
+		unsigned long long v4 = seed - PRIME1;
+		const unsigned char* limit = end - 32;
+		do{
+			v1 = Round(v1, Read64(p));
+			v2 = Round(v2, Read64(p + 8));
+			v3 = Round(v3, Read64(p + 16));
+			v4 = Round(v4, Read64(p + 24));
+			p += 32;
+		}while(p <= limit);
+		h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+		h = MergeRound(h, v1);
+		h = MergeRound(h, v2);
+		h = MergeRound(h, v3);
+		h = MergeRound(h, v4);
+	}
+	else{
+		h = seed + PRIME5;
+	}
+	h += (unsigned long long)bytes;
+
+	for(; p + 8 <= end; p += 8){
+		h ^= Round(0, Read64(p));
+		h = Rotl(h, 27) * PRIME1 + PRIME4;
+	}
+	if(p + 4 <= end){
+		h ^= (unsigned long long)Read32(p) * PRIME1;
+		h = Rotl(h, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	for(; p < end; p++){
+		h ^= (*p) * PRIME5;
+		h = Rotl(h, 11) * PRIME1;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
+
+
+ResultCache::Key ResultCache::MakeKey(const void* data, size_t bytes, unsigned long long model_version, unsigned long long options)
+{
+	Key key;
+	key.content = Hash(data, bytes);
+	key.bytes = bytes;
+	key.model_version = model_version;
+	key.options = options;
+	return key;
+}
+
+
+ResultCache::Shard& ResultCache::ShardOf(const Key& key) const
+{
+	// the high bits, the map of the shard uses the low ones
+	unsigned long long h = KeyHash()(key);
+	return *_shards[(size_t)((h >> 32) % _shards.size())];
+}
+
+
+bool ResultCache::Get(const Key& key, std::vector<CardResult>& cards)
+{
+	Shard& shard = ShardOf(key);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	std::unordered_map<Key, Shard::LruList::iterator, KeyHash>::iterator it = shard.index.find(key);
+	if(it == shard.index.end()){
+		shard.misses++;
+		return false;
+	}
+	shard.hits++;
+	shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+	cards = it->second->second;
+	return true;
+}
+
+
+void ResultCache::Put(const Key& key, const std::vector<CardResult>& cards)
+{
+	Shard& shard = ShardOf(key);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	std::unordered_map<Key, Shard::LruList::iterator, KeyHash>::iterator it = shard.index.find(key);
+	if(it != shard.index.end()){
+		// another thread recognized the same input meanwhile
+		it->second->second = cards;
+		shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+		return;
+	}
+	if(shard.lru.size() >= shard.capacity){
+		shard.index.erase(shard.lru.back().first);
+		shard.lru.pop_back();
+		shard.evictions++;
+	}
+	shard.lru.push_front(std::make_pair(key, cards));
+	shard.index[key] = shard.lru.begin();
+}
+
+
+void ResultCache::Clear()
+{
+	for(size_t i=0; i<_shards.size(); i++){
+		std::lock_guard<std::mutex> lock(_shards[i]->mutex);
+		_shards[i]->index.clear();
+		_shards[i]->lru.clear();
+	}
+}
+
+
+void ResultCache::GetStatistics(ResultCacheStatistics& stats) const
+{
+	std::memset(&stats, 0, sizeof(stats));
+	for(size_t i=0; i<_shards.size(); i++){
+		std::lock_guard<std::mutex> lock(_shards[i]->mutex);
+		stats.hits += _shards[i]->hits;
+		stats.misses += _shards[i]->misses;
+		stats.evictions += _shards[i]->evictions;
+		stats.entries += _shards[i]->lru.size();
+	}
+}
+
+}
@@ -0,0 +1,126 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __RESULT_CACHE__
+#define __RESULT_CACHE__
+
+#include "CreditNumberRecog.h"
+#include <vector>
+
+namespace ccnr{
+
+//! Counters of a ResultCache, summed over its shards
+struct ResultCacheStatistics
+{
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long evictions;	// least recently used entries dropped for new ones
+	unsigned long long entries;	// results currently kept
+};
+
+
+//! Bounded LRU cache of recognition results keyed by the hash of the input bytes
+/*!
+Byte-identical inputs, e.g. retried requests or reprocessed folders, get the result
+of the first one without being decoded or recognized again. The key also holds the
+model version and a fingerprint of the options, so a reloaded model or other options
+never see older results.
+
+The entries are split into shards by key, each with its own lock and LRU list,
+so that worker threads rarely wait for each other.
+\code
+ResultCache::Key key = ResultCache::MakeKey(bytes.data(), bytes.size(), recog.GetModelVersion());
+if(!cache.Get(key, cards)){
+	... decode and recognize into cards ...
+	cache.Put(key, cards);
+}
+\endcode
+*/
+class ResultCache
+{
+public:
+	struct Key
+	{
+		unsigned long long content;	// Hash() of the input bytes
+		unsigned long long bytes;
+		unsigned long long model_version;
+		unsigned long long options;
+
+		Key() : content(0), bytes(0), model_version(0), options(0){};
+
+		bool operator==(const Key& other) const{
+			return content == other.content && bytes == other.bytes && model_version == other.model_version && options == other.options;
+		}
+	};
+
+	//! Cache of at most capacity results (> 0) in shard_num shards
+	explicit ResultCache(size_t capacity, int shard_num = 16);
+	~ResultCache();
+
+	//! 64 bit hash of a byte string (XXH64), several GB/s
+	static unsigned long long Hash(const void* data, size_t bytes, unsigned long long seed = 0);
+
+	static Key MakeKey(const void* data, size_t bytes, unsigned long long model_version, unsigned long long options = 0);
+
+	//! Copy the result of key and mark it as the most recently used
+	/*!
+	\return false if it is not cached
+	*/
+	bool Get(const Key& key, std::vector<CardResult>& cards);
+
+	//! Store the result of key, dropping the least recently used of its shard if it is full
+	void Put(const Key& key, const std::vector<CardResult>& cards);
+
+	void Clear();
+
+	size_t Capacity() const{
+		return _capacity;
+	}
+
+	void GetStatistics(ResultCacheStatistics& stats) const;
+
+private:
+	struct Shard;
+
+	size_t _capacity;
+	std::vector<Shard*> _shards;
+
+	Shard& ShardOf(const Key& key) const;
+
+	ResultCache(const ResultCache&);
+	ResultCache& operator=(const ResultCache&);
+};
+
+}
+
+#endif
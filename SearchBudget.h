@@ -0,0 +1,116 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __SEARCH_BUDGET__
+#define __SEARCH_BUDGET__
+
+#include <chrono>
+
+namespace ccnr{
+
+//! Deadline and work limit of an anytime search
+/*!
+A search calls Spend() for every unit of work and stops as soon as it returns
+false, keeping the best hypothesis found so far. Truncated() tells the caller
+that the result may not be optimal.
+The clock is read only every CHECK_INTERVAL units.
+*/
+class SearchBudget
+{
+public:
+	//! No limit
+	SearchBudget() : _has_deadline(false), _max_work(0), _work(0), _next_check(CHECK_INTERVAL), _truncated(false){};
+
+	/*!
+	\param[in] time_limit_ms time from now, <= 0 for no deadline
+	\param[in] max_work maximum units of work, <= 0 for no limit
+	*/
+	explicit SearchBudget(double time_limit_ms, long long max_work = 0)
+		: _has_deadline(time_limit_ms > 0), _max_work(max_work), _work(0), _next_check(CHECK_INTERVAL), _truncated(false)
+	{
+		if(_has_deadline){
+			_deadline = std::chrono::steady_clock::now() + 
+				std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(time_limit_ms));
+		}
+	};
+
+	//! Account work; false once the budget is exhausted
+	bool Spend(long long work = 1){
+		if(_truncated)
+			return false;
+		_work += work;
+		if(_max_work > 0 && _work > _max_work){
+			_truncated = true;
+			return false;
+		}
+		if(_has_deadline && _work >= _next_check){
+			_next_check = _work + CHECK_INTERVAL;
+			if(std::chrono::steady_clock::now() >= _deadline){
+				_truncated = true;
+				return false;
+			}
+		}
+		return true;
+	};
+
+	//! Read the clock now, e.g. before a step that does not call Spend()
+	bool Check(){
+		if(!_truncated && _has_deadline && std::chrono::steady_clock::now() >= _deadline)
+			_truncated = true;
+		return !_truncated;
+	};
+
+	//! true if the search was cut short
+	bool Truncated() const{
+		return _truncated;
+	};
+
+	//! Units of work spent so far
+	long long Work() const{
+		return _work;
+	};
+
+private:
+	static const long long CHECK_INTERVAL = 64;
+
+	bool _has_deadline;
+	std::chrono::steady_clock::time_point _deadline;
+	long long _max_work;
+	long long _work;
+	long long _next_check;
+	bool _truncated;
+};
+
+}
+
+#endif
@@ -0,0 +1,539 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "ShmRing.h"
+#include <atomic>
+#include <thread>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <new>
+#include <algorithm>
+
+#if defined(__unix__)
+#define CCNR_SHM_RING
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <time.h>
+#endif
+
+namespace ccnr{
+
+#ifdef CCNR_SHM_RING
+
+namespace{
+
+const char MAGIC[8] = {'C', 'C', 'N', 'R', 'S', 'H', 'M', '\0'};
+const uint32_t VERSION = 2;
+const size_t ALIGN = 64;
+
+size_t AlignUp(size_t v)
+{
+	return (v + ALIGN - 1) / ALIGN * ALIGN;
+}
+
+//! Bounded queue over an array of entries that start with a sequence number
+/*!
+Entry i is free for position pos when its sequence is pos, filled when it is
+pos + 1, and free again for pos + slot_num once the consumer is done with it.
+The semaphores count free and filled entries so that waiters can sleep.
+*/
+struct Queue
+{
+	alignas(64) std::atomic<uint64_t> enqueue_pos;
+	alignas(64) std::atomic<uint64_t> dequeue_pos;
+	alignas(64) sem_t free_num;
+	sem_t filled_num;
+};
+
+struct alignas(64) FrameEntry
+{
+	ShmFrameInfo info;
+	uint32_t producer;
+	uint32_t generation;
+};
+
+//! Entry of the queue of submitted slots
+struct alignas(64) SubmitEntry
+{
+	std::atomic<uint64_t> seq;
+	uint32_t index;
+};
+
+struct alignas(64) ResultEntry
+{
+	std::atomic<uint64_t> seq;
+	uint32_t generation;
+	ShmResult result;
+};
+
+struct alignas(64) ProducerEntry
+{
+	std::atomic<uint32_t> in_use;
+	std::atomic<uint32_t> generation;	// incremented by every Open() that takes the ring
+	Queue results;
+};
+
+//! Wait on a semaphore, -1 on timeout (timeout_ms < 0: forever)
+int Wait(sem_t* sem, double timeout_ms)
+{
+	if(timeout_ms < 0){
+		while(sem_wait(sem) != 0){
+			if(errno != EINTR)
+				return -1;
+		}
+		return 0;
+	}
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	long long nsec = deadline.tv_nsec + (long long)(timeout_ms * 1e6);
+	deadline.tv_sec += (time_t)(nsec / 1000000000LL);
+	deadline.tv_nsec = (long)(nsec % 1000000000LL);
+	while(sem_timedwait(sem, &deadline) != 0){
+		if(errno != EINTR)
+			return -1;
+	}
+	return 0;
+}
+
+//! Sequence number of entry i, entries are step bytes apart
+inline std::atomic<uint64_t>& Seq(std::atomic<uint64_t>* first, size_t step, uint64_t i)
+{
+	return *reinterpret_cast<std::atomic<uint64_t>*>(reinterpret_cast<char*>(first) + step * i);
+}
+
+//! Claim the entry at the tail of the queue (a free one has been counted)
+/*!
+The entries are only held while one is copied in or out, so the tail entry can
+only be busy for the few instructions a consumer of the previous round needs to
+copy it out.
+*/
+uint64_t ClaimFree(Queue& q, std::atomic<uint64_t>* first, size_t step, unsigned int n)
+{
+	for(;;){
+		uint64_t pos = q.enqueue_pos.load(std::memory_order_relaxed);
+		uint64_t seq = Seq(first, step, pos % n).load(std::memory_order_acquire);
+		if(seq == pos){
+			if(q.enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				return pos;
+		}
+		else if(seq < pos){
+			// the consumer of the previous round is still copying it out
+			std::this_thread::yield();
+		}
+	}
+}
+
+//! Claim the entry at the head of the queue (a filled one has been counted)
+uint64_t ClaimFilled(Queue& q, std::atomic<uint64_t>* first, size_t step, unsigned int n)
+{
+	for(;;){
+		uint64_t pos = q.dequeue_pos.load(std::memory_order_relaxed);
+		uint64_t seq = Seq(first, step, pos % n).load(std::memory_order_acquire);
+		if(seq == pos + 1){
+			if(q.dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				return pos;
+		}
+		else if(seq < pos + 1){
+			// the writer that claimed it before the counted one is still copying it in
+			std::this_thread::yield();
+		}
+	}
+}
+
+std::string SegmentName(const std::string& name)
+{
+	return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+
+}
+
+
+struct ShmRing::Header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t slot_num;
+	uint32_t producer_num;
+	uint64_t frame_bytes;
+	uint64_t frame_step;	// entry + pixel buffer
+	uint64_t frames_offset;
+	uint64_t submits_offset;
+	uint64_t free_offset;	// bitmap of the free frame slots
+	uint64_t producers_offset;
+	uint64_t results_offset;	// slot_num entries per producer
+	uint64_t total_size;
+	std::atomic<uint32_t> ready;	// set last by Create()
+
+	Queue frames;	// free_num counts the free slots, the queue holds the submitted ones
+
+	FrameEntry* Frame(unsigned int i){
+		return reinterpret_cast<FrameEntry*>(reinterpret_cast<char*>(this) + frames_offset + frame_step * i);
+	}
+
+	unsigned char* FrameData(unsigned int i){
+		return reinterpret_cast<unsigned char*>(Frame(i)) + AlignUp(sizeof(FrameEntry));
+	}
+
+	SubmitEntry* Submits(){
+		return reinterpret_cast<SubmitEntry*>(reinterpret_cast<char*>(this) + submits_offset);
+	}
+
+	std::atomic<uint64_t>* FreeWords(){
+		return reinterpret_cast<std::atomic<uint64_t>*>(reinterpret_cast<char*>(this) + free_offset);
+	}
+
+	unsigned int FreeWordNum() const{
+		return (slot_num + 63) / 64;
+	}
+
+	ProducerEntry* Producer(unsigned int p){
+		return reinterpret_cast<ProducerEntry*>(reinterpret_cast<char*>(this) + producers_offset) + p;
+	}
+
+	ResultEntry* Results(unsigned int p){
+		return reinterpret_cast<ResultEntry*>(reinterpret_cast<char*>(this) + results_offset) + (size_t)slot_num * p;
+	}
+};
+
+static_assert(sizeof(ResultEntry) % 64 == 0, "ResultEntry must be padded to its alignment");
+static_assert(sizeof(SubmitEntry) % 64 == 0, "SubmitEntry must be padded to its alignment");
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory queues need lock-free 64 bit atomics");
+
+
+ShmRing::ShmRing() : _header(0), _size(0), _owner(false), _producer(-1), _generation(0)
+{
+}
+
+
+ShmRing::~ShmRing()
+{
+	Close();
+}
+
+
+int ShmRing::Map(int fd, size_t size)
+{
+	void* addr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(addr == MAP_FAILED)
+		return -1;
+	_header = static_cast<Header*>(addr);
+	_size = size;
+	return 0;
+}
+
+
+int ShmRing::Create(const std::string& name, int slot_num, size_t frame_bytes, int producer_num)
+{
+	Close();
+	if(slot_num <= 0 || frame_bytes == 0 || producer_num <= 0)
+		return -1;
+
+	size_t frame_step = AlignUp(sizeof(FrameEntry)) + AlignUp(frame_bytes);
+	size_t frames_offset = AlignUp(sizeof(Header));
+	size_t submits_offset = frames_offset + frame_step * slot_num;
+	size_t free_offset = submits_offset + sizeof(SubmitEntry) * slot_num;
+	size_t producers_offset = AlignUp(free_offset + sizeof(uint64_t) * ((slot_num + 63) / 64));
+	size_t results_offset = producers_offset + sizeof(ProducerEntry) * producer_num;
+	size_t total = results_offset + sizeof(ResultEntry) * slot_num * producer_num;
+
+	std::string seg = SegmentName(name);
+	shm_unlink(seg.c_str());	// stale segment of a previous run
+	int fd = shm_open(seg.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if(fd < 0)
+		return -1;
+	if(ftruncate(fd, (off_t)total) != 0){
+		close(fd);
+		shm_unlink(seg.c_str());
+		return -1;
+	}
+	if(Map(fd, total) < 0){
+		shm_unlink(seg.c_str());
+		return -1;
+	}
+
+	Header* h = new(_header) Header();
+	h->version = VERSION;
+	h->slot_num = (uint32_t)slot_num;
+	h->producer_num = (uint32_t)producer_num;
+	h->frame_bytes = frame_bytes;
+	h->frame_step = frame_step;
+	h->frames_offset = frames_offset;
+	h->submits_offset = submits_offset;
+	h->free_offset = free_offset;
+	h->producers_offset = producers_offset;
+	h->results_offset = results_offset;
+	h->total_size = total;
+	h->frames.enqueue_pos.store(0, std::memory_order_relaxed);
+	h->frames.dequeue_pos.store(0, std::memory_order_relaxed);
+	bool sem_ok = sem_init(&h->frames.free_num, 1, slot_num) == 0 && sem_init(&h->frames.filled_num, 1, 0) == 0;
+	for(int p=0; p<producer_num && sem_ok; p++){
+		ProducerEntry* producer = new(h->Producer(p)) ProducerEntry();
+		producer->in_use.store(0, std::memory_order_relaxed);
+		producer->generation.store(0, std::memory_order_relaxed);
+		producer->results.enqueue_pos.store(0, std::memory_order_relaxed);
+		producer->results.dequeue_pos.store(0, std::memory_order_relaxed);
+		sem_ok = sem_init(&producer->results.free_num, 1, slot_num) == 0 && sem_init(&producer->results.filled_num, 1, 0) == 0;
+		ResultEntry* results = h->Results(p);
+		for(int i=0; i<slot_num; i++){
+			new(&results[i]) ResultEntry();
+			results[i].seq.store(i, std::memory_order_relaxed);
+		}
+	}
+	if(!sem_ok){
+		munmap(_header, _size);
+		_header = 0;
+		shm_unlink(seg.c_str());
+		return -1;
+	}
+	SubmitEntry* submits = h->Submits();
+	for(int i=0; i<slot_num; i++){
+		new(h->Frame(i)) FrameEntry();
+		new(&submits[i]) SubmitEntry();
+		submits[i].seq.store(i, std::memory_order_relaxed);
+	}
+	std::atomic<uint64_t>* words = h->FreeWords();
+	for(unsigned int w=0; w<h->FreeWordNum(); w++){
+		unsigned int bits = std::min(64u, (unsigned int)slot_num - w * 64);
+		new(&words[w]) std::atomic<uint64_t>(bits == 64 ? ~0ULL : (1ULL << bits) - 1);
+	}
+	std::memcpy(h->magic, MAGIC, sizeof(MAGIC));
+	h->ready.store(1, std::memory_order_release);
+
+	_name = seg;
+	_owner = true;
+	return 0;
+}
+
+
+int ShmRing::Open(const std::string& name)
+{
+	Close();
+	std::string seg = SegmentName(name);
+	int fd = shm_open(seg.c_str(), O_RDWR, 0);
+	if(fd < 0)
+		return -1;
+	struct stat st;
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)){
+		close(fd);
+		return -1;
+	}
+	if(Map(fd, (size_t)st.st_size) < 0)
+		return -1;
+	if(_header->ready.load(std::memory_order_acquire) != 1 || std::memcmp(_header->magic, MAGIC, sizeof(MAGIC)) != 0
+		|| _header->version != VERSION || _header->total_size != _size){
+		Close();
+		return -1;
+	}
+	_name = seg;
+	_owner = false;
+
+	// results still on the way to the previous holder of the ring are told apart by the generation
+	for(unsigned int p=0; p<_header->producer_num; p++){
+		uint32_t free_ring = 0;
+		ProducerEntry* producer = _header->Producer(p);
+		if(producer->in_use.compare_exchange_strong(free_ring, 1, std::memory_order_acq_rel)){
+			_producer = (int)p;
+			_generation = producer->generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+			return 0;
+		}
+	}
+	Close();
+	return -1;
+}
+
+
+void ShmRing::Close()
+{
+	if(_header){
+		if(_producer >= 0)
+			_header->Producer(_producer)->in_use.store(0, std::memory_order_release);
+		munmap(_header, _size);
+		_header = 0;
+		_size = 0;
+	}
+	if(_owner)
+		shm_unlink(_name.c_str());
+	_owner = false;
+	_producer = -1;
+	_name.clear();
+}
+
+
+int ShmRing::SlotNum() const
+{
+	return _header ? (int)_header->slot_num : 0;
+}
+
+
+size_t ShmRing::FrameBytes() const
+{
+	return _header ? (size_t)_header->frame_bytes : 0;
+}
+
+
+int ShmRing::AcquireFrame(Slot& slot, double timeout_ms)
+{
+	if(!_header || _producer < 0 || Wait(&_header->frames.free_num, timeout_ms) < 0)
+		return -1;
+	// a free slot has been counted, so one of the bits is set
+	std::atomic<uint64_t>* words = _header->FreeWords();
+	unsigned int word_num = _header->FreeWordNum();
+	for(;;){
+		for(unsigned int w=0; w<word_num; w++){
+			uint64_t bits = words[w].load(std::memory_order_relaxed);
+			while(bits){
+				int bit = __builtin_ctzll(bits);
+				if(words[w].compare_exchange_weak(bits, bits & ~(1ULL << bit), std::memory_order_acquire, std::memory_order_relaxed)){
+					slot.index = w * 64 + bit;
+					slot.data = _header->FrameData(slot.index);
+					slot.capacity = (size_t)_header->frame_bytes;
+					slot.producer = (uint32_t)_producer;
+					slot.generation = _generation;
+					return 0;
+				}
+			}
+		}
+	}
+}
+
+
+void ShmRing::SubmitFrame(const Slot& slot, const ShmFrameInfo& info)
+{
+	FrameEntry* entry = _header->Frame(slot.index);
+	entry->info = info;
+	entry->producer = slot.producer;
+	entry->generation = slot.generation;
+
+	unsigned int n = _header->slot_num;
+	SubmitEntry* submits = _header->Submits();
+	uint64_t pos = ClaimFree(_header->frames, &submits[0].seq, sizeof(SubmitEntry), n);
+	submits[pos % n].index = slot.index;
+	submits[pos % n].seq.store(pos + 1, std::memory_order_release);
+	sem_post(&_header->frames.filled_num);
+}
+
+
+int ShmRing::ReceiveFrame(Slot& slot, ShmFrameInfo& info, double timeout_ms)
+{
+	if(!_header || Wait(&_header->frames.filled_num, timeout_ms) < 0)
+		return -1;
+	unsigned int n = _header->slot_num;
+	SubmitEntry* submits = _header->Submits();
+	uint64_t pos = ClaimFilled(_header->frames, &submits[0].seq, sizeof(SubmitEntry), n);
+	slot.index = submits[pos % n].index;
+	submits[pos % n].seq.store(pos + n, std::memory_order_release);
+
+	const FrameEntry* entry = _header->Frame(slot.index);
+	slot.data = _header->FrameData(slot.index);
+	slot.capacity = (size_t)_header->frame_bytes;
+	slot.producer = entry->producer;
+	slot.generation = entry->generation;
+	info = entry->info;
+	return 0;
+}
+
+
+void ShmRing::ReleaseFrame(const Slot& slot)
+{
+	_header->FreeWords()[slot.index / 64].fetch_or(1ULL << (slot.index % 64), std::memory_order_release);
+	sem_post(&_header->frames.free_num);
+}
+
+
+int ShmRing::SendResult(const Slot& slot, const ShmResult& result, double timeout_ms)
+{
+	if(!_header || slot.producer >= _header->producer_num)
+		return -1;
+	Queue& q = _header->Producer(slot.producer)->results;
+	if(Wait(&q.free_num, timeout_ms) < 0)
+		return -1;
+	unsigned int n = _header->slot_num;
+	ResultEntry* entries = _header->Results(slot.producer);
+	uint64_t pos = ClaimFree(q, &entries[0].seq, sizeof(ResultEntry), n);
+	entries[pos % n].generation = slot.generation;
+	entries[pos % n].result = result;
+	entries[pos % n].seq.store(pos + 1, std::memory_order_release);
+	sem_post(&q.filled_num);
+	return 0;
+}
+
+
+int ShmRing::ReceiveResult(ShmResult& result, double timeout_ms)
+{
+	if(!_header || _producer < 0)
+		return -1;
+	Queue& q = _header->Producer(_producer)->results;
+	unsigned int n = _header->slot_num;
+	ResultEntry* entries = _header->Results(_producer);
+	for(;;){
+		if(Wait(&q.filled_num, timeout_ms) < 0)
+			return -1;
+		uint64_t pos = ClaimFilled(q, &entries[0].seq, sizeof(ResultEntry), n);
+		bool own = entries[pos % n].generation == _generation;
+		if(own)
+			result = entries[pos % n].result;
+		entries[pos % n].seq.store(pos + n, std::memory_order_release);
+		sem_post(&q.free_num);
+		// a late result of the previous holder of the ring
+		if(own)
+			return 0;
+	}
+}
+
+#else
+
+struct ShmRing::Header{};
+
+ShmRing::ShmRing() : _header(0), _size(0), _owner(false), _producer(-1), _generation(0){}
+ShmRing::~ShmRing(){}
+int ShmRing::Map(int, size_t){ return -1; }
+int ShmRing::Create(const std::string&, int, size_t, int){ return -1; }
+int ShmRing::Open(const std::string&){ return -1; }
+void ShmRing::Close(){}
+int ShmRing::SlotNum() const{ return 0; }
+size_t ShmRing::FrameBytes() const{ return 0; }
+int ShmRing::AcquireFrame(Slot&, double){ return -1; }
+void ShmRing::SubmitFrame(const Slot&, const ShmFrameInfo&){}
+int ShmRing::ReceiveFrame(Slot&, ShmFrameInfo&, double){ return -1; }
+void ShmRing::ReleaseFrame(const Slot&){}
+int ShmRing::SendResult(const Slot&, const ShmResult&, double){ return -1; }
+int ShmRing::ReceiveResult(ShmResult&, double){ return -1; }
+
+#endif
+
+}
@@ -0,0 +1,169 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __SHM_RING__
+#define __SHM_RING__
+
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+#include "ccnr_c.h"
+
+namespace ccnr{
+
+//! Frame written into a ShmRing slot by the producer
+struct ShmFrameInfo
+{
+	uint64_t frame_id;	// chosen by the producer, returned with the result
+	int32_t width;
+	int32_t height;
+	int32_t stride;	// as ccnr_recognize (0: packed rows)
+	int32_t format;	// ccnr_pixel_format
+};
+
+//! Recognition result returned through the completion ring
+struct ShmResult
+{
+	uint64_t frame_id;
+	int32_t status;	// ccnr_status
+	int32_t reserved;
+	ccnr_result result;
+};
+
+
+//! Frame slots and per-producer completion rings in POSIX shared memory
+/*!
+The recognizer creates the segment; producers on the same host open it by name,
+write raw frames directly into a free slot and submit it. The recognizer reads the
+frame in place, releases the slot and sends a ShmResult back through the
+completion ring of the producer that submitted it. Nothing is copied or encoded
+on the way.
+
+Free slots are kept in a bitmap, so a slot released out of order is available at
+once. Submitted slots and results pass through bounded queues with a sequence number
+per entry. Every producer that opens the segment is given one of producer_num
+completion rings, so it only receives the results of its own frames and may
+number them as it likes. Any number of threads of a producer and of the
+recognizer can use the segment at the same time; process-shared semaphores let
+the waiting side sleep. A slot or completion ring that a crashed process held is
+not recovered until the segment is created again.
+Only available on POSIX systems other than macOS (no unnamed semaphores).
+*/
+class ShmRing
+{
+public:
+	//! A frame slot acquired by the producer or received by the recognizer
+	struct Slot
+	{
+		unsigned char* data;
+		size_t capacity;	// bytes available at data
+		unsigned int index;
+		uint32_t producer;	// completion ring of the submitting producer
+		uint32_t generation;
+
+		Slot() : data(0), capacity(0), index(0), producer(0), generation(0){};
+	};
+
+	ShmRing();
+	~ShmRing();
+
+	//! Create the segment, replacing a stale one with the same name
+	/*!
+	\param[in] name segment name, e.g. "/ccnr" ('/' is added if missing)
+	\param[in] slot_num number of frame slots and entries of each completion ring
+	\param[in] frame_bytes largest frame a slot holds
+	\param[in] producer_num producers that can have the segment open at the same time
+	*/
+	int Create(const std::string& name, int slot_num, size_t frame_bytes, int producer_num = 8);
+
+	//! Attach to a segment created by the recognizer as a producer
+	/*!
+	\return -1 if the segment cannot be opened or all completion rings are in use
+	*/
+	int Open(const std::string& name);
+
+	//! Detach. The creator also removes the name.
+	void Close();
+
+	bool IsOpen() const{
+		return _header != 0;
+	}
+
+	int SlotNum() const;
+
+	size_t FrameBytes() const;
+
+	//! Producer: take a free slot to write a frame into
+	/*!
+	\return -1 on timeout (timeout_ms < 0: wait forever)
+	*/
+	int AcquireFrame(Slot& slot, double timeout_ms = -1);
+
+	//! Producer: hand the frame written into slot to the recognizer
+	void SubmitFrame(const Slot& slot, const ShmFrameInfo& info);
+
+	//! Producer: next result of a frame this producer submitted, in completion order
+	int ReceiveResult(ShmResult& result, double timeout_ms = -1);
+
+	//! Recognizer: next submitted frame, readable at slot.data until ReleaseFrame()
+	int ReceiveFrame(Slot& slot, ShmFrameInfo& info, double timeout_ms = -1);
+
+	//! Recognizer: give the slot back to the producers
+	void ReleaseFrame(const Slot& slot);
+
+	//! Recognizer: queue the result of the frame received in slot for its producer
+	/*!
+	The slot may already have been released.
+	\return -1 if the completion ring of the producer stays full for timeout_ms
+	*/
+	int SendResult(const Slot& slot, const ShmResult& result, double timeout_ms = -1);
+
+private:
+	struct Header;
+
+	Header* _header;
+	size_t _size;
+	std::string _name;
+	bool _owner;
+	int _producer;	// completion ring held by this producer, -1 if none
+	uint32_t _generation;
+
+	ShmRing(const ShmRing&);
+	ShmRing& operator=(const ShmRing&);
+
+	int Map(int fd, size_t size);
+};
+
+}
+
+#endif
@@ -0,0 +1,147 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "SkewEstimator.h"
+#include <cmath>
+#include <algorithm>
+
+namespace ccnr{
+
+void SkewEstimator::StripProfiles(const cv::Mat& edge_img, cv::Mat& profiles, std::vector<float>& offsets) const
+{
+	CV_Assert(edge_img.type() == CV_32FC1);
+	int strip = std::max(1, _params.strip_width);
+	int strips = (edge_img.cols + strip - 1) / strip;
+
+	profiles.create(strips, edge_img.rows, CV_32FC1);
+	offsets.resize(strips);
+	for(int k=0; k<strips; k++){
+		int x_begin = k * strip;
+		int x_end = std::min(x_begin + strip, edge_img.cols);
+		offsets[k] = (x_begin + x_end - edge_img.cols) * 0.5f;
+	}
+	for(int y=0; y<edge_img.rows; y++){
+		const float* src = edge_img.ptr<float>(y);
+		for(int k=0; k<strips; k++){
+			int x_end = std::min((k + 1) * strip, edge_img.cols);
+			float sum = 0;
+			for(int x=k*strip; x<x_end; x++){
+				sum += src[x];
+			}
+			profiles.at<float>(k, y) = sum;
+		}
+	}
+}
+
+
+double SkewEstimator::ShearedSharpness(const cv::Mat& profiles, const std::vector<float>& offsets, double angle,
+	std::vector<float>& profile)
+{
+	int rows = profiles.cols;
+	double slope = std::tan(angle * CV_PI / 180.0);
+	profile.assign(rows, 0.0f);
+	for(int k=0; k<profiles.rows; k++){
+		// the line through row y at the image center crosses strip k at row y + shift
+		int shift = cvRound(slope * offsets[k]);
+		const float* src = profiles.ptr<float>(k);
+		int y_begin = std::max(0, -shift);
+		int y_end = std::min(rows, rows - shift);
+		for(int y=y_begin; y<y_end; y++){
+			profile[y] += src[y + shift];
+		}
+	}
+
+	double sharpness = 0;
+	for(int y=1; y<rows; y++){
+		double diff = profile[y] - profile[y - 1];
+		sharpness += diff * diff;
+	}
+	return sharpness;
+}
+
+
+double SkewEstimator::Sharpness(const cv::Mat& edge_img, double angle) const
+{
+	cv::Mat profiles;
+	std::vector<float> offsets, profile;
+	StripProfiles(edge_img, profiles, offsets);
+	return ShearedSharpness(profiles, offsets, angle, profile);
+}
+
+
+double SkewEstimator::Estimate(const cv::Mat& edge_img) const
+{
+	if(edge_img.rows < 2 || edge_img.cols < 2)
+		return 0;
+
+	cv::Mat profiles;
+	std::vector<float> offsets, profile;
+	StripProfiles(edge_img, profiles, offsets);
+
+	int evaluations = 1;
+	double best_angle = 0;
+	double best_sharpness = ShearedSharpness(profiles, offsets, 0, profile);
+
+	// coarse pass from the small skews outwards, so that running out of evaluations drops the large ones
+	double step = std::max(_params.coarse_step, 1e-3);
+	for(double a = step; a <= _params.max_angle + 1e-9 && evaluations + 2 <= _params.max_evaluations; a += step){
+		for(int sign=-1; sign<=1; sign+=2){
+			double sharpness = ShearedSharpness(profiles, offsets, sign * a, profile);
+			evaluations++;
+			if(sharpness > best_sharpness){
+				best_sharpness = sharpness;
+				best_angle = sign * a;
+			}
+		}
+	}
+
+	// halve the step around the best angle until the outermost strip moves by less than a pixel
+	double min_step = std::atan(1.0 / std::max(1.0f, std::abs(offsets.front()))) * 180.0 / CV_PI;
+	for(step /= 2; step >= min_step && evaluations + 2 <= _params.max_evaluations; step /= 2){
+		double center = best_angle;
+		for(int sign=-1; sign<=1; sign+=2){
+			double angle = center + sign * step;
+			if(std::abs(angle) > _params.max_angle)
+				continue;
+			double sharpness = ShearedSharpness(profiles, offsets, angle, profile);
+			evaluations++;
+			if(sharpness > best_sharpness){
+				best_sharpness = sharpness;
+				best_angle = angle;
+			}
+		}
+	}
+	return best_angle;
+}
+
+}
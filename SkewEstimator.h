@@ -0,0 +1,97 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __SKEW_ESTIMATOR__
+#define __SKEW_ESTIMATOR__
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+namespace ccnr{
+
+//! Search range of SkewEstimator
+struct DeskewParams
+{
+	double max_angle;	// skews in [-max_angle, max_angle] are searched [degree]
+	double min_angle;	// smaller skews are left alone [degree]
+	double coarse_step;	// step of the first pass over the range [degree]
+	int strip_width;	// columns shifted together for one angle [pixel]
+	int max_evaluations;	// bound of the profiles scored per image
+
+	DeskewParams() : max_angle(10), min_angle(0.5), coarse_step(1.0), strip_width(8), max_evaluations(40){};
+};
+
+
+//! Skew of the text lines of an edge image from the sharpness of its row profiles
+/*!
+The image is cut into vertical strips and the row profile of each strip is made
+once. The profile along lines of slope tan(angle) is then the sum of the strip
+profiles shifted by tan(angle) times the strip position (a shear), so scoring an
+angle costs strips x rows additions instead of a warp of the image.
+The sharpness is the sum of squared differences of neighbouring bins; it peaks
+when the digit rows and the card edges line up with the profile bins.
+Angles are searched from coarse_step down to the step that moves the outermost
+strip by one pixel, at most max_evaluations profiles.
+*/
+class SkewEstimator
+{
+public:
+	explicit SkewEstimator(const DeskewParams& params = DeskewParams()) : _params(params){};
+
+	//! Angle that makes the text lines horizontal [degree]
+	/*!
+	cv::getRotationMatrix2D(center, angle, 1.0) deskews the image.
+	\param[in] edge_img gradient magnitude (CV_32FC1)
+	*/
+	double Estimate(const cv::Mat& edge_img) const;
+
+	//! Sharpness of the row profile along lines of slope tan(angle)
+	double Sharpness(const cv::Mat& edge_img, double angle) const;
+
+	const DeskewParams& Params() const{
+		return _params;
+	}
+
+private:
+	DeskewParams _params;
+
+	//! Row profile of every strip (one row per strip) and the strip centers relative to the image center
+	void StripProfiles(const cv::Mat& edge_img, cv::Mat& profiles, std::vector<float>& offsets) const;
+
+	static double ShearedSharpness(const cv::Mat& profiles, const std::vector<float>& offsets, double angle,
+		std::vector<float>& profile);
+};
+
+}
+
+#endif
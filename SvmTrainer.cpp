@@ -0,0 +1,289 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "SvmTrainer.h"
+#include "ModelFile.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <random>
+#include <limits>
+#include <cmath>
+
+namespace ccnr{
+
+namespace{
+
+//! w.x + bias, x is a row of features
+inline double Dot(const double* w, const float* x, int dims)
+{
+	double sum = w[dims];
+	for(int d=0; d<dims; d++){
+		sum += w[d] * x[d];
+	}
+	return sum;
+}
+
+struct Problem
+{
+	int positive;
+	int negative;	// -1: one-vs-rest
+	std::vector<int> samples;
+	std::vector<signed char> y;
+};
+
+//! Solve problems in parallel, each into its own row of coeffs
+int SolveAll(const cv::Mat& features, const std::vector<Problem>& problems, const SvmTrainParams& params,
+	cv::Mat& coeffs, std::vector<SvmProblemStatistics>* stats)
+{
+	coeffs.create((int)problems.size(), features.cols + 1, CV_32FC1);
+	std::vector<SvmProblemStatistics> results(problems.size());
+
+	int threads = params.threads > 0 ? params.threads : std::max(1, (int)std::thread::hardware_concurrency());
+	threads = std::min(threads, (int)problems.size());
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> workers;
+	for(int t=0; t<threads; t++){
+		workers.push_back(std::thread([&](){
+			size_t p;
+			while((p = next++) < problems.size()){
+				results[p] = SvmTrainer::TrainBinary(features, problems[p].samples, problems[p].y, params,
+					params.seed + (unsigned int)p, coeffs.ptr<float>((int)p));
+				results[p].positive = problems[p].positive;
+				results[p].negative = problems[p].negative;
+			}
+		}));
+	}
+	for(size_t t=0; t<workers.size(); t++){
+		workers[t].join();
+	}
+	if(stats)
+		stats->swap(results);
+	return 0;
+}
+
+//! Row indices of each class in [0, num_class)
+int GroupByClass(const cv::Mat& features, const cv::Mat& labels, int num_class, std::vector<std::vector<int> >& classes)
+{
+	if(features.empty() || features.type() != CV_32FC1 || labels.type() != CV_32SC1
+		|| (int)labels.total() != features.rows || num_class < 2)
+		return -1;
+	classes.assign(num_class, std::vector<int>());
+	for(int r=0; r<features.rows; r++){
+		int label = labels.at<int>(r);
+		if(label >= 0 && label < num_class)
+			classes[label].push_back(r);
+	}
+	for(int c=0; c<num_class; c++){
+		if(classes[c].empty())
+			return -1;
+	}
+	return 0;
+}
+
+}
+
+
+SvmProblemStatistics SvmTrainer::TrainBinary(const cv::Mat& features, const std::vector<int>& samples,
+	const std::vector<signed char>& y, const SvmTrainParams& params, unsigned int seed, float* w_out)
+{
+	const double INF = std::numeric_limits<double>::infinity();
+	int dims = features.cols;
+	int l = (int)samples.size();
+
+	// L2-loss: no upper bound, 1/(2C) on the diagonal. L1-loss: bounded by C.
+	double diag = params.squared_hinge ? 0.5 / params.C : 0;
+	double upper = params.squared_hinge ? INF : params.C;
+
+	std::vector<double> w(dims + 1, 0.0);
+	std::vector<double> alpha(l, 0.0);
+	std::vector<double> qd(l);
+	std::vector<int> index(l);
+	for(int i=0; i<l; i++){
+		const float* x = features.ptr<float>(samples[i]);
+		double sq = 1.0;	// bias feature
+		for(int d=0; d<dims; d++){
+			sq += (double)x[d] * x[d];
+		}
+		qd[i] = sq + diag;
+		index[i] = i;
+	}
+
+	std::mt19937 rng(seed);
+	int active_size = l;
+	double pg_max_old = INF, pg_min_old = -INF;
+	SvmProblemStatistics st;
+	st.samples = l;
+	st.converged = false;
+	int iter = 0;
+	while(iter < params.max_iter){
+		double pg_max_new = -INF, pg_min_new = INF;
+		std::shuffle(index.begin(), index.begin() + active_size, rng);
+
+		for(int s=0; s<active_size; s++){
+			int i = index[s];
+			const float* x = features.ptr<float>(samples[i]);
+			double yi = y[i];
+			double g = yi * Dot(&w[0], x, dims) - 1.0 + alpha[i] * diag;
+
+			// shrink variables that are stuck at a bound
+			double pg = 0;
+			if(alpha[i] == 0){
+				if(g > pg_max_old){
+					std::swap(index[s--], index[--active_size]);
+					continue;
+				}
+				if(g < 0)
+					pg = g;
+			}
+			else if(alpha[i] == upper){
+				if(g < pg_min_old){
+					std::swap(index[s--], index[--active_size]);
+					continue;
+				}
+				if(g > 0)
+					pg = g;
+			}
+			else{
+				pg = g;
+			}
+			pg_max_new = std::max(pg_max_new, pg);
+			pg_min_new = std::min(pg_min_new, pg);
+
+			if(std::fabs(pg) > 1e-12){
+				double old = alpha[i];
+				alpha[i] = std::min(std::max(alpha[i] - g / qd[i], 0.0), upper);
+				double step = (alpha[i] - old) * yi;
+				for(int d=0; d<dims; d++){
+					w[d] += step * x[d];
+				}
+				w[dims] += step;
+			}
+		}
+		iter++;
+
+		if(pg_max_new - pg_min_new <= params.eps){
+			if(active_size == l){
+				st.converged = true;
+				break;
+			}
+			// check the shrunk variables once more before stopping
+			active_size = l;
+			pg_max_old = INF;
+			pg_min_old = -INF;
+			continue;
+		}
+		pg_max_old = (pg_max_new <= 0) ? INF : pg_max_new;
+		pg_min_old = (pg_min_new >= 0) ? -INF : pg_min_new;
+	}
+	st.iterations = iter;
+
+	st.train_errors = 0;
+	for(int i=0; i<l; i++){
+		if(y[i] * Dot(&w[0], features.ptr<float>(samples[i]), dims) <= 0)
+			st.train_errors++;
+	}
+	for(int d=0; d<=dims; d++){
+		w_out[d] = (float)w[d];
+	}
+	return st;
+}
+
+
+int SvmTrainer::TrainOneVsOne(const cv::Mat& features, const cv::Mat& labels, int num_class,
+	const SvmTrainParams& params, cv::Mat& coeffs, std::vector<SvmProblemStatistics>* stats)
+{
+	std::vector<std::vector<int> > classes;
+	if(GroupByClass(features, labels, num_class, classes) < 0)
+		return -1;
+
+	// same order as NumberRecog::predict
+	std::vector<Problem> problems;
+	for(int a=0; a<num_class; a++){
+		for(int b=a+1; b<num_class; b++){
+			Problem prob;
+			prob.positive = a;
+			prob.negative = b;
+			prob.samples = classes[a];
+			prob.samples.insert(prob.samples.end(), classes[b].begin(), classes[b].end());
+			prob.y.assign(classes[a].size(), 1);
+			prob.y.insert(prob.y.end(), classes[b].size(), -1);
+			problems.push_back(prob);
+		}
+	}
+	return SolveAll(features, problems, params, coeffs, stats);
+}
+
+
+int SvmTrainer::TrainOneVsRest(const cv::Mat& features, const cv::Mat& labels, int num_class,
+	const SvmTrainParams& params, cv::Mat& coeffs, std::vector<SvmProblemStatistics>* stats)
+{
+	std::vector<std::vector<int> > classes;
+	if(GroupByClass(features, labels, num_class, classes) < 0)
+		return -1;
+
+	std::vector<int> all;
+	std::vector<int> label_of;
+	for(int c=0; c<num_class; c++){
+		all.insert(all.end(), classes[c].begin(), classes[c].end());
+		label_of.insert(label_of.end(), classes[c].size(), c);
+	}
+	std::vector<Problem> problems(num_class);
+	for(int c=0; c<num_class; c++){
+		problems[c].positive = c;
+		problems[c].negative = -1;
+		problems[c].samples = all;
+		problems[c].y.resize(all.size());
+		for(size_t i=0; i<all.size(); i++){
+			problems[c].y[i] = (label_of[i] == c) ? 1 : -1;
+		}
+	}
+	return SolveAll(features, problems, params, coeffs, stats);
+}
+
+
+int SvmTrainer::Save(const std::string& file, const cv::Mat& coeffs)
+{
+	if(coeffs.empty())
+		return -1;
+	if(file.size() >= 4 && file.compare(file.size() - 4, 4, ".bin") == 0)
+		return ModelFile::Save(file, coeffs);
+
+	cv::FileStorage fs(file, cv::FileStorage::WRITE);
+	if(!fs.isOpened())
+		return -1;
+	fs << "svm_coeff" << coeffs;
+	return 0;
+}
+
+}
@@ -0,0 +1,113 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __SVM_TRAINER__
+#define __SVM_TRAINER__
+
+#include <vector>
+#include <string>
+#include <opencv2/core/core.hpp>
+
+namespace ccnr{
+
+//! Parameters of SvmTrainer
+struct SvmTrainParams
+{
+	double C;	// cost of a margin violation
+	bool squared_hinge;	// L2-loss (true) or L1-loss (hinge) SVM
+	double eps;	// stop when the projected gradient spread is below this
+	int max_iter;	// passes over the samples per problem
+	unsigned int seed;	// sample order of the solver
+	int threads;	// problems solved at once (0: all cores)
+
+	SvmTrainParams() : C(1.0), squared_hinge(true), eps(0.1), max_iter(1000), seed(1), threads(0){};
+};
+
+//! Result of one binary problem
+struct SvmProblemStatistics
+{
+	int positive;	// class of the +1 samples
+	int negative;	// class of the -1 samples (-1: all others)
+	int samples;
+	int iterations;
+	int train_errors;
+	bool converged;
+};
+
+
+//! Linear SVM trainer writing the coefficient layouts NumberRecog loads
+/*!
+Each binary problem is solved by dual coordinate descent with shrinking
+(Hsieh et al., ICML 2008, as in LIBLINEAR) with the bias as an extra feature
+of value 1. Independent problems run on separate threads; every problem
+shuffles with its own seed, so the result does not depend on the thread count.
+*/
+class SvmTrainer
+{
+public:
+	//! One-vs-one coefficients for NumberRecog::Load
+	/*!
+	Row k is the pair (a, b) in the order (0,1), (0,2), ... (num_class-2, num_class-1)
+	and is positive for a. Samples with labels outside [0, num_class) are ignored.
+	\param[in] features CV_32FC1, one sample per row
+	\param[in] labels CV_32SC1, one per row
+	\param[out] coeffs CV_32FC1, num_class*(num_class-1)/2 rows of feature dimensions + 1 (bias last)
+	\return 0 on success, -1 if the input does not fit or a class has no samples
+	*/
+	static int TrainOneVsOne(const cv::Mat& features, const cv::Mat& labels, int num_class,
+		const SvmTrainParams& params, cv::Mat& coeffs, std::vector<SvmProblemStatistics>* stats = 0);
+
+	//! One-vs-rest coefficients for NumberRecog::LoadOVR
+	/*!
+	Row c separates class c from all other samples, for c in [0, num_class).
+	The background class has to be the last one.
+	*/
+	static int TrainOneVsRest(const cv::Mat& features, const cv::Mat& labels, int num_class,
+		const SvmTrainParams& params, cv::Mat& coeffs, std::vector<SvmProblemStatistics>* stats = 0);
+
+	//! Solve one problem
+	/*!
+	\param[in] samples rows of features to use
+	\param[in] y +1 or -1 for each of samples
+	\param[out] w feature dimensions + 1 coefficients (bias last)
+	*/
+	static SvmProblemStatistics TrainBinary(const cv::Mat& features, const std::vector<int>& samples,
+		const std::vector<signed char>& y, const SvmTrainParams& params, unsigned int seed, float* w);
+
+	//! Save coefficients as "svm_coeff" in YAML/XML, or in the binary ModelFile format for *.bin
+	static int Save(const std::string& file, const cv::Mat& coeffs);
+};
+
+}
+
+#endif
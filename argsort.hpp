@@ -35,6 +35,7 @@
 #define __ARGSORT__
 
 #include <algorithm>
+#include <vector>
 
 template <typename T>
 struct ARG_SORTER
@@ -67,6 +68,80 @@ void argsort_vector(const std::vector<T>& vec, std::vector<int>& idx)
 	}
 }
 
+//! Indices of an array in ascending order of value, sorted only as far as they are read
+/*!
+A binary heap is built in O(n); idx(i) pops until the i-th smallest value is
+known, so reading the first k indices costs O(n + k log n). Popped indices are
+kept, and reading them again is O(1). Equal values are ordered by index.
+The array must outlive the sorter.
+*/
+template <typename T>
+class LazyArgsort
+{
+public:
+	LazyArgsort() : _vec(0), _size(0){};
+
+	LazyArgsort(const T* vec, int size){
+		reset(vec, size);
+	};
+
+	void reset(const T* vec, int size){
+		_vec = vec;
+		_size = size;
+		_heap.resize(size);
+		for(int i=0; i<size; i++){
+			_heap[i] = i;
+		}
+		std::make_heap(_heap.begin(), _heap.end(), Greater(vec));
+		_sorted.clear();
+		_sorted.reserve(size);
+	};
+
+	int size() const{
+		return _size;
+	};
+
+	//! Number of indices sorted so far
+	int sorted() const{
+		return _sorted.size();
+	};
+
+	const T* data() const{
+		return _vec;
+	};
+
+	//! Index of the i-th smallest value (0 <= i < size())
+	int idx(int i){
+		while((int)_sorted.size() <= i){
+			std::pop_heap(_heap.begin(), _heap.end(), Greater(_vec));
+			_sorted.push_back(_heap.back());
+			_heap.pop_back();
+		}
+		return _sorted[i];
+	};
+
+	//! i-th smallest value
+	T val(int i){
+		return _vec[idx(i)];
+	};
+
+private:
+	struct Greater
+	{
+		const T* vec;
+		explicit Greater(const T* v) : vec(v){};
+		bool operator()(int a, int b) const{
+			return vec[a] > vec[b] || (vec[a] == vec[b] && a > b);
+		}
+	};
+
+	const T* _vec;
+	int _size;
+	std::vector<int> _heap;
+	std::vector<int> _sorted;
+};
+
+
 template<typename T> 
 int max_arg(const std::vector<T>& vec, T& max_val)
 {
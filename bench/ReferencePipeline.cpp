@@ -0,0 +1,748 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "ReferencePipeline.h"
+#include <chrono>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "common.h"
+#include "ModelFile.h"
+
+namespace ccnr{
+namespace reference{
+
+namespace{
+
+const int CHAR_BLANK = 0, CHAR_LEFT = 1, CHAR_RIGHT = 2, CHAR_STRING_LEFT = 3, CHAR_STRING_RIGHT = 4;
+const int CHAR_EDGE_TYPE_NUM = 5;
+
+typedef std::chrono::steady_clock Clock;
+
+void AddTime(StageTimes* times, const char* stage, const Clock::time_point& start)
+{
+	if(times)
+		(*times)[stage] += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int CalcSizeEdge2Max(int org_size, int pool_size, float overlap)
+{
+	int step = pool_size * (1.0 - overlap);
+	return (org_size - pool_size) / step + 1;
+}
+
+///// Mser1D /////
+struct Region1D
+{
+	int pos;
+	int len;
+	double threshold;
+	std::vector<int> child_idx;
+};
+
+void CreateMserRegionTree(const std::vector<float>& histogram, std::vector<Region1D>& regions, int rgn_id, double step)
+{
+	int start, end;
+	double th;
+	if(regions.empty()){
+		start = 0;
+		end = histogram.size();
+		th = (double)(*std::min_element(histogram.begin(), histogram.end())) - 0.000001;
+	}
+	else{
+		start = regions[rgn_id].pos;
+		end = start + regions[rgn_id].len;
+		th = regions[rgn_id].threshold + step;
+	}
+	for(int i=start; i<end; i++){
+		if(histogram[i] >= th){
+			Region1D rgn;
+			rgn.pos = i;
+			int count = 0;
+			while(i<end && histogram[i] >= th){
+				count ++;
+				i++;
+			}
+			rgn.len = count;
+			rgn.threshold = th;
+			int new_rgn_id = regions.size();
+			if(new_rgn_id > 0){
+				regions[rgn_id].child_idx.push_back(new_rgn_id);
+			}
+			regions.push_back(rgn);
+
+			CreateMserRegionTree(histogram, regions, new_rgn_id, step);
+		}
+	}
+}
+
+///// Appearance costs /////
+void CreateCharLeftCost(const cv::Mat& derivmap, std::vector<double>& char_left_cost, int slide)
+{
+	cv::Mat tmp_map, edgecost;
+	cv::exp(-derivmap, tmp_map);
+	cv::log(tmp_map + 1, edgecost);
+
+	int num = edgecost.total();
+	double* ptr = (double*)edgecost.data;
+	for(int i=slide; i<num; i++){
+		char_left_cost.push_back(ptr[i]);
+	}
+	for(int i=0; i<slide; i++){
+		char_left_cost.push_back(1.0);
+	}
+}
+
+void CreateCharRightCost(const cv::Mat& derivmap, std::vector<double>& char_right_cost, int slide)
+{
+	cv::Mat tmp_map, edgecost;
+	cv::exp(derivmap, tmp_map);
+	cv::log(tmp_map + 1, edgecost);
+
+	int num = edgecost.total();
+	double* ptr = (double*)edgecost.data;
+	for(int i=0; i<slide; i++){
+		char_right_cost.push_back(1.0);
+	}
+	for(int i=0; i<num-slide; i++){
+		char_right_cost.push_back(ptr[i]);
+	}
+}
+
+void CreateCharStringLeftCost(const cv::Mat& block_deriv, const cv::Mat& integ, std::vector<double>& char_string_left_cost, int slide)
+{
+	double _epsilon = 0.00001;
+	double total = integ.at<double>(integ.rows-1, integ.cols-1) + _epsilon;
+	cv::Mat integ2 = (-integ(cv::Rect(1,1,integ.cols-1,integ.rows-1)) + total) / total;
+
+	std::vector<double> char_left_cost;
+	CreateCharLeftCost(block_deriv, char_left_cost, slide);
+	int full_size = char_left_cost.size();
+	for(int i=0; i<full_size; i++){
+		char_string_left_cost.push_back(char_left_cost[i] - std::log(integ2.at<double>(0,i)));
+	}
+}
+
+void CreateCharStringRightCost(const cv::Mat& block_deriv, const cv::Mat& integ, std::vector<double>& char_string_right_cost, int slide)
+{
+	double _epsilon = 0.00001;
+	double total = integ.at<double>(integ.rows-1, integ.cols-1) + _epsilon;
+	cv::Mat integ2 = (integ(cv::Rect(1,1,integ.cols-1,integ.rows-1)) + _epsilon)/ total;
+
+	std::vector<double> char_right_cost;
+	CreateCharRightCost(block_deriv, char_right_cost, slide);
+	int full_size = char_right_cost.size();
+	for(int i=0; i<full_size; i++){
+		char_string_right_cost.push_back(char_right_cost[i] - std::log(integ2.at<double>(0,i)));
+	}
+}
+
+void CreateCharBlankCost(const cv::Mat& derivmap, std::vector<double>& char_blank_cost)
+{
+	cv::Mat tmp_map, edgecost;
+	cv::exp(-derivmap, tmp_map);
+	cv::log(tmp_map + 1, edgecost);
+
+	int num = edgecost.total();
+	double* ptr = (double*)edgecost.data;
+	for(int i=0; i<num; i++){
+		char_blank_cost.push_back(ptr[i]);
+	}
+}
+
+void CreateDeriv(const cv::Mat& prj, cv::Mat& deriv1st, cv::Mat& deriv2nd)
+{
+	cv::Mat derivfilter(1,3,CV_64FC1);
+	derivfilter.at<double>(0,0) = -0.5;
+	derivfilter.at<double>(0,1) = 0;
+	derivfilter.at<double>(0,2) = 0.5;
+	cv::filter2D(prj, deriv1st, prj.depth(), derivfilter);
+	cv::filter2D(deriv1st, deriv2nd, prj.depth(), derivfilter);
+}
+
+void CreateBlockDeriv(const cv::Mat& prj, int block_size, cv::Mat& dst)
+{
+	block_size += (1-block_size%2);
+
+	cv::Mat tprj;
+	cv::boxFilter(prj, tprj, CV_64FC1, cv::Size(block_size, 1), cv::Point(-1,-1), true);
+	cv::Mat filter = cv::Mat::zeros(1, block_size+2, CV_64FC1); 
+	filter.at<double>(0,0) = -0.1;
+	filter.at<double>(0,block_size+1) = 0.1;
+	cv::filter2D(tprj, dst, CV_64FC1, filter);
+}
+
+///// Character range search /////
+void InitPositions(const std::vector<double>& app_costs, std::vector<double>& target_costs, std::vector<int>& positions)
+{
+	argsort_vector(app_costs, positions);
+	target_costs.clear();
+	for(size_t i=0; i<positions.size(); i++){
+		target_costs.push_back(app_costs[positions[i]]);
+	}
+}
+
+void MinScorePositions(const std::vector<double>& app_costs, const std::vector<double>& size_costs, 
+	int pos, double* min_cost, int* min_position)
+{
+	int bi = - (int)size_costs.size() + 1;
+	int bp = pos + bi;
+	int ep = pos + size_costs.size();
+	if(bp < 0){
+		bi -= bp;
+		bp = 0;
+	}
+	if(ep >= (int)app_costs.size())
+		ep = app_costs.size() - 1;
+
+	std::vector<double> costs;
+	for(int p = bp, i=bi; p<ep; p++, i++){
+		costs.push_back(app_costs[p] + size_costs[std::abs(i)]);
+	}
+
+	int idx = min_arg(costs, *min_cost);
+	*min_position = bp + idx;
+}
+
+void EvaluateNumberStrings(const std::vector<std::pair<int,int> >& line_pos, std::vector<double>& scores, const std::vector<float>& prj)
+{
+	float myu = 0.6 * prj.size();
+	float delta = 0.5 * prj.size();
+	for(size_t i=0; i<line_pos.size(); i++){
+		float center = (float)line_pos[i].second / 2 + line_pos[i].first;
+		float tmp = (center - myu) / delta;
+		float score = std::exp(- tmp*tmp/2) / (std::sqrt(2.0*CV_PI) * delta);
+		scores.push_back(score);
+	}
+}
+
+double DetectCharacterRange(const cv::Mat& edge_img, const cv::Rect& area, std::vector<int>& break_pos, int& pattern, double min_cost, StageTimes* times)
+{
+	const float char_aspect_ratio = 1.5, char_width_div = 0.2;
+
+	Clock::time_point start = Clock::now();
+	std::vector<std::vector<double> > app_costs;
+	CreateAppearanceCosts(edge_img(area).clone(), app_costs);
+	AddTime(times, "appearance_costs", start);
+
+	std::vector<double> reg_costs;
+	float char_size = (float)area.height / char_aspect_ratio;
+	int win_size = char_size / 2;
+	win_size += (win_size + 1) % 2;
+	CreateRegularizationCosts(reg_costs, win_size, char_width_div * char_size);
+
+	int min_idx = 0;
+	start = Clock::now();
+	for(int i=0; i<PATTERN_NUM; i++){
+		std::vector<int> char_pattern;
+		CreateCreditBreakPattern(char_pattern, i);
+		float avg_length = char_size * (char_pattern.size() - 1);
+		std::vector<int> char_break_pos;
+		double cost = ExtractCharRange(char_break_pos, app_costs, reg_costs, avg_length, char_width_div * avg_length, char_pattern, min_cost);
+		if(cost < min_cost && !char_break_pos.empty()){
+			min_cost = cost;
+			min_idx = i;
+			break_pos = char_break_pos;
+		}
+	}
+	AddTime(times, "char_range", start);
+	pattern = min_idx;
+	return min_cost;
+}
+
+}
+
+
+void ExtractEdgeDir(const cv::Mat& src_img, std::vector<cv::Mat>& dir_imgs, int dir_num)
+{
+	dir_imgs.resize(dir_num);
+	for(int i=0; i<dir_num; i++){
+		dir_imgs[i] = cv::Mat::zeros(src_img.size(), CV_64FC1);
+	}
+
+	cv::Mat gray;
+	if(src_img.channels() > 1)
+		cv::cvtColor(src_img, gray, cv::COLOR_RGB2GRAY);
+	else
+		gray = src_img;
+
+	cv::Mat X_sobelMat, Y_sobelMat;
+	cv::Sobel(gray, X_sobelMat, CV_64F, 1, 0);
+	cv::Sobel(gray, Y_sobelMat, CV_64F, 0, 1);
+
+	double* x_sobel_data = (double*)X_sobelMat.data;
+	double* y_sobel_data = (double*)Y_sobelMat.data;
+
+	double angle = CV_PI /(double)dir_num;
+	int step_size = src_img.cols;
+	for(int y=0; y<src_img.rows; y++){
+		for(int x=0; x<src_img.cols; x++){
+			double xDelta = *(x_sobel_data + y*step_size + x);
+			double yDelta = *(y_sobel_data + y*step_size + x);
+			double magnitude = sqrt(xDelta * xDelta + yDelta * yDelta);
+			double gradient = atan2((double)yDelta, (double)xDelta);
+			if(gradient < 0.0){
+				gradient += 2.0 * CV_PI;
+			}
+			if(gradient >= CV_PI){
+				gradient -= CV_PI;
+			}
+			int dir = round(gradient/angle) % dir_num;
+			dir_imgs[dir].at<double>(y,x) = magnitude;
+		}
+	}
+}
+
+
+void MaxPooling(const cv::Mat& img, cv::Mat& output, int pool_size, float overlap)
+{
+	cv::Size out_size(CalcSizeEdge2Max(img.cols, pool_size, overlap), CalcSizeEdge2Max(img.rows, pool_size, overlap));
+	int step = pool_size * (1.0 - overlap);
+
+	output = cv::Mat::zeros(out_size.height, out_size.width, CV_32FC1);
+	cv::Rect rect(0,0,pool_size,pool_size);
+	int x, y;
+	int max_rect_x = img.cols - step;
+	int max_rect_y = img.rows - step;
+	for(y=0, rect.y=0;y<output.rows && rect.y <= max_rect_y;y++, rect.y += step){
+		for(x=0, rect.x=0;x<output.cols && rect.x <= max_rect_x;x++, rect.x += step){
+			double min_val, max_val;
+			cv::minMaxLoc(img(rect), &min_val, &max_val);
+			output.at<float>(y,x) = (float)max_val;
+		}
+	}
+}
+
+
+void ExtractFeature(const cv::Mat& img, const cv::Size& train_size, cv::Mat& feature, StageTimes* times)
+{
+	const int dir_num = 4, pool_size = 4;
+	const float overlap = 0.5;
+
+	cv::Mat resize_img;
+	cv::resize(img, resize_img, train_size);
+
+	Clock::time_point start = Clock::now();
+	std::vector<cv::Mat> edge_dir;
+	ExtractEdgeDir(resize_img, edge_dir, dir_num);
+	AddTime(times, "edge_dir", start);
+
+	start = Clock::now();
+	cv::Rect trunc_rect(1,1, resize_img.cols-2, resize_img.rows-2);
+	std::vector<cv::Mat> pools;
+	for(size_t i=0; i<edge_dir.size(); i++){
+		cv::Mat out;
+		MaxPooling(edge_dir[i](trunc_rect).clone(), out, pool_size, overlap);
+		pools.push_back(out);
+	}
+	AddTime(times, "max_pooling", start);
+
+	int sum_size = 0;
+	for(size_t i=0; i<pools.size(); i++){
+		sum_size += pools[i].total();
+	}
+	feature.create(1, sum_size, CV_32FC1);
+	float* ptr = (float*)feature.data;
+	for(size_t i=0; i<pools.size(); i++){
+		memcpy(ptr, pools[i].data, pools[i].total() * sizeof(float));
+		ptr += pools[i].total();
+	}
+}
+
+
+void Mser1D(const std::vector<float>& histogram, std::vector<std::pair<int, int> >& msers,
+	double step, double delta, int min_area, int max_area)
+{
+	std::vector<Region1D> regions;
+	CreateMserRegionTree(histogram, regions, 0, step);
+
+	// cluster chains of regions with a single child
+	std::vector<std::vector<int> > clustered;
+	std::vector<bool> check(regions.size(), false);
+	for(size_t i=0; i<regions.size(); i++){
+		if(!check[i]){
+			std::vector<int> idx_chain;
+			idx_chain.push_back(i);
+			check[i] = true;
+			int j = i;
+			while(regions[j].child_idx.size() == 1){
+				j = regions[j].child_idx[0];
+				idx_chain.push_back(j);
+				check[j] = true;
+			}
+			clustered.push_back(idx_chain);
+		}
+	}
+
+	// area variation and its minimum in every chain
+	int i_delta = (int)(delta / step + 0.5);
+	if(max_area < 1)
+		max_area = histogram.size();
+	for(size_t c=0; c<clustered.size(); c++){
+		const std::vector<int>& chain = clustered[c];
+		if((int)chain.size() < 2*i_delta + 1 || regions[chain.front()].len < min_area || regions[chain.back()].len > max_area)
+			continue;
+		double min = 10000;
+		int min_id = -1;
+		int end = chain.size() - i_delta;
+		for(int i=i_delta; i<end; i++){
+			int cand_idx = chain[i];
+			double val = (double)(regions[cand_idx-i_delta].len - regions[cand_idx+i_delta].len) / regions[cand_idx].len;
+			if(val >= 0 && min > val){
+				min = val;
+				min_id = i;
+			}
+		}
+		if(min_id >= 0){
+			const Region1D& rgn = regions[chain[min_id]];
+			msers.push_back(std::pair<int,int>(rgn.pos, rgn.len));
+		}
+	}
+}
+
+
+void DetectStringHeight(const cv::Mat& edge_img, std::vector<cv::Rect>& candidates, int min_char_height, int max_char_height)
+{
+	cv::Mat prj;
+	Projection(edge_img, prj, true);
+
+	int filter_width = edge_img.cols / 80;
+	filter_width = (filter_width < 3) ? 3 : filter_width + (1 - filter_width % 2);
+
+	cv::Mat gprj;
+	cv::GaussianBlur(prj, gprj, cv::Size(1,filter_width), 0.0, 1.0);
+
+	std::vector<float> gprj_vec;
+	Mat2Vector(gprj, gprj_vec);
+
+	std::vector<std::pair<int,int> > msers;
+	Mser1D(gprj_vec, msers, 1.0, 2.0, min_char_height, max_char_height);
+	if(msers.empty())
+		return;
+
+	std::vector<double> scores;
+	EvaluateNumberStrings(msers, scores, gprj_vec);
+
+	std::vector<int> idx;
+	argsort_vector(scores, idx);
+
+	double max_score = scores[idx[idx.size()-1]];
+	for(int i=idx.size() -1; i>=0; i--){
+		if(scores[idx[i]] / max_score < 0.90)
+			break;
+		candidates.push_back(cv::Rect(0, msers[idx[i]].first, edge_img.cols, msers[idx[i]].second));
+	}
+}
+
+
+void CreateAppearanceCosts(const cv::Mat& edge_img, std::vector<std::vector<double> >& app_costs)
+{
+	cv::Mat prj, nprj, gprj;
+	Projection(edge_img, prj);
+
+	int filter_width = edge_img.cols / 80;
+	filter_width = (filter_width < 3) ? 3 : filter_width + (1 - filter_width % 2);
+	cv::normalize(prj, gprj, 100.0, 0.0, cv::NORM_MINMAX, CV_64FC1);
+	cv::GaussianBlur(gprj, nprj, cv::Size(filter_width,1), 1.0, 1.0);
+
+	cv::Mat integ;
+	cv::integral(gprj, integ);
+
+	cv::Mat derivmap, derivmap2nd;
+	CreateDeriv(nprj, derivmap, derivmap2nd);
+
+	cv::Mat blockderiv;
+	CreateBlockDeriv(gprj, edge_img.rows, blockderiv);
+
+	app_costs.clear();
+	app_costs.resize(CHAR_EDGE_TYPE_NUM);
+	CreateCharLeftCost(derivmap, app_costs[CHAR_LEFT], 1);
+	CreateCharRightCost(derivmap, app_costs[CHAR_RIGHT], 1);
+	CreateCharStringLeftCost(blockderiv, integ, app_costs[CHAR_STRING_LEFT], 1);
+	CreateCharStringRightCost(blockderiv, integ, app_costs[CHAR_STRING_RIGHT], 1);
+	CreateCharBlankCost(derivmap2nd, app_costs[CHAR_BLANK]);
+}
+
+
+void CreateRegularizationCosts(std::vector<double>& reg_costs, int window_size, double sigma)
+{
+	int half_size = window_size / 2 + window_size % 2;
+	for(int i=0; i<half_size; i++){
+		double diff = (double)i/sigma;
+		reg_costs.push_back((diff * diff) / 2.0);
+	}
+}
+
+
+void CreateCreditBreakPattern(std::vector<int>& pattern, int type)
+{
+	static const int groups[PATTERN_NUM][4] = { {4,4,4,4}, {4,6,5,0}, {4,6,4,0} };
+	pattern.clear();
+	pattern.push_back(CHAR_STRING_LEFT);
+	for(int g=0; g<4 && groups[type][g] > 0; g++){
+		if(g > 0){
+			pattern.push_back(CHAR_RIGHT);
+			pattern.push_back(CHAR_LEFT);
+		}
+		for(int i=0; i<groups[type][g]-1; i++){
+			pattern.push_back(CHAR_BLANK);
+		}
+	}
+	pattern.push_back(CHAR_STRING_RIGHT);
+}
+
+
+double ExtractCharRange(std::vector<int>& char_breaks, const std::vector<std::vector<double> >& app_costs,
+	const std::vector<double>& pos_costs, float avg_string_len, float string_len_div, const std::vector<int>& char_pattern, double init_cost)
+{
+	std::vector<double> start_costs, end_costs;
+	std::vector<int> start_pos, end_pos;
+
+	int ptn_size = char_pattern.size();
+	InitPositions(app_costs[char_pattern[0]], start_costs, start_pos);
+	InitPositions(app_costs[char_pattern[ptn_size-1]], end_costs, end_pos);
+
+	std::vector<int> cur_char_breaks(ptn_size);
+
+	int max_string_width = app_costs[0].size();
+	int min_string_width = max_string_width / 3;
+	double min_cost = init_cost;
+	for(size_t s=0; s<start_costs.size(); s++){
+		double cur_cost = start_costs[s];
+		cur_char_breaks[0] = start_pos[s];
+		if(cur_cost >= min_cost)
+			break;
+
+		for(size_t e=0; e<end_costs.size(); e++){
+			double cur_cost2 = cur_cost + end_costs[e];
+			cur_char_breaks[ptn_size-1] = end_pos[e];
+
+			int char_str_range = end_pos[e] - start_pos[s];
+			if(char_str_range < min_string_width)
+				continue;
+			float diff = ((avg_string_len - char_str_range) / string_len_div);
+			cur_cost2 += (diff * diff / 2.0);
+			if(cur_cost2 >= min_cost)
+				break;
+
+			float char_size = (float)char_str_range / (ptn_size - 1);
+			for(int p=1; p<ptn_size-1; p++){
+				double target_cost;
+				int position;
+				MinScorePositions(app_costs[char_pattern[p]], pos_costs, start_pos[s] + round(char_size * p), &target_cost, &position);
+				cur_cost2 += target_cost;
+				cur_char_breaks[p] = position;
+				if(cur_cost2 >= min_cost)
+					break;
+				if(p == ptn_size - 2){
+					min_cost = cur_cost2;
+					char_breaks = cur_char_breaks;
+				}
+			}
+		}
+	}
+	return min_cost;
+}
+
+
+void ConvertXtoRects(const std::vector<int>& breaks, std::vector<cv::Rect>& number_rects, const cv::Rect& region, int pattern)
+{
+	if(breaks.empty())
+		return;
+
+	static const int b[PATTERN_NUM][4] = { {0,5,10,15}, {0,5,12,-1}, {0,5,12,-1} };
+	static const int e[PATTERN_NUM][4] = { {4,9,14,19}, {4,11,17,-1}, {4,11,16,-1} };
+	for(int j=0; j<4 && b[pattern][j] >= 0; j++){
+		for(int i=b[pattern][j]; i<e[pattern][j]; i++){
+			number_rects.push_back(cv::Rect(breaks[i], region.y, breaks[i+1] - breaks[i], region.height));
+		}
+	}
+}
+
+
+int Predict(const cv::Mat& svm_coeffs, const cv::Mat& feature)
+{
+	if(feature.cols+1 != svm_coeffs.cols)
+		return -1;
+
+	cv::Mat hom_feat(1, feature.cols+1, CV_32FC1);
+	feature.convertTo(hom_feat(cv::Rect(0,0,feature.cols,1)), CV_32FC1);
+	hom_feat.at<float>(0, feature.cols) = 1.0;
+	cv::Mat scores = svm_coeffs * hom_feat.t();
+
+	int num_class = round(std::sqrt(2 * svm_coeffs.rows - 0.25) + 0.5);
+	std::vector<int> count(num_class, 0);
+	int a=0, b=1;
+	for(int r=0; r<scores.rows; r++){
+		if(scores.at<float>(r,0) > 0)
+			count[a]++;
+		else
+			count[b]++;
+		b++;
+		if(b >= num_class){
+			a++;
+			b = a+1;
+		}
+	}
+	int max_val;
+	return max_arg(count, max_val);
+}
+
+
+void ScoreMapOVR(const std::vector<cv::Mat>& feature_map, const cv::Mat& svm_coeffs, const cv::Size& filter_size,
+	std::vector<cv::Mat>& response_map)
+{
+	response_map.clear();
+	int area = filter_size.area();
+	for(int c=0; c<svm_coeffs.rows; c++){
+		cv::Mat response;
+		for(size_t d=0; d<feature_map.size(); d++){
+			cv::Mat filter(filter_size, CV_32FC1);
+			memcpy(filter.data, svm_coeffs.ptr<float>(c) + d * area, area * sizeof(float));
+			cv::Mat dst;
+			cv::filter2D(feature_map[d], dst, feature_map[d].type(), filter);
+			if(d == 0)
+				response = dst;
+			else
+				response += dst;
+		}
+		response += svm_coeffs.at<float>(c, svm_coeffs.cols - 1);
+		response_map.push_back(response);
+	}
+}
+
+
+void Score2CostOVR(const std::vector<cv::Mat>& response_map, cv::Mat& pos_cost_map, cv::Mat& neg_cost_map)
+{
+	int class_num = response_map.size();
+	std::vector<cv::Mat> exp_mats;
+	for(int i=0; i<class_num; i++){
+		cv::Mat expMat;
+		cv::exp(response_map[i], expMat);
+		exp_mats.push_back(expMat);
+	}
+
+	cv::Mat sum_mat, neg_prob, pos_prob;
+	exp_mats[0].copyTo(sum_mat);
+	for(int i=1; i<class_num; i++){
+		sum_mat += exp_mats[i];
+	}
+
+	cv::divide(exp_mats[class_num-1], sum_mat, neg_prob);
+	neg_prob.convertTo(pos_prob, -1, -1.0, 1.0);
+
+	cv::Mat neglog, poslog;
+	cv::log(neg_prob,neglog);
+	cv::log(pos_prob,poslog);
+	poslog.convertTo(pos_cost_map, -1, -1.0);
+	neglog.convertTo(neg_cost_map, -1, -1.0);
+}
+
+
+bool LoadModel(const std::string& model_file, cv::Mat& svm_coeffs)
+{
+	cv::Mat coeffs;
+	if(ccnr::ModelFile::Read(model_file, coeffs) < 0)
+		return false;
+	coeffs.convertTo(svm_coeffs, CV_32FC1);
+	return true;
+}
+
+
+void Recognize(const cv::Mat& card_img, const cv::Mat& svm_coeffs, std::vector<int>& numbers, std::vector<cv::Rect>& num_pos, 
+	StageTimes* times)
+{
+	const int input_width = 320;
+	const cv::Size train_size(16,24);
+	const float min_char_height_ratio = 0.05, max_char_height_ratio = 0.1;
+
+	Clock::time_point total_start = Clock::now();
+	cv::Mat img;
+	if(card_img.channels() > 1)
+		cv::cvtColor(card_img, img, cv::COLOR_RGB2GRAY);
+	else
+		img = card_img;
+
+	cv::Mat proc_img;
+	cv::resize(img, proc_img, cv::Size(input_width, round((float)img.rows * input_width / img.cols)));
+
+	cv::Mat RowGrad, ColGrad, SumGrad;
+	cv::Sobel(proc_img, RowGrad, CV_32F, 1, 0);
+	cv::Sobel(proc_img, ColGrad, CV_32F, 0, 1);
+	cv::add(cv::abs(RowGrad), cv::abs(ColGrad), SumGrad);
+
+	// number string candidates
+	Clock::time_point start = Clock::now();
+	std::vector<cv::Rect> candidates;
+	DetectStringHeight(SumGrad, candidates, round(min_char_height_ratio * SumGrad.cols), round(max_char_height_ratio * SumGrad.cols));
+	AddTime(times, "string_height", start);
+
+	// character boxes
+	std::vector<int> min_break_pos;
+	double min_cost = 10000;
+	int min_i = -1, pattern = 0;
+	for(size_t i=0; i<candidates.size(); i++){
+		int cur_pattern;
+		std::vector<int> break_pos;
+		double cost = DetectCharacterRange(SumGrad, candidates[i], break_pos, cur_pattern, min_cost, times);
+		if(cost < min_cost){
+			min_cost = cost;
+			min_break_pos = break_pos;
+			pattern = cur_pattern;
+			min_i = i;
+		}
+	}
+	std::vector<cv::Rect> char_regions;
+	if(min_i >= 0){
+		ConvertXtoRects(min_break_pos, char_regions, candidates[min_i], pattern);
+	}
+
+	float ratio = (float)img.cols / input_width;
+	for(size_t i=0; i<char_regions.size(); i++){
+		const cv::Rect& r = char_regions[i];
+		if(r.width > 0 && r.height > 0){
+			cv::Rect rect((int)(ratio * r.x), (int)(ratio * r.y), round(ratio * r.width), round(ratio * r.height));
+			num_pos.push_back(TruncateRect(rect, img.size()));
+		}
+	}
+
+	for(size_t i=0; i<num_pos.size(); i++){
+		cv::Mat feature;
+		ExtractFeature(img(num_pos[i]).clone(), train_size, feature, times);
+		start = Clock::now();
+		numbers.push_back(Predict(svm_coeffs, feature));
+		AddTime(times, "predict", start);
+	}
+	AddTime(times, "total", total_start);
+}
+
+}
+}
@@ -0,0 +1,104 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __REFERENCE_PIPELINE__
+#define __REFERENCE_PIPELINE__
+
+#include <map>
+#include <string>
+#include <opencv2/core/core.hpp>
+
+namespace ccnr{
+
+//! Frozen copy of the original recognition pipeline
+/*!
+These functions are the golden reference for optimized code paths and must
+not be changed together with the library. Only the model is shared.
+*/
+namespace reference{
+
+//! Accumulated time of each stage [ms]
+typedef std::map<std::string, double> StageTimes;
+
+//! Pattern types in the order of the original implementation (4-4-4-4, 4-6-5, 4-6-4)
+const int PATTERN_NUM = 3;
+
+void ExtractEdgeDir(const cv::Mat& src_img, std::vector<cv::Mat>& dir_imgs, int dir_num);
+
+void MaxPooling(const cv::Mat& img, cv::Mat& output, int pool_size, float overlap);
+
+//! Resize to train_size, edge directions, truncation, max pooling and concatenation
+void ExtractFeature(const cv::Mat& img, const cv::Size& train_size, cv::Mat& feature, StageTimes* times = 0);
+
+void Mser1D(const std::vector<float>& histogram, std::vector<std::pair<int, int> >& msers,
+	double step, double delta, int min_area, int max_area);
+
+void DetectStringHeight(const cv::Mat& edge_img, std::vector<cv::Rect>& candidates, int min_char_height, int max_char_height);
+
+void CreateAppearanceCosts(const cv::Mat& edge_img, std::vector<std::vector<double> >& app_costs);
+
+void CreateRegularizationCosts(std::vector<double>& reg_costs, int window_size, double sigma);
+
+void CreateCreditBreakPattern(std::vector<int>& pattern, int type);
+
+double ExtractCharRange(std::vector<int>& char_breaks, const std::vector<std::vector<double> >& app_costs,
+	const std::vector<double>& pos_costs, float avg_string_len, float string_len_div,
+	const std::vector<int>& char_pattern, double init_cost = 10000);
+
+void ConvertXtoRects(const std::vector<int>& breaks, std::vector<cv::Rect>& number_rects, const cv::Rect& region, int pattern);
+
+//! One-vs-one voting with coefficients as stored in svm_coeff (CV_32FC1)
+int Predict(const cv::Mat& svm_coeffs, const cv::Mat& feature);
+
+//! One-vs-rest responses with one cv::filter2D per class and direction
+/*!
+\param[in] svm_coeffs one row per class, the bias last (CV_32FC1)
+*/
+void ScoreMapOVR(const std::vector<cv::Mat>& feature_map, const cv::Mat& svm_coeffs, const cv::Size& filter_size,
+	std::vector<cv::Mat>& response_map);
+
+//! Digit and background costs of one-vs-rest responses (exp, sum, divide, log)
+void Score2CostOVR(const std::vector<cv::Mat>& response_map, cv::Mat& pos_cost_map, cv::Mat& neg_cost_map);
+
+//! Load svm_coeff from any model ModelFile::Read accepts (CV_32FC1)
+bool LoadModel(const std::string& model_file, cv::Mat& svm_coeffs);
+
+//! Whole pipeline as in the original RecognizeCreditCardNumber
+void Recognize(const cv::Mat& card_img, const cv::Mat& svm_coeffs, std::vector<int>& numbers, std::vector<cv::Rect>& num_pos, 
+	StageTimes* times = 0);
+
+}
+
+}
+
+#endif
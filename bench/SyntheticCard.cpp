@@ -0,0 +1,263 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "SyntheticCard.h"
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace ccnr{
+
+SyntheticCardGenerator::SyntheticCardGenerator(unsigned long long seed) : _rng(seed)
+{
+	_min_width = 480;
+	_max_width = 1280;
+	_max_blur = 1.5;
+	_max_noise = 12.0;
+	_max_skew = 0;
+	_upside_down_ratio = 0;
+	_pattern_num = 3;
+}
+
+
+std::vector<int> SyntheticCardGenerator::DigitGroups(NumberDetect::CREDIT_PATTERN pattern)
+{
+	return CreditLayout::Builtin(pattern).Groups();
+}
+
+
+SyntheticCardParams SyntheticCardGenerator::RandomParams()
+{
+	SyntheticCardParams params;
+	params.width = _rng.uniform(_min_width, _max_width + 1);
+	params.char_height_ratio = _rng.uniform(0.058, 0.066);
+	// blur and noise are given for a 640 pixel card and scaled with the width
+	params.blur_sigma = _rng.uniform(0.0, _max_blur) * params.width / 640;
+	params.noise_sigma = _rng.uniform(0.0, _max_noise);
+	params.background = _rng.uniform(0, 4);
+	params.dark_digits = (_rng.uniform(0.0, 1.0) < 0.3);
+	params.pattern = (NumberDetect::CREDIT_PATTERN)_rng.uniform(0, _pattern_num);
+	// drawn last and only when enabled, so that the cards of a seed stay the same without skew
+	params.skew = (_max_skew > 0) ? _rng.uniform(-_max_skew, _max_skew) : 0.0;
+	params.upside_down = (_upside_down_ratio > 0) && (_rng.uniform(0.0, 1.0) < _upside_down_ratio);
+	return params;
+}
+
+
+void SyntheticCardGenerator::Generate(SyntheticCard& card)
+{
+	Generate(RandomParams(), card);
+}
+
+
+void SyntheticCardGenerator::Generate(const SyntheticCardParams& params, SyntheticCard& card)
+{
+	card.params = params;
+	card.digits.clear();
+	card.digit_boxes.clear();
+
+	int width = params.width;
+	int height = cvRound(width / 1.586);	// ISO/IEC 7810 ID-1
+	card.image.create(height, width, CV_8UC3);
+	DrawBackground(card.image, params.background);
+
+	// light card with dark digits or the other way around
+	double base = params.dark_digits ? _rng.uniform(150.0, 230.0) : _rng.uniform(30.0, 110.0);
+	cv::Mat tint(card.image.size(), card.image.type(), cv::Scalar(base, base, base));
+	cv::addWeighted(card.image, 0.35, tint, 0.65, 0.0, card.image);
+
+	// EMV chip above the number line
+	if(params.background > 0){
+		cv::Rect chip(cvRound(0.1 * width), cvRound(0.28 * height), cvRound(0.12 * width), cvRound(0.09 * width));
+		cv::rectangle(card.image, chip, cv::Scalar(60, 170, 200), -1);
+		cv::rectangle(card.image, chip, cv::Scalar(40, 110, 140), 2);
+	}
+
+	// digit layout: every digit and every gap between groups occupies one pitch
+	std::vector<int> groups = DigitGroups(params.pattern);
+	int intervals = (int)groups.size() - 1;
+	for(size_t g=0; g<groups.size(); g++){
+		intervals += groups[g];
+	}
+	double char_height = params.char_height_ratio * width;
+	double pitch = char_height / 1.5;
+	double string_len = pitch * intervals;
+	if(string_len > 0.9 * width){
+		// long layouts such as 4-4-4-4-3 are printed smaller
+		pitch *= 0.9 * width / string_len;
+		char_height = pitch * 1.5;
+		string_len = pitch * intervals;
+	}
+	double x0 = (width - string_len) / 2 + _rng.uniform(-0.02, 0.02) * width;
+	if(x0 < 0.03 * width)
+		x0 = 0.03 * width;
+	double y0 = 0.58 * height - char_height / 2 + _rng.uniform(-0.03, 0.03) * height;
+
+	double level = params.dark_digits ? _rng.uniform(20.0, 70.0) : _rng.uniform(180.0, 240.0);
+	cv::Scalar color(level, level, level);
+	int idx = 0;
+	for(size_t g=0; g<groups.size(); g++){
+		for(int i=0; i<groups[g]; i++, idx++){
+			int digit = _rng.uniform(0, 10);
+			cv::Rect cell(cvRound(x0 + idx * pitch), cvRound(y0), cvRound(pitch), cvRound(char_height));
+			DrawDigit(card.image, digit, cell, color);
+			card.digits.push_back(digit);
+			card.digit_boxes.push_back(cell);
+		}
+		idx++;
+	}
+
+	if(params.skew != 0){
+		cv::Point2f center((width - 1) * 0.5f, (height - 1) * 0.5f);
+		cv::Mat rotation = cv::getRotationMatrix2D(center, params.skew, 1.0);
+		cv::Mat rotated;
+		cv::warpAffine(card.image, rotated, rotation, card.image.size(), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+		card.image = rotated;
+		for(size_t i=0; i<card.digit_boxes.size(); i++){
+			const cv::Rect& cell = card.digit_boxes[i];
+			std::vector<cv::Point2f> corners(4), rotated;
+			corners[0] = cv::Point2f((float)cell.x, (float)cell.y);
+			corners[1] = cv::Point2f((float)cell.br().x, (float)cell.y);
+			corners[2] = cv::Point2f((float)cell.br().x, (float)cell.br().y);
+			corners[3] = cv::Point2f((float)cell.x, (float)cell.br().y);
+			cv::transform(corners, rotated, rotation);
+			card.digit_boxes[i] = cv::boundingRect(rotated) & cv::Rect(0, 0, width, height);
+		}
+	}
+
+	if(params.upside_down){
+		cv::flip(card.image, card.image, -1);
+		for(size_t i=0; i<card.digit_boxes.size(); i++){
+			cv::Rect& box = card.digit_boxes[i];
+			box = cv::Rect(width - box.x - box.width, height - box.y - box.height, box.width, box.height);
+		}
+	}
+
+	if(params.blur_sigma > 0.1){
+		cv::GaussianBlur(card.image, card.image, cv::Size(0,0), params.blur_sigma);
+	}
+	if(params.noise_sigma > 0){
+		cv::Mat fimg, noise(card.image.size(), CV_32FC3);
+		card.image.convertTo(fimg, CV_32FC3);
+		_rng.fill(noise, cv::RNG::NORMAL, 0.0, params.noise_sigma);
+		fimg += noise;
+		fimg.convertTo(card.image, CV_8UC3);
+	}
+}
+
+
+void SyntheticCardGenerator::DrawBackground(cv::Mat& card, int style)
+{
+	cv::Scalar c1(_rng.uniform(0,256), _rng.uniform(0,256), _rng.uniform(0,256));
+	cv::Scalar c2(_rng.uniform(0,256), _rng.uniform(0,256), _rng.uniform(0,256));
+	if(style == 0){
+		card.setTo(c1);
+	}
+	else if(style == 1){
+		// diagonal gradient
+		for(int y=0; y<card.rows; y++){
+			cv::Vec3b* ptr = card.ptr<cv::Vec3b>(y);
+			for(int x=0; x<card.cols; x++){
+				double t = 0.5 * ((double)x / card.cols + (double)y / card.rows);
+				for(int c=0; c<3; c++){
+					ptr[x][c] = cv::saturate_cast<uchar>(c1[c] * (1.0 - t) + c2[c] * t);
+				}
+			}
+		}
+	}
+	else if(style == 2){
+		// smooth random texture
+		cv::Mat seed(5, 8, CV_8UC3);
+		_rng.fill(seed, cv::RNG::UNIFORM, 0, 256);
+		cv::resize(seed, card, card.size(), 0, 0, cv::INTER_CUBIC);
+	}
+	else{
+		// guilloche-like waves
+		double fx = _rng.uniform(0.01, 0.05), fy = _rng.uniform(0.01, 0.05);
+		double phase = _rng.uniform(0.0, CV_PI);
+		for(int y=0; y<card.rows; y++){
+			cv::Vec3b* ptr = card.ptr<cv::Vec3b>(y);
+			for(int x=0; x<card.cols; x++){
+				double t = 0.5 + 0.5 * std::sin(fx * x + fy * y + phase + 3.0 * std::sin(0.01 * x));
+				for(int c=0; c<3; c++){
+					ptr[x][c] = cv::saturate_cast<uchar>(c1[c] * (1.0 - t) + c2[c] * t);
+				}
+			}
+		}
+	}
+}
+
+
+void SyntheticCardGenerator::DrawDigit(cv::Mat& card, int digit, const cv::Rect& cell, const cv::Scalar& color)
+{
+	// render the glyph large and squeeze it into the narrow digit cell
+	std::string text(1, (char)('0' + digit));
+	int baseline = 0;
+	double scale = 2.0;
+	int thickness = _rng.uniform(3, 6);
+	cv::Size text_size = cv::getTextSize(text, cv::FONT_HERSHEY_SIMPLEX, scale, thickness, &baseline);
+	int pad = thickness;
+	cv::Mat glyph = cv::Mat::zeros(text_size.height + 2 * pad, text_size.width + 2 * pad, CV_8UC1);
+	cv::putText(glyph, text, cv::Point(pad, pad + text_size.height), cv::FONT_HERSHEY_SIMPLEX, scale, cv::Scalar(255), thickness, cv::LINE_AA);
+
+	cv::Rect glyph_rect(cell.x + cvRound(0.14 * cell.width), cell.y, cvRound(0.72 * cell.width), cell.height);
+	glyph_rect &= cv::Rect(0, 0, card.cols, card.rows);
+	if(glyph_rect.width <= 0 || glyph_rect.height <= 0)
+		return;
+
+	cv::Mat alpha;
+	cv::resize(glyph, alpha, glyph_rect.size(), 0, 0, cv::INTER_AREA);
+
+	// embossed digits: a shadow one pixel down-right, then the face
+	for(int pass=0; pass<2; pass++){
+		int offset = (pass == 0) ? 1 : 0;
+		double shade = (pass == 0) ? 0.5 : 1.0;
+		for(int y=0; y<alpha.rows; y++){
+			int cy = glyph_rect.y + y + offset;
+			if(cy >= card.rows)
+				break;
+			cv::Vec3b* ptr = card.ptr<cv::Vec3b>(cy);
+			const uchar* aptr = alpha.ptr<uchar>(y);
+			for(int x=0; x<alpha.cols; x++){
+				int cx = glyph_rect.x + x + offset;
+				if(cx >= card.cols)
+					break;
+				double a = aptr[x] / 255.0;
+				for(int c=0; c<3; c++){
+					double target = color[c] * shade;
+					ptr[cx][c] = cv::saturate_cast<uchar>(ptr[cx][c] * (1.0 - a) + target * a);
+				}
+			}
+		}
+	}
+}
+
+}
@@ -0,0 +1,134 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __SYNTHETIC_CARD__
+#define __SYNTHETIC_CARD__
+
+#include <algorithm>
+#include <opencv2/core/core.hpp>
+#include "NumberDetect.h"
+
+namespace ccnr{
+
+//! Rendering parameters of one synthetic card
+struct SyntheticCardParams
+{
+	int width;	// card width [pixel]
+	double char_height_ratio;	// digit height / card width
+	double blur_sigma;	// gaussian blur (0: none)
+	double noise_sigma;	// additive gaussian noise
+	int background;	// background style (0: flat, 1: gradient, 2: texture, 3: waves)
+	bool dark_digits;	// dark digits on a light card
+	NumberDetect::CREDIT_PATTERN pattern;
+	double skew;	// rotation of the card [degree], the digit boxes are the bounding boxes of the rotated cells
+	bool upside_down;	// rotated by 180 degrees; digits and digit boxes stay in reading order
+};
+
+
+//! Synthetic card image with its ground truth
+struct SyntheticCard
+{
+	cv::Mat image;	// BGR
+	std::vector<int> digits;
+	std::vector<cv::Rect> digit_boxes;
+	SyntheticCardParams params;
+};
+
+
+//! Render credit card images with known digit strings
+/*!
+The generator is deterministic for a given seed, so benchmark numbers can be
+reproduced on any machine without real card data.
+*/
+class SyntheticCardGenerator
+{
+public:
+	explicit SyntheticCardGenerator(unsigned long long seed = 0x5eed);
+
+	//! Draw random parameters and render a card
+	void Generate(SyntheticCard& card);
+
+	//! Render a card with the given parameters (digits are random)
+	void Generate(const SyntheticCardParams& params, SyntheticCard& card);
+
+	//! Random parameters within the configured ranges
+	SyntheticCardParams RandomParams();
+
+	void SetWidthRange(int min_width, int max_width){
+		_min_width = min_width;
+		_max_width = max_width;
+	}
+
+	void SetMaxBlur(double sigma){
+		_max_blur = sigma;
+	}
+
+	void SetMaxNoise(double sigma){
+		_max_noise = sigma;
+	}
+
+	//! Rotate cards by up to degree either way (0 by default; no random numbers are drawn then)
+	void SetMaxSkew(double degree){
+		_max_skew = degree;
+	}
+
+	//! Turn this fraction of the cards upside down (0 by default; no random numbers are drawn then)
+	void SetUpsideDownRatio(double ratio){
+		_upside_down_ratio = ratio;
+	}
+
+	//! Draw the first num built-in layouts (TYPE4444, TYPE465, TYPE464 by default)
+	void SetPatternNum(int num){
+		_pattern_num = std::max(1, std::min(num, CreditLayout::BUILTIN_NUM));
+	}
+
+	//! Digit group sizes of a credit pattern, e.g. {4,4,4,4}
+	static std::vector<int> DigitGroups(NumberDetect::CREDIT_PATTERN pattern);
+
+private:
+	cv::RNG _rng;
+	int _min_width;
+	int _max_width;
+	double _max_blur;
+	double _max_noise;
+	double _max_skew;
+	double _upside_down_ratio;
+	int _pattern_num;
+
+	void DrawBackground(cv::Mat& card, int style);
+	void DrawDigit(cv::Mat& card, int digit, const cv::Rect& cell, const cv::Scalar& color);
+};
+
+}
+
+#endif
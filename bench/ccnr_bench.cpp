@@ -0,0 +1,301 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+// End-to-end benchmark of the recognition pipeline on synthetic cards
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <boost/program_options.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include "CreditNumberRecog.h"
+#include "ModelFile.h"
+#include "SyntheticCard.h"
+
+using namespace boost::program_options;
+
+namespace{
+
+struct BenchResult
+{
+	std::vector<int> numbers;
+	std::vector<cv::Rect> num_pos;
+	double latency_ms;
+	bool truncated;
+};
+
+
+std::string DigitString(const std::vector<int>& digits, const std::vector<int>& groups)
+{
+	std::string str;
+	size_t idx = 0;
+	for(size_t g=0; g<groups.size(); g++){
+		if(g > 0)
+			str += "-";
+		for(int i=0; i<groups[g] && idx<digits.size(); i++, idx++){
+			str += (char)('0' + digits[idx]);
+		}
+	}
+	return str;
+}
+
+
+double Percentile(const std::vector<double>& sorted, double ratio)
+{
+	if(sorted.empty())
+		return 0;
+	size_t idx = (size_t)(ratio * (sorted.size() - 1) + 0.5);
+	return sorted[idx];
+}
+
+
+bool SaveCards(const std::vector<ccnr::SyntheticCard>& cards, const std::string& dir)
+{
+	boost::filesystem::create_directories(dir);
+	std::ofstream gt((boost::filesystem::path(dir) / "ground_truth.txt").string().c_str());
+	std::ofstream box((boost::filesystem::path(dir) / "digit_boxes.txt").string().c_str());
+	if(!gt.is_open() || !box.is_open())
+		return false;
+	for(size_t i=0; i<cards.size(); i++){
+		std::ostringstream name;
+		name << "card_" << std::setw(5) << std::setfill('0') << i << ".png";
+		if(!cv::imwrite((boost::filesystem::path(dir) / name.str()).string(), cards[i].image))
+			return false;
+		gt << name.str() << " " 
+			<< DigitString(cards[i].digits, ccnr::SyntheticCardGenerator::DigitGroups(cards[i].params.pattern)) << std::endl;
+		// input of --mine-negatives
+		box << name.str();
+		for(size_t j=0; j<cards[i].digit_boxes.size(); j++){
+			const cv::Rect& r = cards[i].digit_boxes[j];
+			box << " " << r.x << " " << r.y << " " << r.width << " " << r.height;
+		}
+		box << std::endl;
+	}
+	return true;
+}
+
+}
+
+
+int main(int argc, char* argv[])
+{
+	options_description opt("option");
+	opt.add_options()
+		("help,h", "print help")
+		("model,m", value<std::string>()->default_value(ccnr::ModelFile::DefaultModel()), "Trained model file path (\"builtin\": compiled-in model)")
+		("count,n", value<int>()->default_value(300), "Number of synthetic cards")
+		("seed,s", value<unsigned long long>()->default_value(0x5eed), "Random seed of the generator")
+		("threads,t", value<int>()->default_value(1), "Number of recognition threads")
+		("min-width", value<int>()->default_value(480), "Minimum card width [pixel]")
+		("max-width", value<int>()->default_value(1280), "Maximum card width [pixel]")
+		("max-blur", value<double>()->default_value(1.5), "Maximum gaussian blur sigma (640 pixel card)")
+		("max-noise", value<double>()->default_value(12.0), "Maximum gaussian noise sigma")
+		("max-skew", value<double>()->default_value(0), "Maximum rotation of the cards [degree]")
+		("deskew", "Measure and undo the skew of every card (RecogOptions::deskew)")
+		("upside-down", value<double>()->default_value(0), "Fraction of the cards rotated by 180 degrees")
+		("orientations", value<std::string>()->default_value("upright"), "Card orientations searched (RecogOptions::orientations), e.g. upright,upside_down")
+		("no-pool", "Allocate temporaries with OpenCV's default allocator")
+		("all-layouts", "Render and search all built-in layouts (adds 4-4-4-4-3 and 4-4-5)")
+		("time-limit", value<double>()->default_value(0), "Deadline of the character search per card [ms] (0: none)")
+		("max-steps", value<long long>()->default_value(0), "Work limit of the character search per card (0: none)")
+		("save", value<std::string>(), "Save generated cards, ground_truth.txt and digit_boxes.txt to this directory");
+
+	variables_map argmap;
+	try{
+		store(parse_command_line(argc, argv, opt), argmap);
+		notify(argmap);
+	}
+	catch(const std::exception& e){
+		std::cerr << e.what() << std::endl << opt << std::endl;
+		return -1;
+	}
+	if(argmap.count("help")){
+		std::cout << "ccnr_bench [option]" << std::endl << opt << std::endl;
+		return 0;
+	}
+
+	int count = argmap["count"].as<int>();
+	int threads = std::max(1, argmap["threads"].as<int>());
+
+	ccnr::CreditNumberRecog ccnr;
+	std::string model_file = argmap["model"].as<std::string>();
+	if(ccnr.LoadClassifier(model_file) < 0){
+		std::cerr << "Fail to load " << model_file << std::endl;
+		return -1;
+	}
+	if(argmap.count("no-pool"))
+		ccnr.EnableMatPool(false);
+	if(argmap.count("all-layouts")){
+		std::vector<ccnr::CreditLayout> layouts;
+		for(int p=0; p<ccnr::CreditLayout::BUILTIN_NUM; p++){
+			layouts.push_back(ccnr::CreditLayout::Builtin(p));
+		}
+		ccnr.SetLayouts(layouts);
+	}
+	ccnr::RecogOptions recog_opt;
+	recog_opt.time_limit_ms = argmap["time-limit"].as<double>();
+	recog_opt.max_search_work = argmap["max-steps"].as<long long>();
+	recog_opt.deskew = (argmap.count("deskew") > 0);
+	recog_opt.orientations = ccnr::CreditNumberRecog::ParseOrientations(argmap["orientations"].as<std::string>());
+	if(recog_opt.orientations < 0){
+		std::cerr << "Unknown orientations " << argmap["orientations"].as<std::string>() << std::endl;
+		return -1;
+	}
+
+	// Generate the corpus up front so that rendering is not measured
+	ccnr::SyntheticCardGenerator generator(argmap["seed"].as<unsigned long long>());
+	generator.SetWidthRange(argmap["min-width"].as<int>(), argmap["max-width"].as<int>());
+	generator.SetMaxBlur(argmap["max-blur"].as<double>());
+	generator.SetMaxNoise(argmap["max-noise"].as<double>());
+	generator.SetMaxSkew(argmap["max-skew"].as<double>());
+	generator.SetUpsideDownRatio(argmap["upside-down"].as<double>());
+	if(argmap.count("all-layouts"))
+		generator.SetPatternNum(ccnr::CreditLayout::BUILTIN_NUM);
+	std::vector<ccnr::SyntheticCard> cards(count);
+	for(int i=0; i<count; i++){
+		generator.Generate(cards[i]);
+	}
+	if(argmap.count("save")){
+		std::string save_dir = argmap["save"].as<std::string>();
+		if(!SaveCards(cards, save_dir)){
+			std::cerr << "Fail to save cards to " << save_dir << std::endl;
+			return -1;
+		}
+	}
+
+	// Warm up caches and lazy initialization of OpenCV
+	for(int i=0; i<std::min(count, 3); i++){
+		std::vector<int> numbers;
+		std::vector<cv::Rect> num_pos;
+		ccnr.RecognizeCreditCardNumber(cards[i].image, numbers, num_pos);
+	}
+	ccnr::CreditNumberRecog::ResetStageStatistics();
+
+	std::vector<BenchResult> results(count);
+	std::atomic<int> next(0);
+	std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for(int t=0; t<threads; t++){
+		workers.push_back(std::thread([&](){
+			int i;
+			while((i = next++) < count){
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				ccnr::RecogStatus status;
+				ccnr.RecognizeCreditCardNumber(cards[i].image, results[i].numbers, results[i].num_pos, recog_opt, &status);
+				std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+				results[i].latency_ms = elapsed.count();
+				results[i].truncated = status.truncated;
+			}
+		}));
+	}
+	for(size_t t=0; t<workers.size(); t++){
+		workers[t].join();
+	}
+	std::chrono::duration<double> wall = std::chrono::steady_clock::now() - wall_start;
+
+	// Accuracy
+	const int pattern_num = ccnr::CreditLayout::BUILTIN_NUM;
+	int total_digits = 0, correct_digits = 0, exact = 0, length_match = 0, truncated = 0;
+	int pattern_count[pattern_num] = {0}, pattern_exact[pattern_num] = {0};
+	std::vector<double> latencies;
+	for(int i=0; i<count; i++){
+		const std::vector<int>& truth = cards[i].digits;
+		const std::vector<int>& numbers = results[i].numbers;
+		total_digits += truth.size();
+		if(numbers.size() == truth.size()){
+			length_match++;
+			for(size_t d=0; d<truth.size(); d++){
+				if(numbers[d] == truth[d])
+					correct_digits++;
+			}
+		}
+		int p = cards[i].params.pattern;
+		pattern_count[p]++;
+		if(numbers == truth){
+			exact++;
+			pattern_exact[p]++;
+		}
+		latencies.push_back(results[i].latency_ms);
+		if(results[i].truncated)
+			truncated++;
+	}
+	std::sort(latencies.begin(), latencies.end());
+	double sum = 0;
+	for(size_t i=0; i<latencies.size(); i++){
+		sum += latencies[i];
+	}
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "cards                : " << count << std::endl;
+	std::cout << "threads              : " << threads << std::endl;
+	std::cout << "wall time [s]        : " << wall.count() << std::endl;
+	std::cout << "throughput [card/s]  : " << count / wall.count() << std::endl;
+	if(count > 0){
+		std::cout << "latency mean [ms]    : " << sum / count << std::endl;
+		std::cout << "latency p50 [ms]     : " << Percentile(latencies, 0.50) << std::endl;
+		std::cout << "latency p90 [ms]     : " << Percentile(latencies, 0.90) << std::endl;
+		std::cout << "latency p99 [ms]     : " << Percentile(latencies, 0.99) << std::endl;
+		std::cout << "latency max [ms]     : " << latencies.back() << std::endl;
+		std::cout << "digit accuracy       : " << (double)correct_digits / total_digits << std::endl;
+		std::cout << "string accuracy      : " << (double)exact / count << std::endl;
+		std::cout << "length match         : " << (double)length_match / count << std::endl;
+		std::cout << "truncated searches   : " << truncated << std::endl;
+	}
+	for(int p=0; p<pattern_num; p++){
+		if(pattern_count[p] == 0)
+			continue;
+		std::cout << "string accuracy " << std::left << std::setw(8) << ccnr::CreditLayout::Builtin(p).Name() << std::right << ": " 
+			<< (double)pattern_exact[p] / pattern_count[p] << " (" << pattern_count[p] << " cards)" << std::endl;
+	}
+
+	ccnr::MatPoolStatistics pool_stats;
+	ccnr.GetMatPoolStatistics(pool_stats);
+	unsigned long long pool_requests = pool_stats.hits + pool_stats.misses + pool_stats.oversize;
+	if(pool_requests > 0){
+		std::cout << "mat pool hit rate    : " << (double)pool_stats.hits / pool_requests 
+			<< " (" << pool_stats.hits << " hits, " << pool_stats.misses << " misses, " 
+			<< pool_stats.oversize << " oversize, " << pool_stats.cached_bytes / 1024 << " KB cached)" << std::endl;
+	}
+
+	if(ccnr::Profiler::Enabled()){
+		std::cout << std::endl;
+		ccnr::CreditNumberRecog::PrintStageStatistics(std::cout);
+	}
+	return 0;
+}
@@ -0,0 +1,400 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+// Microbenchmarks of the hot primitives with fixed-seed inputs
+//
+// Every case prints one line of JSON (or CSV), so the output of two builds
+// can be diffed directly or compared with --baseline.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "CreditNumberRecog.h"
+#include "EdgeDirFeatures.h"
+#include "NumberDetect.h"
+#include "NumberRecog.h"
+#include "common.h"
+#include "Mser1D.hpp"
+#include "ModelFile.h"
+#include "SyntheticCard.h"
+
+using namespace boost::program_options;
+
+namespace{
+
+struct MicroCase
+{
+	std::string name;
+	std::string size;
+	std::function<void()> run;
+};
+
+
+struct MicroResult
+{
+	std::string name;
+	std::string size;
+	long long iterations;
+	double mean_ns;
+	double median_ns;
+	double min_ns;
+};
+
+
+std::string SizeString(int width, int height)
+{
+	std::ostringstream oss;
+	oss << width << "x" << height;
+	return oss.str();
+}
+
+
+//! Run batches until min_time has passed and report per-operation times
+MicroResult Measure(const MicroCase& c, double min_time)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	// calibrate the batch size to about 1 ms
+	long long batch = 1;
+	for(;;){
+		Clock::time_point start = Clock::now();
+		for(long long i=0; i<batch; i++){
+			c.run();
+		}
+		double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		if(elapsed > 1e-3 || batch >= (1LL << 24))
+			break;
+		batch *= 2;
+	}
+
+	std::vector<double> samples;
+	long long iterations = 0;
+	double total = 0;
+	while(total < min_time || samples.size() < 5){
+		Clock::time_point start = Clock::now();
+		for(long long i=0; i<batch; i++){
+			c.run();
+		}
+		double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		samples.push_back(elapsed * 1e9 / batch);
+		iterations += batch;
+		total += elapsed;
+	}
+	std::sort(samples.begin(), samples.end());
+
+	MicroResult r;
+	r.name = c.name;
+	r.size = c.size;
+	r.iterations = iterations;
+	r.mean_ns = total * 1e9 / iterations;
+	r.median_ns = samples[samples.size() / 2];
+	r.min_ns = samples.front();
+	return r;
+}
+
+
+void PrintResult(std::ostream& os, const MicroResult& r, const std::string& format)
+{
+	os << std::fixed << std::setprecision(1);
+	if(format == "csv"){
+		os << r.name << "," << r.size << "," << r.iterations << "," << r.mean_ns << "," << r.median_ns << "," << r.min_ns << std::endl;
+	}
+	else{
+		os << "{\"name\": \"" << r.name << "\", \"size\": \"" << r.size << "\", \"iterations\": " << r.iterations 
+			<< ", \"mean_ns\": " << r.mean_ns << ", \"median_ns\": " << r.median_ns << ", \"min_ns\": " << r.min_ns << "}" << std::endl;
+	}
+}
+
+
+//! Read "name/size" -> median_ns from a previous JSON or CSV output
+bool LoadBaseline(const std::string& filename, std::map<std::string, double>& baseline)
+{
+	std::ifstream ifs(filename.c_str());
+	if(!ifs.is_open())
+		return false;
+	std::string line;
+	while(std::getline(ifs, line)){
+		std::string name, size;
+		double median = -1;
+		if(!line.empty() && line[0] == '{'){
+			size_t p;
+			if((p = line.find("\"name\": \"")) != std::string::npos)
+				name = line.substr(p + 9, line.find('"', p + 9) - p - 9);
+			if((p = line.find("\"size\": \"")) != std::string::npos)
+				size = line.substr(p + 9, line.find('"', p + 9) - p - 9);
+			if((p = line.find("\"median_ns\": ")) != std::string::npos)
+				median = atof(line.c_str() + p + 13);
+		}
+		else{
+			std::vector<std::string> fields;
+			std::stringstream ss(line);
+			std::string field;
+			while(std::getline(ss, field, ',')){
+				fields.push_back(field);
+			}
+			if(fields.size() == 6){
+				name = fields[0];
+				size = fields[1];
+				median = atof(fields[4].c_str());
+			}
+		}
+		if(!name.empty() && median > 0)
+			baseline[name + "/" + size] = median;
+	}
+	return true;
+}
+
+}
+
+
+int main(int argc, char* argv[])
+{
+	options_description opt("option");
+	opt.add_options()
+		("help,h", "print help")
+		("model,m", value<std::string>(), "Trained model file path (random coefficients if omitted)")
+		("filter,f", value<std::string>()->default_value(std::string()), "Run only cases whose name contains this string")
+		("min-time", value<double>()->default_value(0.3), "Measuring time per case [s]")
+		("format", value<std::string>()->default_value("json"), "Output format (json or csv)")
+		("baseline,b", value<std::string>(), "Previous output to compare the median time with")
+		("seed,s", value<unsigned long long>()->default_value(0x5eed), "Random seed of the inputs");
+
+	variables_map argmap;
+	try{
+		store(parse_command_line(argc, argv, opt), argmap);
+		notify(argmap);
+	}
+	catch(const std::exception& e){
+		std::cerr << e.what() << std::endl << opt << std::endl;
+		return -1;
+	}
+	if(argmap.count("help")){
+		std::cout << "ccnr_microbench [option]" << std::endl << opt << std::endl;
+		return 0;
+	}
+	std::string format = argmap["format"].as<std::string>();
+	std::string filter = argmap["filter"].as<std::string>();
+	double min_time = argmap["min-time"].as<double>();
+	unsigned long long seed = argmap["seed"].as<unsigned long long>();
+
+	ccnr::CreditNumberRecog ccnr;
+	ccnr::EdgeDirFeatures extractor;
+	extractor.init(4, 4, 0.5);
+	cv::Size train_size = ccnr.GetTrainCharSize();
+	cv::Size filter_size = extractor.calcSizeImg2Feature(train_size);
+	int feature_dim = extractor.GetNumDirections() * filter_size.area();
+
+	// Classifiers: one-vs-one from the model file or random, one-vs-rest always random
+	cv::RNG rng(seed);
+	ccnr::NumberRecog recognizer;
+	if(argmap.count("model")){
+		std::string model_file = argmap["model"].as<std::string>();
+		if(recognizer.Load(model_file) < 0){
+			std::cerr << "Fail to load " << model_file << std::endl;
+			return -1;
+		}
+	}
+	else{
+		cv::Mat coeffs(45, feature_dim + 1, CV_64FC1);
+		rng.fill(coeffs, cv::RNG::NORMAL, 0.0, 1e-3);
+		recognizer.Load(coeffs);
+	}
+	cv::Mat ovr_coeffs(11, feature_dim + 1, CV_64FC1);
+	rng.fill(ovr_coeffs, cv::RNG::NORMAL, 0.0, 1e-3);
+	recognizer.LoadOVR(ovr_coeffs, filter_size);
+
+	// Realistic inputs from one synthetic card at the processing width
+	ccnr::SyntheticCardGenerator generator(seed);
+	ccnr::SyntheticCardParams params = generator.RandomParams();
+	params.width = 640;
+	params.pattern = ccnr::NumberDetect::TYPE4444;
+	ccnr::SyntheticCard card;
+	generator.Generate(params, card);
+
+	cv::Mat gray, proc_img, RowGrad, ColGrad, edge_img;
+	cv::cvtColor(card.image, gray, cv::COLOR_RGB2GRAY);
+	int proc_width = ccnr.GetProcImageSize();
+	cv::resize(gray, proc_img, cv::Size(proc_width, cvRound((double)gray.rows * proc_width / gray.cols)));
+	cv::Sobel(proc_img, RowGrad, CV_32F, 1, 0);
+	cv::Sobel(proc_img, ColGrad, CV_32F, 0, 1);
+	cv::add(cv::abs(RowGrad), cv::abs(ColGrad), edge_img);
+
+	// one digit at the training size and the number band at the training height
+	cv::Mat digit_img, band_img;
+	cv::resize(gray(card.digit_boxes[0]), digit_img, train_size);
+	cv::Rect band = card.digit_boxes.front() | card.digit_boxes.back();
+	cv::resize(gray(band), band_img, cv::Size(cvRound((double)band.width * train_size.height / band.height), train_size.height));
+
+	// number band in the processed image
+	double ratio = (double)proc_width / gray.cols;
+	cv::Rect proc_band(0, cvRound(band.y * ratio), proc_width, cvRound(band.height * ratio));
+	proc_band &= cv::Rect(0, 0, edge_img.cols, edge_img.rows);
+	cv::Mat band_edge = edge_img(proc_band).clone();
+
+	// inputs of the individual stages
+	std::vector<cv::Mat> dir_digit, dir_band, pool_band;
+	ccnr::EdgeDirFeatures::ExtractEdgeDir(digit_img, dir_digit, 4);
+	ccnr::EdgeDirFeatures::ExtractEdgeDir(band_img, dir_band, 4);
+	extractor(band_img, pool_band);
+	cv::Mat digit_feature;
+	extractor(digit_img, digit_feature);
+
+	cv::Mat row_prj, gprj;
+	ccnr::Projection(edge_img, row_prj, true);
+	cv::GaussianBlur(row_prj, gprj, cv::Size(1, 5), 0.0, 1.0);
+	std::vector<float> gprj_vec;
+	ccnr::Mat2Vector(gprj, gprj_vec);
+	int min_char_height = cvRound(0.05 * proc_width), max_char_height = cvRound(0.1 * proc_width);
+
+	cv::Mat app_costs;
+	ccnr::NumberDetect::CreateAppearanceCosts(band_edge, app_costs);
+	std::vector<double> reg_costs;
+	float char_size = (float)proc_band.height / 1.5f;
+	int win_size = (int)(char_size / 2);
+	win_size += (win_size + 1) % 2;
+	ccnr::NumberDetect::CreateRegularizationCosts(reg_costs, win_size, 0.2 * char_size);
+	std::vector<int> break_pattern;
+	ccnr::NumberDetect::CreateCreditBreakPattern(break_pattern, ccnr::NumberDetect::TYPE4444);
+	float avg_length = char_size * (break_pattern.size() - 1);
+
+	cv::Mat pos_map, neg_map;
+	recognizer.CharExistingCostOVR(pool_band, pos_map, neg_map);
+
+	// Cases
+	std::vector<MicroCase> cases;
+	std::vector<cv::Mat> out_dirs, out_pools, out_responses;
+	cv::Mat out_mat;
+	std::vector<std::pair<int,int> > out_msers;
+	std::vector<int> out_breaks;
+	cv::Mat out_costs;
+	volatile int sink = 0;
+
+	MicroCase c;
+	c.name = "ExtractEdgeDir"; c.size = SizeString(digit_img.cols, digit_img.rows);
+	c.run = [&](){ ccnr::EdgeDirFeatures::ExtractEdgeDir(digit_img, out_dirs, 4); };
+	cases.push_back(c);
+	c.name = "ExtractEdgeDir"; c.size = SizeString(band_img.cols, band_img.rows);
+	c.run = [&](){ ccnr::EdgeDirFeatures::ExtractEdgeDir(band_img, out_dirs, 4); };
+	cases.push_back(c);
+	c.name = "MaxPooling"; c.size = SizeString(dir_digit[0].cols, dir_digit[0].rows) + "x4";
+	c.run = [&](){ ccnr::EdgeDirFeatures::MaxPooling(dir_digit, out_pools, 4, 0.5); };
+	cases.push_back(c);
+	c.name = "MaxPooling"; c.size = SizeString(dir_band[0].cols, dir_band[0].rows) + "x4";
+	c.run = [&](){ ccnr::EdgeDirFeatures::MaxPooling(dir_band, out_pools, 4, 0.5); };
+	cases.push_back(c);
+	c.name = "ConvertFeature2ImageSize"; c.size = SizeString(pos_map.cols, pos_map.rows);
+	c.run = [&](){ extractor.ConvertFeature2ImageSize(pos_map, out_mat); };
+	cases.push_back(c);
+	c.name = "Projection.rows"; c.size = SizeString(edge_img.cols, edge_img.rows);
+	c.run = [&](){ ccnr::Projection(edge_img, out_mat, true); };
+	cases.push_back(c);
+	c.name = "Projection.cols"; c.size = SizeString(band_edge.cols, band_edge.rows);
+	c.run = [&](){ ccnr::Projection(band_edge, out_mat, false); };
+	cases.push_back(c);
+	c.name = "Mser1D"; c.size = SizeString((int)gprj_vec.size(), 1);
+	c.run = [&](){ out_msers.clear(); ccnr::Mser1D(gprj_vec, out_msers, 1.0, 2.0, min_char_height, max_char_height); };
+	cases.push_back(c);
+	c.name = "CreateAppearanceCosts"; c.size = SizeString(band_edge.cols, band_edge.rows);
+	c.run = [&](){ ccnr::NumberDetect::CreateAppearanceCosts(band_edge, out_costs); };
+	cases.push_back(c);
+	c.name = "ExtractCharRange"; c.size = SizeString(band_edge.cols, (int)break_pattern.size());
+	c.run = [&](){ 
+		sink += (int)ccnr::NumberDetect::ExtractCharRange(out_breaks, app_costs, reg_costs, avg_length, 0.2f * avg_length, break_pattern);
+	};
+	cases.push_back(c);
+	c.name = "predict"; c.size = SizeString(digit_feature.cols, 45);
+	c.run = [&](){ sink += recognizer.predict(digit_feature); };
+	cases.push_back(c);
+	c.name = "ScoreMapOVR"; c.size = SizeString(pool_band[0].cols, pool_band[0].rows) + "x11";
+	c.run = [&](){ recognizer.ScoreMapOVR(pool_band, out_responses); };
+	cases.push_back(c);
+
+	// Model loading: the given file and its binary conversion
+	std::string bin_model;
+	if(argmap.count("model")){
+		std::string model_file = argmap["model"].as<std::string>();
+		bin_model = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("ccnr_%%%%%%%%.bin")).string();
+		if(ccnr::ModelFile::Convert(model_file, bin_model) < 0){
+			std::cerr << "Fail to convert " << model_file << std::endl;
+			return -1;
+		}
+		if(model_file != ccnr::ModelFile::BUILTIN_MODEL && !ccnr::ModelFile::IsBinary(model_file)){
+			c.name = "LoadModel.text"; c.size = "45x241";
+			c.run = [model_file](){ ccnr::NumberRecog r; r.Load(model_file); };
+			cases.push_back(c);
+		}
+		if(ccnr::ModelFile::HasBuiltin()){
+			c.name = "LoadModel.builtin"; c.size = "45x241";
+			c.run = [](){ ccnr::NumberRecog r; r.Load(std::string(ccnr::ModelFile::BUILTIN_MODEL)); };
+			cases.push_back(c);
+		}
+		c.name = "LoadModel.binary"; c.size = "45x241";
+		c.run = [bin_model](){ ccnr::NumberRecog r; r.Load(bin_model); };
+		cases.push_back(c);
+	}
+
+	std::map<std::string, double> baseline;
+	if(argmap.count("baseline")){
+		std::string baseline_file = argmap["baseline"].as<std::string>();
+		if(!LoadBaseline(baseline_file, baseline)){
+			std::cerr << "Fail to read " << baseline_file << std::endl;
+			return -1;
+		}
+	}
+
+	if(format == "csv")
+		std::cout << "name,size,iterations,mean_ns,median_ns,min_ns" << std::endl;
+	for(size_t i=0; i<cases.size(); i++){
+		if(!filter.empty() && cases[i].name.find(filter) == std::string::npos)
+			continue;
+		MicroResult r = Measure(cases[i], min_time);
+		PrintResult(std::cout, r, format);
+
+		std::map<std::string, double>::iterator it = baseline.find(r.name + "/" + r.size);
+		if(it != baseline.end()){
+			std::cerr << std::left << std::setw(28) << r.name << std::setw(12) << r.size << std::right << std::fixed << std::setprecision(2)
+				<< " baseline/current = " << it->second / r.median_ns << std::endl;
+		}
+	}
+	if(!bin_model.empty())
+		boost::filesystem::remove(bin_model);
+	return 0;
+}
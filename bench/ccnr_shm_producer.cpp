@@ -0,0 +1,224 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+// Test producer for "CreditNumberRecognizer --shm": writes synthetic cards into
+// the shared-memory ring and checks the results that come back
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <boost/program_options.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "ShmRing.h"
+#include "SyntheticCard.h"
+
+using namespace boost::program_options;
+
+namespace{
+
+typedef std::chrono::steady_clock Clock;
+
+double Percentile(const std::vector<double>& sorted, double ratio)
+{
+	if(sorted.empty())
+		return 0;
+	size_t idx = (size_t)(ratio * (sorted.size() - 1) + 0.5);
+	return sorted[idx];
+}
+
+
+//! Frame in the format the producer sends
+/*!
+Gray uses the weights of the pipeline (COLOR_RGB2GRAY on BGR) so that the results
+match ccnr_bench. I420 is what many camera pipelines deliver.
+*/
+int ToFrame(const cv::Mat& bgr, const std::string& format, cv::Mat& frame)
+{
+	if(format == "gray"){
+		cv::cvtColor(bgr, frame, cv::COLOR_RGB2GRAY);
+		return CCNR_PIXEL_GRAY8;
+	}
+	else if(format == "i420"){
+		// I420 needs an even size
+		cv::Mat even = bgr(cv::Rect(0, 0, bgr.cols & ~1, bgr.rows & ~1));
+		cv::cvtColor(even, frame, cv::COLOR_BGR2YUV_I420);
+		return CCNR_PIXEL_YUV_I420;
+	}
+	else if(format == "bgr"){
+		frame = bgr;
+		return CCNR_PIXEL_BGR8;
+	}
+	return -1;
+}
+
+}
+
+
+int main(int argc, char* argv[])
+{
+	options_description opt("option");
+	opt.add_options()
+		("help,h", "print help")
+		("name", value<std::string>()->default_value("/ccnr"), "Shared memory name given to --shm of the recognizer")
+		("count,n", value<int>()->default_value(300), "Number of synthetic cards")
+		("seed,s", value<unsigned long long>()->default_value(0x5eed), "Random seed of the generator")
+		("format,f", value<std::string>()->default_value("gray"), "Frame format: gray, i420 or bgr")
+		("min-width", value<int>()->default_value(480), "Minimum card width [pixel]")
+		("max-width", value<int>()->default_value(1280), "Maximum card width [pixel]")
+		("timeout", value<double>()->default_value(5000), "Give up waiting for a slot or a result after this [ms]");
+
+	variables_map argmap;
+	try{
+		store(parse_command_line(argc, argv, opt), argmap);
+		notify(argmap);
+	}
+	catch(const std::exception& e){
+		std::cerr << e.what() << std::endl << opt << std::endl;
+		return -1;
+	}
+	if(argmap.count("help")){
+		std::cout << "ccnr_shm_producer [option]" << std::endl << opt << std::endl;
+		return 0;
+	}
+
+	std::string name = argmap["name"].as<std::string>();
+	std::string format = argmap["format"].as<std::string>();
+	int count = argmap["count"].as<int>();
+	double timeout_ms = argmap["timeout"].as<double>();
+
+	ccnr::ShmRing ring;
+	if(ring.Open(name) < 0){
+		std::cerr << "Fail to open " << name << ". Is \"CreditNumberRecognizer --shm " << name << "\" running?" << std::endl;
+		return -1;
+	}
+
+	// Render and convert up front so that only the transfer and recognition are measured
+	ccnr::SyntheticCardGenerator generator(argmap["seed"].as<unsigned long long>());
+	generator.SetWidthRange(argmap["min-width"].as<int>(), argmap["max-width"].as<int>());
+	std::vector<ccnr::SyntheticCard> cards(count);
+	std::vector<cv::Mat> frames(count);
+	std::vector<int> formats(count);
+	for(int i=0; i<count; i++){
+		generator.Generate(cards[i]);
+		formats[i] = ToFrame(cards[i].image, format, frames[i]);
+		if(formats[i] < 0){
+			std::cerr << "Unknown format " << format << std::endl;
+			return -1;
+		}
+		size_t bytes = frames[i].total() * frames[i].elemSize();
+		if(bytes > ring.FrameBytes()){
+			std::cerr << "Card " << i << " (" << bytes << " bytes) does not fit a slot of " << ring.FrameBytes() << " bytes" << std::endl;
+			return -1;
+		}
+	}
+
+	// Results are collected while frames are being submitted
+	std::vector<Clock::time_point> submitted(count);
+	std::vector<double> latency(count, -1);
+	std::vector<ccnr::ShmResult> results(count);
+	int received = 0;
+	std::thread receiver([&](){
+		ccnr::ShmResult res;
+		while(received < count && ring.ReceiveResult(res, timeout_ms) == 0){
+			if(res.frame_id >= (uint64_t)count || latency[res.frame_id] >= 0)
+				continue;
+			std::chrono::duration<double, std::milli> elapsed = Clock::now() - submitted[res.frame_id];
+			latency[res.frame_id] = elapsed.count();
+			results[res.frame_id] = res;
+			received++;
+		}
+	});
+
+	Clock::time_point wall_start = Clock::now();
+	int sent = 0;
+	for(; sent<count; sent++){
+		ccnr::ShmRing::Slot slot;
+		if(ring.AcquireFrame(slot, timeout_ms) < 0){
+			std::cerr << "No free slot within " << timeout_ms << " ms" << std::endl;
+			break;
+		}
+		// frames are written directly into the slot
+		const cv::Mat& frame = frames[sent];
+		size_t row_bytes = frame.cols * frame.elemSize();
+		for(int y=0; y<frame.rows; y++){
+			std::memcpy(slot.data + y * row_bytes, frame.ptr(y), row_bytes);
+		}
+		ccnr::ShmFrameInfo info;
+		info.frame_id = sent;
+		info.width = frame.cols;
+		// the I420 frame from cvtColor has the chroma planes below the Y plane
+		info.height = (formats[sent] == CCNR_PIXEL_YUV_I420) ? frame.rows * 2 / 3 : frame.rows;
+		info.stride = (int)row_bytes;
+		info.format = formats[sent];
+		submitted[sent] = Clock::now();
+		ring.SubmitFrame(slot, info);
+	}
+	receiver.join();
+	std::chrono::duration<double> wall = Clock::now() - wall_start;
+
+	int exact = 0, errors = 0;
+	std::vector<double> latencies;
+	for(int i=0; i<count; i++){
+		if(latency[i] < 0)
+			continue;
+		latencies.push_back(latency[i]);
+		const ccnr::ShmResult& res = results[i];
+		if(res.status != CCNR_OK){
+			errors++;
+			continue;
+		}
+		std::vector<int> numbers;
+		for(int d=0; d<res.result.num_digits; d++){
+			numbers.push_back(res.result.digits[d].digit);
+		}
+		if(numbers == cards[i].digits)
+			exact++;
+	}
+	std::sort(latencies.begin(), latencies.end());
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "frames sent          : " << sent << " (" << format << ")" << std::endl;
+	std::cout << "results received     : " << received << std::endl;
+	std::cout << "errors               : " << errors << std::endl;
+	std::cout << "wall time [s]        : " << wall.count() << std::endl;
+	std::cout << "throughput [frame/s] : " << received / wall.count() << std::endl;
+	if(!latencies.empty()){
+		std::cout << "latency p50 [ms]     : " << Percentile(latencies, 0.50) << std::endl;
+		std::cout << "latency p99 [ms]     : " << Percentile(latencies, 0.99) << std::endl;
+		std::cout << "string accuracy      : " << (double)exact / received << std::endl;
+	}
+	return (received == count && errors == 0) ? 0 : -1;
+}
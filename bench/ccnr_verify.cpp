@@ -0,0 +1,651 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+// Golden-output equivalence harness
+//
+// Runs the frozen reference pipeline (ReferencePipeline.h) and the library
+// configured as a selected variant on the same corpus. Intermediate outputs
+// are compared within tolerances, the final digits and boxes exactly, and
+// the time of every stage is reported side by side.
+// The exit code is 1 if any check failed.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <limits>
+#include <cmath>
+#include <boost/program_options.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include "CreditNumberRecog.h"
+#include "EdgeDirFeatures.h"
+#include "ModelFile.h"
+#include "NumberDetect.h"
+#include "NumberRecog.h"
+#include "common.h"
+#include "util.h"
+#include "SyntheticCard.h"
+#include "ReferencePipeline.h"
+
+using namespace boost::program_options;
+
+namespace{
+
+//! Library configuration under test
+struct Variant
+{
+	std::string name;
+	std::string description;
+	std::function<void(ccnr::CreditNumberRecog&)> configure;
+};
+
+
+std::vector<Variant> Variants()
+{
+	std::vector<Variant> variants;
+	Variant def;
+	def.name = "default";
+	def.description = "library as built";
+	def.configure = [](ccnr::CreditNumberRecog&){};
+	variants.push_back(def);
+
+	Variant no_pool;
+	no_pool.name = "no_pool";
+	no_pool.description = "temporaries from OpenCV's default allocator";
+	no_pool.configure = [](ccnr::CreditNumberRecog& recog){ recog.EnableMatPool(false); };
+	variants.push_back(no_pool);
+	return variants;
+}
+
+
+struct Sample
+{
+	std::string name;
+	cv::Mat image;
+	std::vector<int> truth;	// empty if unknown
+};
+
+
+struct Tolerance
+{
+	double cost;	// appearance and search costs, relative to max(1, |cost|)
+	int breaks;	// character break positions [pixel]
+	double feature;	// edge directions, pooling and features
+	double score;	// one-vs-rest responses and costs, relative to max(1, |value|)
+};
+
+
+//! Result of one kind of check
+struct StageReport
+{
+	long long checks;
+	long long mismatches;
+	double max_diff;
+	double ref_ms;
+	double opt_ms;
+
+	StageReport() : checks(0), mismatches(0), max_diff(0), ref_ms(0), opt_ms(0){};
+};
+
+
+class Verifier
+{
+public:
+	Verifier(const ccnr::CreditNumberRecog& recog, const cv::Mat& svm_coeffs, const Tolerance& tol, int verbose)
+		: _recog(recog), _svm_coeffs(svm_coeffs), _tol(tol), _verbose(verbose)
+	{
+		_number_recog.Load(svm_coeffs);
+	};
+
+	//! Also compare the one-vs-rest scoring of every band (svm_coeff of a detector file)
+	void SetDetector(const cv::Mat& ovr_coeffs){
+		_ovr_coeffs = ovr_coeffs;
+		cv::Size filter_size = ccnr::EdgeDirFeatures().calcSizeImg2Feature(_recog.GetTrainCharSize());
+		_ovr_recog.LoadOVR(ovr_coeffs, filter_size);
+	}
+
+	//! true if every check of the image passed
+	bool Verify(const Sample& sample);
+
+	void Print(std::ostream& os) const;
+
+private:
+	const ccnr::CreditNumberRecog& _recog;
+	cv::Mat _svm_coeffs;
+	ccnr::NumberRecog _number_recog;
+	cv::Mat _ovr_coeffs;
+	ccnr::NumberRecog _ovr_recog;
+	Tolerance _tol;
+	int _verbose;
+	std::map<std::string, StageReport> _reports;
+	std::string _current;
+	bool _passed;
+
+	void Check(const std::string& stage, bool ok, double diff, const std::string& detail = std::string());
+
+	template<typename F>
+	static double TimeMs(F f){
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		f();
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void VerifyBand(const cv::Mat& edge_img, const cv::Rect& band);
+	void VerifyFeature(const cv::Mat& char_img);
+	void VerifyDetector(const cv::Mat& band_img);
+};
+
+
+double MaxAbsDiff(const cv::Mat& a, const cv::Mat& b)
+{
+	if(a.size() != b.size())
+		return std::numeric_limits<double>::infinity();
+	cv::Mat a64, b64;
+	a.convertTo(a64, CV_64F);
+	b.convertTo(b64, CV_64F);
+	return cv::norm(a64, b64, cv::NORM_INF);
+}
+
+
+//! |a - b| relative to max(1, |a|)
+double RelDiff(double a, double b)
+{
+	return std::abs(a - b) / std::max(1.0, std::abs(a));
+}
+
+
+//! Reference cost channels as the library's CHAR_EDGE_TYPE_NUM x width block
+cv::Mat CostBlock(const std::vector<std::vector<double> >& costs)
+{
+	cv::Mat block((int)costs.size(), costs.empty() ? 0 : (int)costs[0].size(), CV_32FC1);
+	for(int t=0; t<block.rows; t++){
+		for(int x=0; x<block.cols; x++){
+			block.at<float>(t,x) = (float)costs[t][x];
+		}
+	}
+	return block;
+}
+
+
+std::string RectString(const std::vector<cv::Rect>& rects)
+{
+	std::ostringstream ss;
+	for(size_t i=0; i<rects.size(); i++){
+		ss << "[" << rects[i].x << "," << rects[i].y << "," << rects[i].width << "," << rects[i].height << "]";
+	}
+	return ss.str();
+}
+
+
+std::string DigitString(const std::vector<int>& digits)
+{
+	std::string str;
+	for(size_t i=0; i<digits.size(); i++){
+		str += (digits[i] >= 0 && digits[i] <= 9) ? (char)('0' + digits[i]) : '?';
+	}
+	return str;
+}
+
+
+void Verifier::Check(const std::string& stage, bool ok, double diff, const std::string& detail)
+{
+	StageReport& report = _reports[stage];
+	report.checks++;
+	if(diff > report.max_diff)
+		report.max_diff = diff;
+	if(!ok){
+		report.mismatches++;
+		_passed = false;
+		if(_verbose > 0){
+			std::cout << _current << ": " << stage << " mismatch";
+			if(!detail.empty())
+				std::cout << " " << detail;
+			std::cout << std::endl;
+		}
+	}
+}
+
+
+bool Verifier::Verify(const Sample& sample)
+{
+	_current = sample.name;
+	_passed = true;
+
+	// Preprocessing shared by both sides, as in RecognizeCreditCardNumber
+	cv::Mat gray;
+	if(sample.image.channels() > 1)
+		cv::cvtColor(sample.image, gray, cv::COLOR_RGB2GRAY);
+	else
+		gray = sample.image;
+	int input_width = _recog.GetProcImageSize();
+	cv::Mat proc_img, RowGrad, ColGrad, SumGrad;
+	cv::resize(gray, proc_img, cv::Size(input_width, ccnr::round((float)gray.rows * input_width / gray.cols)));
+	cv::Sobel(proc_img, RowGrad, CV_32F, 1, 0);
+	cv::Sobel(proc_img, ColGrad, CV_32F, 0, 1);
+	cv::add(cv::abs(RowGrad), cv::abs(ColGrad), SumGrad);
+
+	// Number string bands (projection + Mser1D), exact
+	ccnr::NumberDetect detector;
+	int min_h = ccnr::round(detector._min_char_height_ratio * SumGrad.cols);
+	int max_h = ccnr::round(detector._max_char_height_ratio * SumGrad.cols);
+	std::vector<cv::Rect> ref_bands, opt_bands;
+	StageReport& band_report = _reports["string_height"];
+	band_report.ref_ms += TimeMs([&](){ ccnr::reference::DetectStringHeight(SumGrad, ref_bands, min_h, max_h); });
+	band_report.opt_ms += TimeMs([&](){ ccnr::NumberDetect::DetectStringHeight(SumGrad, opt_bands, min_h, max_h); });
+	Check("string_height", ref_bands == opt_bands, 0, RectString(ref_bands) + " vs " + RectString(opt_bands));
+
+	for(size_t i=0; i<ref_bands.size(); i++){
+		VerifyBand(SumGrad, ref_bands[i]);
+		if(!_ovr_coeffs.empty())
+			VerifyDetector(proc_img(ref_bands[i]));
+	}
+
+	// End to end
+	std::vector<int> ref_numbers, opt_numbers;
+	std::vector<cv::Rect> ref_pos, opt_pos;
+	StageReport& total_report = _reports["total"];
+	total_report.ref_ms += TimeMs([&](){ ccnr::reference::Recognize(sample.image, _svm_coeffs, ref_numbers, ref_pos); });
+	total_report.opt_ms += TimeMs([&](){ _recog.RecognizeCreditCardNumber(sample.image, opt_numbers, opt_pos); });
+	Check("boxes", ref_pos == opt_pos, 0, RectString(ref_pos) + " vs " + RectString(opt_pos));
+	Check("digits", ref_numbers == opt_numbers, 0, DigitString(ref_numbers) + " vs " + DigitString(opt_numbers));
+	total_report.checks++;
+
+	// Character features and classification on the reference boxes
+	for(size_t i=0; i<ref_pos.size(); i++){
+		VerifyFeature(gray(ref_pos[i]).clone());
+	}
+
+	// Accuracy is reported but does not fail the image
+	if(!sample.truth.empty()){
+		StageReport& ref_truth = _reports["truth[reference]"];
+		StageReport& opt_truth = _reports["truth[variant]"];
+		ref_truth.checks++;
+		opt_truth.checks++;
+		if(ref_numbers != sample.truth)
+			ref_truth.mismatches++;
+		if(opt_numbers != sample.truth)
+			opt_truth.mismatches++;
+	}
+	if(_verbose > 1)
+		std::cout << _current << ": " << DigitString(opt_numbers) << (_passed ? " ok" : " NG") << std::endl;
+	return _passed;
+}
+
+
+void Verifier::VerifyBand(const cv::Mat& edge_img, const cv::Rect& band)
+{
+	cv::Mat band_img = edge_img(band).clone();
+
+	// Appearance costs, within tolerance
+	std::vector<std::vector<double> > ref_costs;
+	cv::Mat opt_costs;
+	StageReport& app_report = _reports["appearance_costs"];
+	app_report.ref_ms += TimeMs([&](){ ccnr::reference::CreateAppearanceCosts(band_img, ref_costs); });
+	app_report.opt_ms += TimeMs([&](){ ccnr::NumberDetect::CreateAppearanceCosts(band_img, opt_costs); });
+	double app_diff = 0;
+	bool app_ok = ((int)ref_costs.size() == opt_costs.rows);
+	for(int t=0; app_ok && t<opt_costs.rows; t++){
+		app_ok = ((int)ref_costs[t].size() == opt_costs.cols);
+		for(int x=0; app_ok && x<opt_costs.cols; x++){
+			app_diff = std::max(app_diff, RelDiff(ref_costs[t][x], opt_costs.at<float>(t,x)));
+		}
+	}
+	Check("appearance_costs", app_ok && app_diff <= _tol.cost, app_diff);
+
+	// Break search of every pattern on the same (reference) costs
+	ccnr::NumberDetect detector;
+	float char_size = (float)band.height / detector._char_aspect_ratio;
+	int win_size = char_size / 2;
+	win_size += (win_size + 1) % 2;
+	std::vector<double> reg_costs;
+	ccnr::reference::CreateRegularizationCosts(reg_costs, win_size, detector._char_width_div * char_size);
+
+	cv::Mat ref_block = CostBlock(ref_costs);
+	StageReport& range_report = _reports["char_range"];
+	for(int p=0; p<ccnr::reference::PATTERN_NUM; p++){
+		std::vector<int> ref_pattern, opt_pattern;
+		ccnr::reference::CreateCreditBreakPattern(ref_pattern, p);
+		ccnr::NumberDetect::CreateCreditBreakPattern(opt_pattern, (ccnr::NumberDetect::CREDIT_PATTERN)p);
+		Check("break_pattern", ref_pattern == opt_pattern, 0);
+
+		float avg_length = char_size * (ref_pattern.size() - 1);
+		float length_div = detector._char_width_div * avg_length;
+		std::vector<int> ref_breaks, opt_breaks;
+		double ref_cost, opt_cost;
+		range_report.ref_ms += TimeMs([&](){
+			ref_cost = ccnr::reference::ExtractCharRange(ref_breaks, ref_costs, reg_costs, avg_length, length_div, ref_pattern);
+		});
+		range_report.opt_ms += TimeMs([&](){
+			opt_cost = ccnr::NumberDetect::ExtractCharRange(opt_breaks, ref_block, reg_costs, avg_length, length_div, ref_pattern);
+		});
+		bool ok = (ref_breaks.size() == opt_breaks.size()) && RelDiff(ref_cost, opt_cost) <= _tol.cost;
+		int max_shift = 0;
+		for(size_t b=0; ok && b<ref_breaks.size(); b++){
+			max_shift = std::max(max_shift, std::abs(ref_breaks[b] - opt_breaks[b]));
+		}
+		ok = ok && max_shift <= _tol.breaks;
+		std::ostringstream detail;
+		detail << "pattern " << p << " cost " << ref_cost << " vs " << opt_cost << " shift " << max_shift;
+		Check("char_range", ok, RelDiff(ref_cost, opt_cost), detail.str());
+	}
+}
+
+
+void Verifier::VerifyFeature(const cv::Mat& char_img)
+{
+	const int dir_num = 4, pool_size = 4;
+	const float overlap = 0.5;
+	cv::Mat resize_img;
+	cv::resize(char_img, resize_img, _recog.GetTrainCharSize());
+
+	// Edge directions
+	std::vector<cv::Mat> ref_dirs, opt_dirs;
+	StageReport& dir_report = _reports["edge_dir"];
+	dir_report.ref_ms += TimeMs([&](){ ccnr::reference::ExtractEdgeDir(resize_img, ref_dirs, dir_num); });
+	dir_report.opt_ms += TimeMs([&](){ ccnr::EdgeDirFeatures::ExtractEdgeDir(resize_img, opt_dirs, dir_num); });
+	double dir_diff = (ref_dirs.size() == opt_dirs.size()) ? 0 : std::numeric_limits<double>::infinity();
+	for(size_t d=0; d<ref_dirs.size() && d<opt_dirs.size(); d++){
+		dir_diff = std::max(dir_diff, MaxAbsDiff(ref_dirs[d], opt_dirs[d]));
+	}
+	Check("edge_dir", dir_diff <= _tol.feature, dir_diff);
+
+	// Max pooling of the same (reference) directions
+	cv::Rect trunc_rect(1, 1, resize_img.cols-2, resize_img.rows-2);
+	StageReport& pool_report = _reports["max_pooling"];
+	for(size_t d=0; d<ref_dirs.size(); d++){
+		cv::Mat dir_img = ref_dirs[d](trunc_rect).clone();
+		cv::Mat ref_pool, opt_pool;
+		pool_report.ref_ms += TimeMs([&](){ ccnr::reference::MaxPooling(dir_img, ref_pool, pool_size, overlap); });
+		pool_report.opt_ms += TimeMs([&](){ ccnr::EdgeDirFeatures::MaxPooling(dir_img, opt_pool, pool_size, overlap); });
+		double pool_diff = MaxAbsDiff(ref_pool, opt_pool);
+		Check("max_pooling", pool_diff <= _tol.feature, pool_diff);
+	}
+
+	// Whole feature
+	cv::Mat ref_feature, opt_feature;
+	StageReport& feature_report = _reports["feature"];
+	feature_report.ref_ms += TimeMs([&](){ ccnr::reference::ExtractFeature(char_img, _recog.GetTrainCharSize(), ref_feature); });
+	feature_report.opt_ms += TimeMs([&](){ _recog.CreateFeature(char_img, opt_feature); });
+	double feature_diff = MaxAbsDiff(ref_feature, opt_feature);
+	Check("feature", feature_diff <= _tol.feature, feature_diff);
+
+	// Classification of the same (reference) feature, exact
+	int ref_label, opt_label;
+	StageReport& predict_report = _reports["predict"];
+	predict_report.ref_ms += TimeMs([&](){ ref_label = ccnr::reference::Predict(_svm_coeffs, ref_feature); });
+	predict_report.opt_ms += TimeMs([&](){ opt_label = _number_recog.predict(ref_feature); });
+	std::ostringstream detail;
+	detail << ref_label << " vs " << opt_label;
+	Check("predict", ref_label == opt_label, 0, detail.str());
+}
+
+
+void Verifier::VerifyDetector(const cv::Mat& band_img)
+{
+	// band features as in CreditNumberRecog::CreateCharExistingCost, shared by both sides
+	cv::Size train_size = _recog.GetTrainCharSize();
+	cv::Mat resize_img;
+	cv::resize(band_img, resize_img, cv::Size(ccnr::round((float)band_img.cols * train_size.height / band_img.rows), train_size.height));
+	ccnr::EdgeDirFeatures extractor;
+	std::vector<cv::Mat> features;
+	extractor(resize_img, features);
+	cv::Size filter_size = extractor.calcSizeImg2Feature(train_size);
+
+	// Responses: filter2D per class and direction vs one matrix product
+	std::vector<cv::Mat> ref_resp, opt_resp;
+	StageReport& score_report = _reports["ovr_scores"];
+	score_report.ref_ms += TimeMs([&](){ ccnr::reference::ScoreMapOVR(features, _ovr_coeffs, filter_size, ref_resp); });
+	score_report.opt_ms += TimeMs([&](){ _ovr_recog.ScoreMapOVR(features, opt_resp); });
+	double score_diff = (ref_resp.size() == opt_resp.size()) ? 0 : std::numeric_limits<double>::infinity();
+	for(size_t c=0; c<ref_resp.size() && c<opt_resp.size(); c++){
+		if(ref_resp[c].size() != opt_resp[c].size()){
+			score_diff = std::numeric_limits<double>::infinity();
+			break;
+		}
+		for(int y=0; y<ref_resp[c].rows; y++){
+			for(int x=0; x<ref_resp[c].cols; x++){
+				score_diff = std::max(score_diff, RelDiff(ref_resp[c].at<float>(y,x), opt_resp[c].at<float>(y,x)));
+			}
+		}
+	}
+	Check("ovr_scores", score_diff <= _tol.score, score_diff);
+
+	// Costs: scores and costs separately vs fused; the reference overflows to inf on large responses
+	cv::Mat ref_pos, ref_neg, opt_pos, opt_neg;
+	StageReport& cost_report = _reports["ovr_costs"];
+	cost_report.ref_ms += TimeMs([&](){
+		ccnr::reference::ScoreMapOVR(features, _ovr_coeffs, filter_size, ref_resp);
+		ccnr::reference::Score2CostOVR(ref_resp, ref_pos, ref_neg);
+	});
+	cost_report.opt_ms += TimeMs([&](){ _ovr_recog.CharExistingCostOVR(features, opt_pos, opt_neg); });
+	double cost_diff = (ref_pos.size() == opt_pos.size()) ? 0 : std::numeric_limits<double>::infinity();
+	for(int y=0; cost_diff == 0 && y<ref_pos.rows; y++){
+		for(int x=0; x<ref_pos.cols; x++){
+			float ref_values[] = {ref_pos.at<float>(y,x), ref_neg.at<float>(y,x)};
+			float opt_values[] = {opt_pos.at<float>(y,x), opt_neg.at<float>(y,x)};
+			for(int k=0; k<2; k++){
+				if(std::isfinite(ref_values[k]))
+					cost_diff = std::max(cost_diff, RelDiff(ref_values[k], opt_values[k]));
+			}
+		}
+	}
+	Check("ovr_costs", cost_diff <= _tol.score, cost_diff);
+}
+
+
+void Verifier::Print(std::ostream& os) const
+{
+	static const char* order[] = {
+		"string_height", "appearance_costs", "break_pattern", "char_range", "edge_dir", "max_pooling",
+		"feature", "predict", "ovr_scores", "ovr_costs", "boxes", "digits", "total", "truth[reference]", "truth[variant]"
+	};
+	std::ios::fmtflags flags = os.flags();
+	os << std::left << std::setw(18) << "check" << std::right
+		<< std::setw(9) << "count" << std::setw(11) << "mismatch" << std::setw(12) << "max diff"
+		<< std::setw(12) << "ref[ms]" << std::setw(12) << "opt[ms]" << std::setw(10) << "speedup" << std::endl;
+	for(size_t i=0; i<sizeof(order)/sizeof(order[0]); i++){
+		std::map<std::string, StageReport>::const_iterator it = _reports.find(order[i]);
+		if(it == _reports.end())
+			continue;
+		const StageReport& r = it->second;
+		os << std::left << std::setw(18) << it->first << std::right
+			<< std::setw(9) << r.checks << std::setw(11) << r.mismatches
+			<< std::setw(12) << std::scientific << std::setprecision(2) << r.max_diff << std::fixed;
+		if(r.ref_ms > 0 || r.opt_ms > 0){
+			os << std::setprecision(3) << std::setw(12) << r.ref_ms << std::setw(12) << r.opt_ms
+				<< std::setprecision(2) << std::setw(9) << (r.opt_ms > 0 ? r.ref_ms / r.opt_ms : 0) << "x";
+		}
+		os << std::endl;
+	}
+	os.flags(flags);
+}
+
+
+//! ground_truth.txt as written by ccnr_bench --save: "<file> <digits with '-'>"
+void ReadGroundTruth(const std::string& dir, std::map<std::string, std::vector<int> >& truth)
+{
+	std::ifstream ifs((boost::filesystem::path(dir) / "ground_truth.txt").string().c_str());
+	std::string line;
+	while(std::getline(ifs, line)){
+		std::istringstream ss(line);
+		std::string file, number;
+		if(!(ss >> file >> number))
+			continue;
+		std::vector<int> digits;
+		for(size_t i=0; i<number.size(); i++){
+			if(number[i] >= '0' && number[i] <= '9')
+				digits.push_back(number[i] - '0');
+		}
+		truth[file] = digits;
+	}
+}
+
+
+bool LoadCorpus(const std::string& dir, std::vector<Sample>& samples)
+{
+	std::vector<std::string> files;
+	if(!ReadImageFilesInDirectory(dir, files))
+		return false;
+	std::sort(files.begin(), files.end());
+
+	std::map<std::string, std::vector<int> > truth;
+	ReadGroundTruth(dir, truth);
+	for(size_t i=0; i<files.size(); i++){
+		Sample sample;
+		sample.name = boost::filesystem::path(files[i]).filename().string();
+		sample.image = cv::imread(files[i]);
+		if(sample.image.empty())
+			continue;
+		std::map<std::string, std::vector<int> >::const_iterator it = truth.find(sample.name);
+		if(it != truth.end())
+			sample.truth = it->second;
+		samples.push_back(sample);
+	}
+	return true;
+}
+
+}
+
+
+int main(int argc, char* argv[])
+{
+	std::vector<Variant> variants = Variants();
+	std::ostringstream variant_help;
+	variant_help << "Library configuration to verify:";
+	for(size_t i=0; i<variants.size(); i++){
+		variant_help << " " << variants[i].name << " (" << variants[i].description << ")";
+	}
+
+	options_description opt("option");
+	opt.add_options()
+		("help,h", "print help")
+		("model,m", value<std::string>()->default_value(ccnr::ModelFile::DefaultModel()), "Trained model file path (\"builtin\": compiled-in model)")
+		("variant,v", value<std::string>()->default_value("default"), variant_help.str().c_str())
+		("corpus,c", value<std::string>(), "Directory of card images (uses ground_truth.txt if exists) instead of synthetic cards")
+		("count,n", value<int>()->default_value(100), "Number of synthetic cards")
+		("seed,s", value<unsigned long long>()->default_value(0x5eed), "Random seed of the generator")
+		("cost-tol", value<double>()->default_value(1e-5), "Relative tolerance of appearance and search costs")
+		("break-tol", value<int>()->default_value(0), "Tolerance of character break positions [pixel]")
+		("feature-tol", value<double>()->default_value(1e-4), "Tolerance of edge directions, pooling and features")
+		("detector,d", value<std::string>(), "One-vs-rest detector file; compares the dense scoring of every band")
+		("score-tol", value<double>()->default_value(1e-4), "Relative tolerance of one-vs-rest responses and costs")
+		("verbose", value<int>()->default_value(1), "0: summary only, 1: mismatches, 2: every image");
+
+	variables_map argmap;
+	try{
+		store(parse_command_line(argc, argv, opt), argmap);
+		notify(argmap);
+	}
+	catch(const std::exception& e){
+		std::cerr << e.what() << std::endl << opt << std::endl;
+		return -1;
+	}
+	if(argmap.count("help")){
+		std::cout << "ccnr_verify [option]" << std::endl << opt << std::endl;
+		return 0;
+	}
+
+	const Variant* variant = 0;
+	for(size_t i=0; i<variants.size(); i++){
+		if(variants[i].name == argmap["variant"].as<std::string>())
+			variant = &variants[i];
+	}
+	if(!variant){
+		std::cerr << "Unknown variant " << argmap["variant"].as<std::string>() << std::endl;
+		return -1;
+	}
+
+	std::string model_file = argmap["model"].as<std::string>();
+	cv::Mat svm_coeffs;
+	ccnr::CreditNumberRecog ccnr;
+	if(!ccnr::reference::LoadModel(model_file, svm_coeffs) || ccnr.LoadClassifier(model_file) < 0){
+		std::cerr << "Fail to load " << model_file << std::endl;
+		return -1;
+	}
+	variant->configure(ccnr);
+
+	std::vector<Sample> samples;
+	if(argmap.count("corpus")){
+		if(!LoadCorpus(argmap["corpus"].as<std::string>(), samples)){
+			std::cerr << "Fail to read " << argmap["corpus"].as<std::string>() << std::endl;
+			return -1;
+		}
+	}
+	else{
+		ccnr::SyntheticCardGenerator generator(argmap["seed"].as<unsigned long long>());
+		int count = argmap["count"].as<int>();
+		for(int i=0; i<count; i++){
+			ccnr::SyntheticCard card;
+			generator.Generate(card);
+			Sample sample;
+			std::ostringstream name;
+			name << "card_" << std::setw(5) << std::setfill('0') << i;
+			sample.name = name.str();
+			sample.image = card.image;
+			sample.truth = card.digits;
+			samples.push_back(sample);
+		}
+	}
+
+	Tolerance tol;
+	tol.cost = argmap["cost-tol"].as<double>();
+	tol.breaks = argmap["break-tol"].as<int>();
+	tol.feature = argmap["feature-tol"].as<double>();
+	tol.score = argmap["score-tol"].as<double>();
+	Verifier verifier(ccnr, svm_coeffs, tol, argmap["verbose"].as<int>());
+	if(argmap.count("detector")){
+		cv::Mat ovr_coeffs;
+		if(!ccnr::reference::LoadModel(argmap["detector"].as<std::string>(), ovr_coeffs)){
+			std::cerr << "Fail to load " << argmap["detector"].as<std::string>() << std::endl;
+			return -1;
+		}
+		verifier.SetDetector(ovr_coeffs);
+	}
+
+	int failed = 0;
+	for(size_t i=0; i<samples.size(); i++){
+		if(!verifier.Verify(samples[i]))
+			failed++;
+	}
+
+	std::cout << "variant : " << variant->name << std::endl;
+	std::cout << "images  : " << samples.size() << " (" << failed << " with mismatches)" << std::endl << std::endl;
+	verifier.Print(std::cout);
+	return (failed > 0) ? 1 : 0;
+}
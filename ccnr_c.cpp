@@ -0,0 +1,191 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "ccnr_c.h"
+#include "CreditNumberRecog.h"
+#include "ModelFile.h"
+#include "RawImage.h"
+#include <memory>
+#include <new>
+
+struct ccnr_model
+{
+	std::shared_ptr<ccnr::CreditNumberRecog> recognizer;
+};
+
+struct ccnr_session
+{
+	// keeps the recognizer alive after ccnr_model_destroy
+	std::shared_ptr<const ccnr::CreditNumberRecog> recognizer;
+	ccnr::RecogOptions options;
+	cv::Mat gray;	// reused for pixel formats the pipeline does not take as they are
+};
+
+namespace{
+
+void SetStatus(int* status, int value)
+{
+	if(status)
+		*status = value;
+}
+
+}
+
+
+int ccnr_abi_version(void)
+{
+	return CCNR_ABI_VERSION;
+}
+
+
+const char* ccnr_status_string(int status)
+{
+	switch(status){
+	case CCNR_OK: return "ok";
+	case CCNR_ERROR_ARGUMENT: return "invalid argument";
+	case CCNR_ERROR_MODEL: return "model cannot be loaded";
+	case CCNR_ERROR_BUFFER: return "too many digits for the result";
+	case CCNR_ERROR_INTERNAL: return "internal error";
+	default: return "unknown status";
+	}
+}
+
+
+ccnr_model* ccnr_model_create(const char* model_file, int* status)
+{
+	try{
+		std::unique_ptr<ccnr_model> model(new ccnr_model());
+		model->recognizer = std::make_shared<ccnr::CreditNumberRecog>();
+		std::string file = model_file ? model_file : ccnr::ModelFile::DefaultModel();
+		if(model->recognizer->LoadClassifier(file) < 0){
+			SetStatus(status, CCNR_ERROR_MODEL);
+			return 0;
+		}
+		SetStatus(status, CCNR_OK);
+		return model.release();
+	}
+	catch(...){
+		SetStatus(status, CCNR_ERROR_INTERNAL);
+		return 0;
+	}
+}
+
+
+void ccnr_model_destroy(ccnr_model* model)
+{
+	delete model;
+}
+
+
+int ccnr_model_set_layouts(ccnr_model* model, const char* layouts)
+{
+	if(!model || !layouts)
+		return CCNR_ERROR_ARGUMENT;
+	try{
+		std::vector<ccnr::CreditLayout> parsed;
+		if(ccnr::CreditLayout::ParseList(layouts, parsed) < 0 || model->recognizer->SetLayouts(parsed) < 0)
+			return CCNR_ERROR_ARGUMENT;
+		return CCNR_OK;
+	}
+	catch(...){
+		return CCNR_ERROR_INTERNAL;
+	}
+}
+
+
+int ccnr_model_reload(ccnr_model* model, const char* model_file)
+{
+	if(!model || !model_file)
+		return CCNR_ERROR_ARGUMENT;
+	try{
+		return model->recognizer->LoadClassifier(model_file) < 0 ? CCNR_ERROR_MODEL : CCNR_OK;
+	}
+	catch(...){
+		return CCNR_ERROR_INTERNAL;
+	}
+}
+
+
+ccnr_session* ccnr_session_create(ccnr_model* model, int* status)
+{
+	if(!model){
+		SetStatus(status, CCNR_ERROR_ARGUMENT);
+		return 0;
+	}
+	ccnr_session* session = new(std::nothrow) ccnr_session();
+	if(!session){
+		SetStatus(status, CCNR_ERROR_INTERNAL);
+		return 0;
+	}
+	session->recognizer = model->recognizer;
+	SetStatus(status, CCNR_OK);
+	return session;
+}
+
+
+void ccnr_session_destroy(ccnr_session* session)
+{
+	delete session;
+}
+
+
+int ccnr_session_set_limits(ccnr_session* session, double time_limit_ms, long long max_steps)
+{
+	if(!session || time_limit_ms < 0 || max_steps < 0)
+		return CCNR_ERROR_ARGUMENT;
+	session->options.time_limit_ms = time_limit_ms;
+	session->options.max_search_work = max_steps;
+	return CCNR_OK;
+}
+
+
+int ccnr_recognize(ccnr_session* session, const unsigned char* pixels, int width, int height,
+	int stride, int format, ccnr_result* result)
+{
+	if(!session || !pixels || !result || width <= 0 || height <= 0 || stride < 0)
+		return CCNR_ERROR_ARGUMENT;
+	try{
+		cv::Mat img;
+		if(ccnr::RawImage::Wrap(pixels, width, height, stride, format, session->gray, img) < 0)
+			return CCNR_ERROR_ARGUMENT;
+
+		std::vector<int> numbers;
+		std::vector<cv::Rect> num_pos;
+		ccnr::RecogStatus recog_status;
+		session->recognizer->RecognizeCreditCardNumber(img, numbers, num_pos, session->options, &recog_status);
+		return ccnr::RawImage::StoreResult(numbers, num_pos, recog_status, *result);
+	}
+	catch(...){
+		return CCNR_ERROR_INTERNAL;
+	}
+}
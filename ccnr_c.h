@@ -0,0 +1,159 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2015 MINAGAWA Takuya.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __CCNR_C__
+#define __CCNR_C__
+
+/*!
+C interface of the recognizer for linking libccnr from other languages.
+
+A model holds the classifier and the digit layouts and may be shared by any
+number of sessions. A session holds the per-caller settings and is used by
+one thread at a time; run one session per thread to recognize in parallel.
+Images and results are owned by the caller and nothing is allocated per call
+that the caller has to free. No C++ exception crosses this interface.
+*/
+
+#if defined(_WIN32)
+#	if defined(CCNR_EXPORTS)
+#		define CCNR_API __declspec(dllexport)
+#	elif defined(CCNR_SHARED)
+#		define CCNR_API __declspec(dllimport)
+#	else
+#		define CCNR_API
+#	endif
+#elif defined(__GNUC__)
+#	define CCNR_API __attribute__((visibility("default")))
+#else
+#	define CCNR_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Incremented when a declaration in this file changes incompatibly
+#define CCNR_ABI_VERSION 1
+
+//! Capacity of ccnr_result::digits
+#define CCNR_MAX_DIGITS 32
+
+//! Return codes
+typedef enum{
+	CCNR_OK = 0,
+	CCNR_ERROR_ARGUMENT = -1,	//!< null pointer, bad size or unknown pixel format
+	CCNR_ERROR_MODEL = -2,	//!< model file cannot be read or does not fit
+	CCNR_ERROR_BUFFER = -3,	//!< more digits than CCNR_MAX_DIGITS
+	CCNR_ERROR_INTERNAL = -4	//!< unexpected failure inside the recognizer
+}ccnr_status;
+
+//! Pixel layout of an input image, 8 bits per channel
+typedef enum{
+	CCNR_PIXEL_GRAY8 = 0,
+	CCNR_PIXEL_BGR8 = 1,
+	CCNR_PIXEL_RGB8 = 2,
+	CCNR_PIXEL_BGRA8 = 3,
+	CCNR_PIXEL_RGBA8 = 4,
+	CCNR_PIXEL_YUV_NV12 = 5,	//!< Y plane followed by interleaved UV, only Y is read
+	CCNR_PIXEL_YUV_I420 = 6	//!< Y, U and V planes, only Y is read
+}ccnr_pixel_format;
+
+//! One recognized digit and its box in input image coordinates
+typedef struct{
+	int digit;
+	int x;
+	int y;
+	int width;
+	int height;
+}ccnr_digit;
+
+typedef struct{
+	int num_digits;
+	ccnr_digit digits[CCNR_MAX_DIGITS];
+	int truncated;	//!< 1 if the search limits of the session cut the search short
+	double cost;	//!< cost of the selected digit boxes (lower is better)
+	double elapsed_ms;
+}ccnr_result;
+
+typedef struct ccnr_model ccnr_model;
+typedef struct ccnr_session ccnr_session;
+
+//! CCNR_ABI_VERSION of the library that is actually loaded
+CCNR_API int ccnr_abi_version(void);
+
+//! Text of a ccnr_status
+CCNR_API const char* ccnr_status_string(int status);
+
+//! Load a model
+/*!
+\param[in] model_file text or binary model file, "builtin" or NULL for the default model
+\param[out] status CCNR_OK or the reason of the failure (may be NULL)
+\return NULL on failure
+*/
+CCNR_API ccnr_model* ccnr_model_create(const char* model_file, int* status);
+
+//! Release a model. Sessions created from it stay valid.
+CCNR_API void ccnr_model_destroy(ccnr_model* model);
+
+//! Digit layouts to search, e.g. "4-4-4-4,4-6-5,4-6-4"
+/*!
+Not to be called while sessions of the model are recognizing.
+*/
+CCNR_API int ccnr_model_set_layouts(ccnr_model* model, const char* layouts);
+
+//! Replace the classifier of a model, also while its sessions are recognizing
+CCNR_API int ccnr_model_reload(ccnr_model* model, const char* model_file);
+
+CCNR_API ccnr_session* ccnr_session_create(ccnr_model* model, int* status);
+
+CCNR_API void ccnr_session_destroy(ccnr_session* session);
+
+//! Limits of the character search per image (0: none)
+CCNR_API int ccnr_session_set_limits(ccnr_session* session, double time_limit_ms, long long max_steps);
+
+//! Recognize the card number in an image
+/*!
+\param[in] pixels first row of the image, not modified and not kept after the call
+\param[in] stride bytes from one row to the next, of the Y plane for YUV (0: packed rows)
+\param[in] format ccnr_pixel_format
+\param[out] result filled on CCNR_OK. On CCNR_ERROR_BUFFER num_digits is the number
+found and the first CCNR_MAX_DIGITS of them are stored.
+*/
+CCNR_API int ccnr_recognize(ccnr_session* session, const unsigned char* pixels, int width, int height,
+	int stride, int format, ccnr_result* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,59 @@
+# Convert the "svm_coeff" matrix of a cv::FileStorage YAML model into a C++
+# source holding the coefficients as a constexpr float array.
+#
+#   cmake -DINPUT=CreditModel.txt -DOUTPUT=EmbeddedModel.cpp -P EmbedModel.cmake
+#
+# The values are written as the double literals of the YAML file, so the
+# compiler rounds them to float exactly like NumberRecog::Load does.
+
+if(NOT INPUT OR NOT OUTPUT)
+    message(FATAL_ERROR "EmbedModel.cmake needs -DINPUT=<model> -DOUTPUT=<source>")
+endif()
+
+file(READ ${INPUT} model)
+
+string(REGEX MATCH "svm_coeff:[^\n]*\n[ \t]*rows:[ \t]*([0-9]+)" _ "${model}")
+set(rows ${CMAKE_MATCH_1})
+string(REGEX MATCH "svm_coeff:[^\n]*\n[ \t]*rows:[^\n]*\n[ \t]*cols:[ \t]*([0-9]+)" _ "${model}")
+set(cols ${CMAKE_MATCH_1})
+if(NOT rows OR NOT cols)
+    message(FATAL_ERROR "${INPUT}: svm_coeff rows/cols not found")
+endif()
+
+string(REGEX MATCH "data:[ \t\n]*\\[[^]]*\\]" data "${model}")
+string(REGEX REPLACE "^data:[ \t\n]*\\[" "" data "${data}")
+string(REGEX MATCHALL "[-+]?[0-9]+(\\.[0-9]*)?([eE][-+]?[0-9]+)?" values "${data}")
+list(LENGTH values count)
+math(EXPR expected "${rows} * ${cols}")
+if(NOT count EQUAL expected)
+    message(FATAL_ERROR "${INPUT}: ${count} coefficients, expected ${rows} x ${cols}")
+endif()
+
+string(REPLACE ";" ",\n\t" values "${values}")
+get_filename_component(input_name ${INPUT} NAME)
+
+file(WRITE ${OUTPUT}.tmp
+"// Generated from ${input_name} by cmake/EmbedModel.cmake. Do not edit.
+
+namespace ccnr{
+
+namespace{
+
+alignas(64) constexpr float EMBEDDED_COEFFS[${rows} * ${cols}] = {
+\t${values}
+};
+
+}
+
+const float* EmbeddedModelData(int& rows, int& cols)
+{
+\trows = ${rows};
+\tcols = ${cols};
+\treturn EMBEDDED_COEFFS;
+}
+
+}
+")
+# keep the timestamp if nothing changed so that dependents are not rebuilt
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different ${OUTPUT}.tmp ${OUTPUT})
+file(REMOVE ${OUTPUT}.tmp)
@@ -40,6 +40,7 @@
 #include <boost/program_options.hpp>
 #include <boost/filesystem/operations.hpp>
 #include "MainAPI.h"
+#include "ModelFile.h"
 #include "util.h"
 
 using namespace boost::program_options;
@@ -54,16 +55,62 @@ void print_help(const options_description& opt)
 
 
 bool parse_command(int argc, char* argv[], std::string& input,
-	std::string& model_file, std::string& output, bool& use_camera)
+	std::string& model_file, std::string& output, bool& use_camera, bool& profile, ccnr::RecogOptions& recog_opt, bool& multi_card, size_t& cache_size, std::string& layouts, std::string& convert_file, bool& quantize, double& watch_sec,
+	std::string& shm_name, int& shm_slots, size_t& shm_frame_bytes, int& shm_threads, int& shm_producers,
+	std::string& feature_dir, int& threads, bool& resume, ccnr::AugmentParams& augment,
+	std::string& train_file, std::string& ovr_file, ccnr::SvmTrainParams& svm_params,
+	std::string& detector_file, std::string& mine_file, ccnr::MiningParams& mining)
 {
 	// Setting of option arguments
 	options_description opt("option");
 	opt.add_options()
 		("input,i", value<std::string>()->default_value(std::string()), "Input image file or directory path")
 		("help,h", "print help")
-		("model,m", value<std::string>()->default_value("CreditModel.txt"), "Trained model file path")
+		("model,m", value<std::string>()->default_value(ccnr::ModelFile::DefaultModel()), "Trained model file path (\"builtin\": compiled-in model)")
 		("output,o", value<std::string>()->default_value(std::string()), "Generate output image or directory path")
-		("camera,c", "Use web camera input");
+		("camera,c", "Use web camera input")
+		("profile,p", "Print per-stage latency statistics at the end")
+		("time-limit,t", value<double>()->default_value(0), "Deadline of the character search per image [ms] (0: none)")
+		("max-steps", value<long long>()->default_value(0), "Work limit of the character search per image (0: none)")
+		("locate-card", "Find the card in a wide photo and rectify it before the recognition")
+		("locate-ms", value<double>()->default_value(ccnr::LocatorParams().time_limit_ms), "Time limit of \"--locate-card\" [ms]; the whole image is used when it runs out")
+		("multi-card", "Read every card of a scanned page, each card by its own thread (see --threads)")
+		("card-min-area", value<double>()->default_value(ccnr::LocatorParams().min_area), "Smallest card of \"--locate-card\" and \"--multi-card\" (ratio to the image area)")
+		("deskew", "Measure and undo a small skew of the card before the digits are searched")
+		("max-skew", value<double>()->default_value(ccnr::DeskewParams().max_angle), "Largest skew searched by \"--deskew\" [degree]")
+		("orientations", value<std::string>()->default_value("upright"), "Card orientations searched: upright, upside_down, mirrored, flipped (comma separated) or all")
+		("layouts,l", value<std::string>()->default_value(std::string()), "Digit layouts to search, e.g. 4-4-4-4,4-6-5,4-6-4,4-4-4-4-3")
+		("convert-model", value<std::string>()->default_value(std::string()), "Convert the model to the binary format and exit")
+		("quantize", "Store 8 bit coefficients with --convert-model")
+		("watch-model", value<double>()->default_value(0), "Reload the model when the file changes or on SIGHUP, polling every SEC seconds (0: off)")
+		("cache-size", value<size_t>()->default_value(0), "Results of byte-identical images or --shm frames kept to skip their recognition (0: no cache)")
+		("shm", value<std::string>()->default_value(std::string()), "Serve raw frames written into this shared-memory ring until SIGINT")
+		("shm-slots", value<int>()->default_value(8), "Frame slots of the --shm ring")
+		("shm-frame-bytes", value<size_t>()->default_value(1920 * 1080 * 3), "Largest frame of the --shm ring [byte]")
+		("shm-threads", value<int>()->default_value(1), "Recognition threads of --shm")
+		("shm-producers", value<int>()->default_value(8), "Producers that can be connected to the --shm ring at the same time")
+		("create-features", value<std::string>()->default_value(std::string()), "Write the features of DIR/0 ... DIR/9 and DIR/bg to the binary file given by --output and exit")
+		("threads", value<int>()->default_value(0), "Threads of --create-features, --mine-negatives and --multi-card (0: all cores)")
+		("resume", "Continue an interrupted --create-features or --mine-negatives run")
+		("augment", value<int>()->default_value(0), "Variants of every image added by --create-features (shift, scale, blur, contrast)")
+		("augment-seed", value<unsigned long long>()->default_value(ccnr::AugmentParams().seed), "Seed of --augment")
+		("aug-shift", value<double>()->default_value(ccnr::AugmentParams().max_shift), "Max shift of --augment (ratio to the sample size)")
+		("aug-scale", value<double>()->default_value(ccnr::AugmentParams().max_scale), "Max scale change of --augment (ratio)")
+		("aug-blur", value<double>()->default_value(ccnr::AugmentParams().max_blur), "Max Gaussian blur sigma of --augment")
+		("aug-contrast", value<double>()->default_value(ccnr::AugmentParams().max_contrast), "Max contrast change of --augment (ratio)")
+		("aug-brightness", value<double>()->default_value(ccnr::AugmentParams().max_brightness), "Max brightness offset of --augment (gray levels)")
+		("train", value<std::string>()->default_value(std::string()), "Train the classifier on a --create-features file, save it to --output and exit")
+		("train-ovr", value<std::string>()->default_value(std::string()), "Also train the one-vs-rest detector into this file")
+		("svm-c", value<double>()->default_value(1.0), "SVM cost of margin violations")
+		("svm-hinge", "Train with the hinge loss instead of the squared hinge loss")
+		("svm-eps", value<double>()->default_value(0.1), "SVM stopping tolerance")
+		("svm-iter", value<int>()->default_value(1000), "Maximum passes over the samples per SVM")
+		("detector", value<std::string>()->default_value(std::string()), "One-vs-rest detector file (as written by --train-ovr)")
+		("engine", value<std::string>()->default_value("projection"), "Costs of the digit segmentation: projection, detector (needs --detector) or mixed")
+		("detector-weight", value<double>()->default_value(1.0), "Weight of the detector costs of \"--engine mixed\"")
+		("mine-negatives", value<std::string>()->default_value(std::string()), "Add the --detector's false positives on the cards of this box file to the --output feature file and exit")
+		("mine-max", value<int>()->default_value(ccnr::MiningParams().max_per_image), "Hard negatives kept per card")
+		("mine-score", value<double>()->default_value(ccnr::MiningParams().min_score), "Digit probability above which a window is a hard negative");
 
 	// Arguments
 	//positional_options_description p;
@@ -85,12 +132,82 @@ bool parse_command(int argc, char* argv[], std::string& input,
 		}
 
 		use_camera = !argmap["camera"].empty();
+		profile = !argmap["profile"].empty();
 		input = argmap["input"].as<std::string>();
 		output = argmap["output"].as<std::string>();
 		model_file = argmap["model"].as<std::string>();
+		recog_opt.time_limit_ms = argmap["time-limit"].as<double>();
+		recog_opt.max_search_work = argmap["max-steps"].as<long long>();
+		recog_opt.engine = ccnr::CreditNumberRecog::ParseEngine(argmap["engine"].as<std::string>());
+		recog_opt.detector_weight = argmap["detector-weight"].as<double>();
+		recog_opt.locate_card = !argmap["locate-card"].empty();
+		recog_opt.locator.time_limit_ms = argmap["locate-ms"].as<double>();
+		recog_opt.locator.min_area = argmap["card-min-area"].as<double>();
+		multi_card = !argmap["multi-card"].empty();
+		cache_size = argmap["cache-size"].as<size_t>();
+		recog_opt.deskew = !argmap["deskew"].empty();
+		recog_opt.skew.max_angle = argmap["max-skew"].as<double>();
+		recog_opt.orientations = ccnr::CreditNumberRecog::ParseOrientations(argmap["orientations"].as<std::string>());
+		layouts = argmap["layouts"].as<std::string>();
+		convert_file = argmap["convert-model"].as<std::string>();
+		quantize = !argmap["quantize"].empty();
+		watch_sec = argmap["watch-model"].as<double>();
+		shm_name = argmap["shm"].as<std::string>();
+		shm_slots = argmap["shm-slots"].as<int>();
+		shm_frame_bytes = argmap["shm-frame-bytes"].as<size_t>();
+		shm_threads = argmap["shm-threads"].as<int>();
+		shm_producers = argmap["shm-producers"].as<int>();
+		feature_dir = argmap["create-features"].as<std::string>();
+		threads = argmap["threads"].as<int>();
+		resume = !argmap["resume"].empty();
+		augment.variants = argmap["augment"].as<int>();
+		augment.seed = argmap["augment-seed"].as<unsigned long long>();
+		augment.max_shift = argmap["aug-shift"].as<double>();
+		augment.max_scale = argmap["aug-scale"].as<double>();
+		augment.max_blur = argmap["aug-blur"].as<double>();
+		augment.max_contrast = argmap["aug-contrast"].as<double>();
+		augment.max_brightness = argmap["aug-brightness"].as<double>();
+		train_file = argmap["train"].as<std::string>();
+		ovr_file = argmap["train-ovr"].as<std::string>();
+		svm_params.C = argmap["svm-c"].as<double>();
+		svm_params.squared_hinge = argmap["svm-hinge"].empty();
+		svm_params.eps = argmap["svm-eps"].as<double>();
+		svm_params.max_iter = argmap["svm-iter"].as<int>();
+		svm_params.threads = threads;
+		detector_file = argmap["detector"].as<std::string>();
+		mine_file = argmap["mine-negatives"].as<std::string>();
+		mining.max_per_image = argmap["mine-max"].as<int>();
+		mining.min_score = argmap["mine-score"].as<double>();
 
 		////// verify command arguments ///////
-		if (use_camera) {
+		if (recog_opt.engine < 0) {
+			throw std::invalid_argument("\"--engine\" must be projection, detector or mixed.");
+		}
+		if (recog_opt.orientations < 0) {
+			throw std::invalid_argument("\"--orientations\" must list upright, upside_down, mirrored or flipped, or be all.");
+		}
+		if (recog_opt.engine != ccnr::ENGINE_PROJECTION && detector_file.empty()) {
+			throw std::invalid_argument("\"--engine detector\" and \"--engine mixed\" need \"--detector\".");
+		}
+		if (!convert_file.empty()) {
+			// only the model is used
+		}
+		else if (!feature_dir.empty() || !train_file.empty()) {
+			if (output.empty()) {
+				throw std::invalid_argument("\"--create-features\" and \"--train\" need \"--output\" file.");
+			}
+		}
+		else if (!mine_file.empty()) {
+			if (output.empty() || detector_file.empty()) {
+				throw std::invalid_argument("\"--mine-negatives\" needs \"--output\" feature file and \"--detector\".");
+			}
+		}
+		else if (!shm_name.empty()) {
+			if (shm_slots <= 0 || shm_frame_bytes == 0) {
+				throw std::invalid_argument("\"--shm-slots\" and \"--shm-frame-bytes\" must be positive.");
+			}
+		}
+		else if (use_camera) {
 			if (!output.empty() && !hasImageExtention(output)) {
 				throw std::invalid_argument("\"--output\" must be image file path.");
 			}
@@ -129,16 +246,50 @@ bool parse_command(int argc, char* argv[], std::string& input,
 int CommandLineExe(int argc, char * argv[])
 {
 	MainAPI CCNR;
-	std::string conf_file, input, output, model_file;
-	bool use_camera;
-	if (!parse_command(argc, argv, input, model_file, output, use_camera))
+	std::string conf_file, input, output, model_file, layouts, convert_file;
+	bool use_camera, profile, quantize;
+	double watch_sec;
+	std::string shm_name;
+	int shm_slots, shm_threads, shm_producers;
+	size_t shm_frame_bytes, cache_size;
+	std::string feature_dir;
+	int threads;
+	bool resume;
+	ccnr::AugmentParams augment;
+	std::string train_file, ovr_file;
+	ccnr::SvmTrainParams svm_params;
+	std::string detector_file, mine_file;
+	ccnr::MiningParams mining;
+	if (!parse_command(argc, argv, input, model_file, output, use_camera, profile, CCNR.Options, CCNR.MultiCard, cache_size, layouts, convert_file, quantize, watch_sec,
+		shm_name, shm_slots, shm_frame_bytes, shm_threads, shm_producers, feature_dir, threads, resume, augment, train_file, ovr_file, svm_params,
+		detector_file, mine_file, mining))
+		return -1;
+	CCNR.PageThreads = threads;
+	CCNR.EnableResultCache(cache_size);
+	if (!train_file.empty())
+		return CCNR.Train(train_file, output, ovr_file, svm_params) ? 0 : -1;
+	if (!feature_dir.empty())
+		return CCNR.CreateTrainingFeatureFile(feature_dir, output, threads, resume, augment) ? 0 : -1;
+	if (!convert_file.empty())
+		return CCNR.ConvertModel(model_file, convert_file, quantize) ? 0 : -1;
+	if (!layouts.empty() && !CCNR.SetLayouts(layouts))
 		return -1;
 
 	try {
 		if (!CCNR.LoadClassifier(model_file))
 			return -1;
+		if (watch_sec > 0 && !CCNR.WatchClassifier(watch_sec))
+			return -1;
+		if (!detector_file.empty() && !CCNR.LoadDetector(detector_file))
+			return -1;
+		if (!mine_file.empty())
+			return CCNR.MineHardNegatives(mine_file, output, mining, threads, resume) ? 0 : -1;
 
-		if (use_camera) {
+		if (!shm_name.empty()) {
+			if (!CCNR.ServeSharedMemory(shm_name, shm_slots, shm_frame_bytes, shm_threads, shm_producers))
+				return -1;
+		}
+		else if (use_camera) {
 			CCNR.RecognizeVideoCapture(output);
 		}
 		else if (hasImageExtention(input)) {
@@ -147,6 +298,9 @@ int CommandLineExe(int argc, char * argv[])
 		else if (is_directory(path(input))) {
 			CCNR.RecognizeFolder(input, output);
 		}
+		if (profile) {
+			CCNR.PrintProfile(std::cout);
+		}
 		return 0;
 	}
 	catch (std::exception& e) {
@@ -186,10 +340,22 @@ void printMenu()
 	std::cout << "img2feature" << std::endl;
 	std::cout << "create_train_features" << std::endl;
 	std::cout << "create_all_train_features" << std::endl;
+	std::cout << "create_feature_file" << std::endl;
+	std::cout << "train" << std::endl;
+	std::cout << "mine_negatives" << std::endl;
 	std::cout << "load" << std::endl;
+	std::cout << "load_detector" << std::endl;
+	std::cout << "engine" << std::endl;
+	std::cout << "locate_card" << std::endl;
+	std::cout << "multi_card" << std::endl;
+	std::cout << "cache" << std::endl;
+	std::cout << "deskew" << std::endl;
+	std::cout << "orientations" << std::endl;
+	std::cout << "convert_model" << std::endl;
 	std::cout << "recog" << std::endl;
 	std::cout << "recog_folder" << std::endl;
 	std::cout << "recog_capture" << std::endl;
+	std::cout << "profile" << std::endl;
 	std::cout << "exit" << std::endl;
 }
 
@@ -206,6 +372,9 @@ int main(int argc, char * argv[])
 	}
 
 	MainAPI CCNR;
+	if (ccnr::ModelFile::HasBuiltin()) {
+		CCNR.LoadClassifier(ccnr::ModelFile::BUILTIN_MODEL);
+	}
 	bool exitflag1 = false;
 	std::string opt;
 
@@ -239,10 +408,80 @@ int main(int argc, char * argv[])
 			std::string save_dir = AskQuestionGetString("Save Directory Name: ");
 			CCNR.CreateTrainingAllFeatures(load_dir, save_dir);
 		}
+		else if(opt == "create_feature_file"){
+			std::string load_dir = AskQuestionGetString("Load Directory Name: ");
+			std::string save_file = AskQuestionGetString("Save Feature File Name: ");
+			int threads = AskQuestionGetInt("Threads (0: all cores): ");
+			int resume = AskQuestionGetInt("Resume (0: no, 1: yes): ");
+			ccnr::AugmentParams augment;
+			augment.variants = AskQuestionGetInt("Augmented variants per image (0: none): ");
+			CCNR.CreateTrainingFeatureFile(load_dir, save_file, threads, resume != 0, augment);
+		}
+		else if(opt == "train"){
+			std::string feature_file = AskQuestionGetString("Feature File Name: ");
+			std::string model_file = AskQuestionGetString("Save Classifier File: ");
+			std::string ovr_file = AskQuestionGetString("Save Detector File (none: no detector): ");
+			if(ovr_file == "none")
+				ovr_file.clear();
+			ccnr::SvmTrainParams params;
+			params.C = AskQuestionGetDouble("SVM C: ");
+			CCNR.Train(feature_file, model_file, ovr_file, params);
+		}
+		else if(opt == "mine_negatives"){
+			std::string detector_file = AskQuestionGetString("Detector File: ");
+			std::string box_file = AskQuestionGetString("Digit Box File: ");
+			std::string feature_file = AskQuestionGetString("Feature File Name: ");
+			ccnr::MiningParams params;
+			params.max_per_image = AskQuestionGetInt("Hard negatives per card: ");
+			int resume = AskQuestionGetInt("Resume (0: no, 1: yes): ");
+			if(CCNR.LoadDetector(detector_file))
+				CCNR.MineHardNegatives(box_file, feature_file, params, 0, resume != 0);
+		}
 		else if(opt == "load"){
 			std::string filename = AskQuestionGetString("Classifier File: ");
 			CCNR.LoadClassifier(filename);
 		}
+		else if(opt == "load_detector"){
+			std::string filename = AskQuestionGetString("Detector File: ");
+			CCNR.LoadDetector(filename);
+		}
+		else if(opt == "engine"){
+			std::string name = AskQuestionGetString("Engine (projection, detector, mixed): ");
+			int engine = ccnr::CreditNumberRecog::ParseEngine(name);
+			if(engine < 0)
+				std::cerr << "Unknown engine " << name << std::endl;
+			else
+				CCNR.Options.engine = engine;
+		}
+		else if(opt == "locate_card"){
+			CCNR.Options.locate_card = (AskQuestionGetInt("Locate the card in wide photos (0: no, 1: yes): ") != 0);
+		}
+		else if(opt == "multi_card"){
+			CCNR.MultiCard = (AskQuestionGetInt("Read every card of a page (0: no, 1: yes): ") != 0);
+			if(CCNR.MultiCard)
+				CCNR.PageThreads = AskQuestionGetInt("Threads (0: all cores): ");
+		}
+		else if(opt == "cache"){
+			int entries = AskQuestionGetInt("Results kept for identical images (0: no cache): ");
+			CCNR.EnableResultCache(entries > 0 ? entries : 0);
+		}
+		else if(opt == "deskew"){
+			CCNR.Options.deskew = (AskQuestionGetInt("Undo the skew of cards (0: no, 1: yes): ") != 0);
+		}
+		else if(opt == "orientations"){
+			std::string names = AskQuestionGetString("Orientations (e.g. upright,upside_down or all): ");
+			int orientations = ccnr::CreditNumberRecog::ParseOrientations(names);
+			if(orientations < 0)
+				std::cerr << "Unknown orientations " << names << std::endl;
+			else
+				CCNR.Options.orientations = orientations;
+		}
+		else if(opt == "convert_model"){
+			std::string src_file = AskQuestionGetString("Model File: ");
+			std::string dst_file = AskQuestionGetString("Save Binary Model File: ");
+			int quantize = AskQuestionGetInt("8 bit coefficients (0: no, 1: yes): ");
+			CCNR.ConvertModel(src_file, dst_file, quantize != 0);
+		}
 		else if(opt == "recog"){
 			std::string filename = AskQuestionGetString("Image File Name: ");
 			std::string save_name = AskQuestionGetString("Save File Name: ");
@@ -256,6 +495,10 @@ int main(int argc, char * argv[])
 		else if (opt == "recog_capture") {
 			CCNR.RecognizeVideoCapture();
 		}
+		else if (opt == "profile") {
+			CCNR.PrintProfile(std::cout);
+			CCNR.PrintCacheStatistics(std::cout);
+		}
 		else{
 			std::cout << "Error: Wrong Command\n" << std::endl;
 		}